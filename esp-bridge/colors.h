@@ -0,0 +1,172 @@
+/*
+
+FAUXMO ESP
+
+Copyright (C) 2018-2020 by Xose Pérez <xose dot perez at gmail dot com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// -----------------------------------------------------------------------------
+// Colour conversion
+// Integer only and allocation free, results are written straight into the
+// caller's rgb[3] (usually fauxmoesp_device_t::rgb). Tables are precomputed.
+// -----------------------------------------------------------------------------
+
+#define FAUXMO_CT_MIN               153     // mired, 6500K
+#define FAUXMO_CT_MAX               500     // mired, 2000K
+
+// Linear 0..255 to sRGB encoded 0..255
+PROGMEM constexpr uint8_t FAUXMO_GAMMA_TABLE[256] = {
+      0,  13,  22,  28,  34,  38,  42,  46,  50,  53,  56,  59,  61,  64,  66,  69,
+     71,  73,  75,  77,  79,  81,  83,  85,  86,  88,  90,  92,  93,  95,  96,  98,
+     99, 101, 102, 104, 105, 106, 108, 109, 110, 112, 113, 114, 115, 117, 118, 119,
+    120, 121, 122, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136,
+    137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148, 148, 149, 150, 151,
+    152, 153, 154, 155, 155, 156, 157, 158, 159, 159, 160, 161, 162, 163, 163, 164,
+    165, 166, 167, 167, 168, 169, 170, 170, 171, 172, 173, 173, 174, 175, 175, 176,
+    177, 178, 178, 179, 180, 180, 181, 182, 182, 183, 184, 185, 185, 186, 187, 187,
+    188, 189, 189, 190, 190, 191, 192, 192, 193, 194, 194, 195, 196, 196, 197, 197,
+    198, 199, 199, 200, 200, 201, 202, 202, 203, 203, 204, 205, 205, 206, 206, 207,
+    208, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213, 214, 214, 215, 215, 216,
+    216, 217, 218, 218, 219, 219, 220, 220, 221, 221, 222, 222, 223, 223, 224, 224,
+    225, 226, 226, 227, 227, 228, 228, 229, 229, 230, 230, 231, 231, 232, 232, 233,
+    233, 234, 234, 235, 235, 236, 236, 237, 237, 238, 238, 238, 239, 239, 240, 240,
+    241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246, 246, 247, 247, 248,
+    248, 249, 249, 250, 250, 251, 251, 251, 252, 252, 253, 253, 254, 254, 255, 255,
+};
+
+// Green and blue for every mired from FAUXMO_CT_MIN to FAUXMO_CT_MAX, red is
+// always 255 below 6600K (Tanner Helland's black body approximation)
+PROGMEM constexpr uint8_t FAUXMO_CT_TABLE[2 * (FAUXMO_CT_MAX - FAUXMO_CT_MIN + 1)] = {
+    255, 251, 254, 250, 253, 249, 253, 248, 252, 247, 251, 246, 251, 245, 250, 244,
+    250, 243, 249, 242, 248, 241, 248, 240, 247, 239, 247, 238, 246, 237, 245, 236,
+    245, 235, 244, 234, 244, 233, 243, 232, 242, 231, 242, 230, 241, 229, 241, 228,
+    240, 227, 240, 226, 239, 225, 238, 224, 238, 223, 237, 222, 237, 221, 236, 220,
+    236, 219, 235, 218, 235, 217, 234, 217, 234, 216, 233, 215, 233, 214, 232, 213,
+    232, 212, 231, 211, 231, 210, 230, 209, 230, 209, 229, 208, 229, 207, 228, 206,
+    228, 205, 227, 204, 227, 203, 226, 202, 226, 202, 225, 201, 225, 200, 224, 199,
+    224, 198, 223, 197, 223, 197, 222, 196, 222, 195, 221, 194, 221, 193, 220, 192,
+    220, 192, 219, 191, 219, 190, 219, 189, 218, 188, 218, 188, 217, 187, 217, 186,
+    216, 185, 216, 184, 215, 184, 215, 183, 215, 182, 214, 181, 214, 180, 213, 180,
+    213, 179, 212, 178, 212, 177, 212, 177, 211, 176, 211, 175, 210, 174, 210, 174,
+    209, 173, 209, 172, 209, 171, 208, 171, 208, 170, 207, 169, 207, 168, 207, 168,
+    206, 167, 206, 166, 205, 165, 205, 165, 205, 164, 204, 163, 204, 162, 203, 162,
+    203, 161, 203, 160, 202, 160, 202, 159, 202, 158, 201, 157, 201, 157, 200, 156,
+    200, 155, 200, 155, 199, 154, 199, 153, 199, 152, 198, 152, 198, 151, 197, 150,
+    197, 150, 197, 149, 196, 148, 196, 147, 196, 147, 195, 146, 195, 145, 195, 145,
+    194, 144, 194, 143, 193, 143, 193, 142, 193, 141, 192, 141, 192, 140, 192, 139,
+    191, 139, 191, 138, 191, 137, 190, 137, 190, 136, 190, 135, 189, 135, 189, 134,
+    189, 133, 188, 133, 188, 132, 188, 131, 187, 131, 187, 130, 187, 129, 186, 129,
+    186, 128, 186, 127, 185, 127, 185, 126, 185, 125, 184, 125, 184, 124, 184, 123,
+    183, 123, 183, 122, 183, 122, 183, 121, 182, 120, 182, 120, 182, 119, 181, 118,
+    181, 118, 181, 117, 180, 116, 180, 116, 180, 115, 179, 115, 179, 114, 179, 113,
+    179, 113, 178, 112, 178, 111, 178, 111, 177, 110, 177, 110, 177, 109, 176, 108,
+    176, 108, 176, 107, 176, 106, 175, 106, 175, 105, 175, 105, 174, 104, 174, 103,
+    174, 103, 173, 102, 173, 101, 173, 101, 173, 100, 172, 100, 172,  99, 172,  98,
+    171,  98, 171,  97, 171,  97, 171,  96, 170,  95, 170,  95, 170,  94, 170,  94,
+    169,  93, 169,  92, 169,  92, 168,  91, 168,  91, 168,  90, 168,  89, 167,  89,
+    167,  88, 167,  88, 167,  87, 166,  86, 166,  86, 166,  85, 165,  85, 165,  84,
+    165,  83, 165,  83, 164,  82, 164,  82, 164,  81, 164,  81, 163,  80, 163,  79,
+    163,  79, 163,  78, 162,  78, 162,  77, 162,  76, 162,  76, 161,  75, 161,  75,
+    161,  74, 161,  74, 160,  73, 160,  72, 160,  72, 160,  71, 159,  71, 159,  70,
+    159,  69, 159,  69, 158,  68, 158,  68, 158,  67, 158,  67, 157,  66, 157,  65,
+    157,  65, 157,  64, 156,  64, 156,  63, 156,  63, 156,  62, 155,  61, 155,  61,
+    155,  60, 155,  60, 154,  59, 154,  59, 154,  58, 154,  57, 154,  57, 153,  56,
+    153,  56, 153,  55, 153,  55, 152,  54, 152,  54, 152,  53, 152,  52, 151,  52,
+    151,  51, 151,  51, 151,  50, 150,  50, 150,  49, 150,  48, 150,  48, 150,  47,
+    149,  47, 149,  46, 149,  46, 149,  45, 148,  45, 148,  44, 148,  43, 148,  43,
+    148,  42, 147,  42, 147,  41, 147,  41, 147,  40, 146,  39, 146,  39, 146,  38,
+    146,  38, 146,  37, 145,  37, 145,  36, 145,  36, 145,  35, 145,  34, 144,  34,
+    144,  33, 144,  33, 144,  32, 143,  32, 143,  31, 143,  31, 143,  30, 143,  29,
+    142,  29, 142,  28, 142,  28, 142,  27, 142,  27, 141,  26, 141,  26, 141,  25,
+    141,  24, 141,  24, 140,  23, 140,  23, 140,  22, 140,  22, 139,  21, 139,  21,
+    139,  20, 139,  19, 139,  19, 138,  18, 138,  18, 138,  17, 138,  17, 138,  16,
+    137,  16, 137,  15, 137,  14, 137,  14,
+};
+
+// hue 0..65535, sat 0..255, full value
+inline void fauxmoesp_hs2rgb(uint16_t hue, uint8_t sat, byte * rgb) {
+
+    // Six sectors of 65536/6, f is the 8 bit position inside the sector
+    uint32_t h6 = (uint32_t) hue * 6;
+    uint8_t sector = h6 >> 16;
+    uint16_t f = (h6 >> 8) & 0xFF;
+    uint8_t p = 255 - sat;
+    uint8_t q = 255 - ((f * sat) >> 8);
+    uint8_t t = 255 - (((256 - f) * sat) >> 8);
+
+    switch (sector) {
+        case 0: rgb[0] = 255; rgb[1] = t; rgb[2] = p; break;
+        case 1: rgb[0] = q; rgb[1] = 255; rgb[2] = p; break;
+        case 2: rgb[0] = p; rgb[1] = 255; rgb[2] = t; break;
+        case 3: rgb[0] = p; rgb[1] = q; rgb[2] = 255; break;
+        case 4: rgb[0] = t; rgb[1] = p; rgb[2] = 255; break;
+        default: rgb[0] = 255; rgb[1] = p; rgb[2] = q;
+    }
+
+}
+
+// Colour temperature in mired, clamped to the Hue range
+inline void fauxmoesp_ct2rgb(uint16_t ct, byte * rgb) {
+    if (ct < FAUXMO_CT_MIN) ct = FAUXMO_CT_MIN;
+    if (ct > FAUXMO_CT_MAX) ct = FAUXMO_CT_MAX;
+    const uint8_t * entry = FAUXMO_CT_TABLE + 2 * (ct - FAUXMO_CT_MIN);
+    rgb[0] = 255;
+    rgb[1] = pgm_read_byte(entry);
+    rgb[2] = pgm_read_byte(entry + 1);
+}
+
+// CIE 1931 xy in 1/10000 units (as parsed by _parseState), full brightness
+inline void fauxmoesp_xy2rgb(uint16_t x, uint16_t y, byte * rgb) {
+
+    // xyY to XYZ with Y = 1, all in 1/10000
+    if (y == 0) y = 1;
+    int32_t z = 10000 - (int32_t) x - (int32_t) y;
+    if (z < 0) z = 0;
+    int64_t X = (int64_t) x * 10000 / y;
+    int64_t Y = 10000;
+    int64_t Z = (int64_t) z * 10000 / y;
+
+    // Wide gamut D65 matrix from the Hue SDK, coefficients * 10000
+    int64_t c[3] = {
+         X * 16565 - Y * 3549 - Z * 2550,
+        -X * 7072 + Y * 16554 + Z * 362,
+         X * 517 - Y * 1214 + Z * 10115
+    };
+
+    // Brightest channel to full scale, then gamma
+    int64_t top = 0;
+    for (unsigned char i=0; i<3; i++) {
+        if (c[i] < 0) c[i] = 0;
+        if (c[i] > top) top = c[i];
+    }
+    for (unsigned char i=0; i<3; i++) {
+        uint8_t linear = (top > 0) ? (c[i] * 255 + top / 2) / top : 255;
+        rgb[i] = pgm_read_byte(FAUXMO_GAMMA_TABLE + linear);
+    }
+
+}
@@ -42,6 +42,7 @@ enum SerialState {
     WAITING_DEVICE_TYPE,
     WAITING_DEVICE_PIN,
     WAITING_DEVICE_URL,
+    WAITING_DEVICE_MEMBERS,
     WAITING_DEVICE_REMOVE,
     WAITING_RESET_CONFIRM
 };
@@ -191,6 +192,9 @@ void processInput(const String& input) {
         case WAITING_DEVICE_URL:
             handleDeviceURLInput(trimmedInput);
             break;
+        case WAITING_DEVICE_MEMBERS:
+            handleDeviceMembersInput(trimmedInput);
+            break;
         case WAITING_DEVICE_REMOVE:
             handleDeviceRemoveInput(trimmedInput);
             break;
@@ -233,8 +237,14 @@ void handleMainCommand(const String& input) {
                 serialController->println("❌ WiFi non connesso o nessun dispositivo");
             }
             break;
+        case 8: // Latenze comandi
+            alexaController->printLatency();
+            break;
+        case 9: // Esporta latenze
+            alexaController->exportLatency();
+            break;
         default:
-            serialController->println("❌ Opzione non valida! Scegli 0-7");
+            serialController->println("❌ Opzione non valida! Scegli 0-9");
             break;
     }
     
@@ -269,6 +279,12 @@ void handleDeviceNameInput(const String& input) {
         return;
     }
     
+    if (input.length() > SystemConfig::MAX_DEVICE_NAME_LENGTH) {
+        serialController->printf("❌ Nome troppo lungo (max %d caratteri)! Riprova:\n", SystemConfig::MAX_DEVICE_NAME_LENGTH);
+        serialController->promptDeviceName();
+        return;
+    }
+    
     if (deviceController->deviceExists(input)) {
         serialController->println("❌ Dispositivo esistente! Riprova:");
         serialController->promptDeviceName();
@@ -297,8 +313,15 @@ void handleDeviceTypeInput(const String& input) {
             serialController->promptDeviceURL();
             currentState = WAITING_DEVICE_URL;
             break;
+        case 3:
+            if (deviceController->getDeviceCount() > 0) {
+                deviceController->printDevices();
+            }
+            serialController->promptGroupMembers(SystemConfig::getInstance()->GROUP_MAX_MEMBERS);
+            currentState = WAITING_DEVICE_MEMBERS;
+            break;
         default:
-            serialController->println("❌ Scelta non valida! Riprova (1/2/0):");
+            serialController->println("❌ Scelta non valida! Riprova (1/2/3/0):");
             serialController->promptDeviceType();
             break;
     }
@@ -355,6 +378,28 @@ void handleDeviceURLInput(const String& input) {
     showMainMenu();
 }
 
+void handleDeviceMembersInput(const String& input) {
+    if (input == "0") {
+        serialController->println("ℹ️ Aggiunta annullata");
+        showMainMenu();
+        return;
+    }
+    
+    if (!deviceController->addGroup(pendingDeviceName, input)) {
+        serialController->println("Riprova:");
+        serialController->promptGroupMembers(SystemConfig::getInstance()->GROUP_MAX_MEMBERS);
+        return;
+    }
+    
+    serialController->printf("✅ '%s' configurato come gruppo: %s\n", pendingDeviceName.c_str(), input.c_str());
+    if (wifiController->isWiFiConnected()) {
+        alexaController->restart();
+    }
+    
+    delay(SystemConfig::getInstance()->MENU_RETURN_DELAY);
+    showMainMenu();
+}
+
 void handleDeviceRemove() {
     if (deviceController->getDeviceCount() == 0) {
         serialController->println("❌ Nessun dispositivo da rimuovere");
@@ -395,6 +440,7 @@ void showSystemStatus() {
     bool alexaActive = alexaController->isAlexaInitialized();
     
     serialController->printSystemStatus(ssid, ip, rssi, mac, deviceCount, alexaActive, millis());
+    alexaController->printStats();
 }
 
 // ===== RESET SYSTEM =====
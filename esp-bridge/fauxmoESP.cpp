@@ -28,64 +28,258 @@ THE SOFTWARE.
 
 #include <Arduino.h>
 #include "fauxmoESP.h"
+#include "colors.h"
 
 // -----------------------------------------------------------------------------
 // UDP
 // -----------------------------------------------------------------------------
 
-void fauxmoESP::_sendUDPResponse() {
+void fauxmoESP::_renderResponses() {
+
+	IPAddress ip = WiFi.localIP();
+	unsigned int mac[6] = {0};
+	sscanf(WiFi.macAddress().c_str(), "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]);
+
+	for (unsigned char bridge=0; bridge<_bridges; bridge++) {
+
+		// Each virtual bridge gets its own serial / UDN and port. The first
+		// one keeps the real MAC, the others set the locally administered
+		// bit and carry their index in the first octet, so they can not
+		// clash with a neighbouring vendor MAC nor wrap around.
+		unsigned char first = (0 == bridge) ? mac[0] : ((mac[0] ^ (bridge << 2)) | 0x02);
+		snprintf(
+			_bridgeId[bridge], sizeof(_bridgeId[bridge]), "%02x%02x%02x%02x%02x%02x",
+			first, mac[1], mac[2], mac[3], mac[4], mac[5]
+		);
+		unsigned int port = _tcp_port + bridge;
+
+	    int len = snprintf_P(
+	        _udpResponse[bridge], sizeof(_udpResponse[bridge]),
+	        FAUXMO_UDP_RESPONSE_TEMPLATE,
+	        ip[0], ip[1], ip[2], ip[3],
+			port,
+	        _bridgeId[bridge], _bridgeId[bridge]
+	    );
+		_udpResponseLen[bridge] = min((size_t) len, sizeof(_udpResponse[bridge]) - 1);
+
+	    snprintf_P(
+	        _descriptionResponse[bridge], sizeof(_descriptionResponse[bridge]),
+	        FAUXMO_DESCRIPTION_TEMPLATE,
+	        ip[0], ip[1], ip[2], ip[3], port,
+	        ip[0], ip[1], ip[2], ip[3], port,
+	        _bridgeId[bridge], _bridgeId[bridge]
+	    );
+
+	}
+
+	_renderedIP = ip;
+	_renderedPort = _tcp_port;
+	_renderedBridges = _bridges;
+
+	DEBUG_MSG_FAUXMO("[FAUXMO] Discovery responses rendered for %s:%d\n", ip.toString().c_str(), _tcp_port);
+
+}
+
+void fauxmoESP::_refreshResponses() {
+	if ((_renderedPort != _tcp_port) || (_renderedBridges != _bridges) || !(WiFi.localIP() == _renderedIP)) {
+		_renderResponses();
+	}
+}
+
+void fauxmoESP::_sendUDPResponse(const IPAddress & ip, unsigned int port) {
 
 	DEBUG_MSG_FAUXMO("[FAUXMO] Responding to M-SEARCH request\n");
 
-	IPAddress ip = WiFi.localIP();
-    String mac = WiFi.macAddress();
-    mac.replace(":", "");
-    mac.toLowerCase();
-
-	char response[strlen(FAUXMO_UDP_RESPONSE_TEMPLATE) + 128];
-    snprintf_P(
-        response, sizeof(response),
-        FAUXMO_UDP_RESPONSE_TEMPLATE,
-        ip[0], ip[1], ip[2], ip[3],
-		_tcp_port,
-        mac.c_str(), mac.c_str()
-    );
+	_refreshResponses();
+
+	// One reply per virtual bridge, each pointing at its own port
+	for (unsigned char bridge=0; bridge<_bridges; bridge++) {
+
+		#if DEBUG_FAUXMO_VERBOSE_UDP
+	    	DEBUG_MSG_FAUXMO("[FAUXMO] UDP response sent to %s:%d\n%s", ip.toString().c_str(), port, _udpResponse[bridge]);
+		#endif
+
+		#ifdef ESP32
+			_udp.writeTo((const uint8_t *) _udpResponse[bridge], _udpResponseLen[bridge], ip, port);
+		#else
+			_udp.beginPacket(ip, port);
+			_udp.write((const uint8_t *) _udpResponse[bridge], _udpResponseLen[bridge]);
+			_udp.endPacket();
+		#endif
+
+	}
+
+}
+
+bool fauxmoESP::_parseSearch(const char * data, size_t len, unsigned int * mx, unsigned char * st) {
+
+	// Header lines are inspected in place, only the request line, MAN, ST and MX matter
+	*mx = 0;
+	*st = FAUXMO_SSDP_ST_NONE;
+	if ((len < 8) || (strncmp(data, "M-SEARCH", 8) != 0)) return false;
+
+	bool match = false;
+	size_t i = 0;
+	while (i < len) {
+
+		// Skip to the start of the next line
+		while ((i < len) && (data[i] != '\n')) i++;
+		size_t start = ++i;
+		while ((i < len) && (data[i] != '\r') && (data[i] != '\n')) i++;
+		if (i <= start) continue;
+
+		const char * line = data + start;
+		const char * colon = (const char *) memchr(line, ':', i - start);
+		if (NULL == colon) continue;
+		size_t name_len = colon - line;
+		const char * value = colon + 1;
+		size_t value_len = (data + i) - value;
+		while ((value_len > 0) && (*value == ' ')) { value++; value_len--; }
+
+		if ((name_len == 2) && (strncasecmp(line, "MX", 2) == 0)) {
+			// Datagram is not NUL terminated, stay inside the value
+			for (size_t j = 0; (j < value_len) && isdigit(value[j]); j++) {
+				*mx = *mx * 10 + (value[j] - '0');
+			}
+		} else if ((name_len == 2) && (strncasecmp(line, "ST", 2) == 0)) {
+			if (_indexOf(value, value_len, "upnp:rootdevice") >= 0) {
+				*st = FAUXMO_SSDP_ST_ROOTDEVICE;
+			} else if (_indexOf(value, value_len, "device:basic:1") >= 0) {
+				*st = FAUXMO_SSDP_ST_BASIC;
+			} else if (_indexOf(value, value_len, "ssdp:all") >= 0) {
+				*st = FAUXMO_SSDP_ST_ALL;
+			} else {
+				continue;
+			}
+			match = true;
+		} else if ((name_len == 3) && (strncasecmp(line, "MAN", 3) == 0)) {
+			if (_indexOf(value, value_len, "ssdp:discover") >= 0) match = true;
+		}
+
+	}
+
+	return match;
+
+}
+
+void fauxmoESP::_scheduleUDPResponse(const IPAddress & ip, unsigned int port, unsigned char st, unsigned int mx) {
+
+	unsigned long now = millis();
+
+	// Find the searcher, or take the slot of the one not heard from for the longest
+	fauxmoesp_udp_requester_t * requester = NULL;
+	fauxmoesp_udp_requester_t * oldest = NULL;
+	for (unsigned char i=0; i<_udpRequesterCount; i++) {
+		fauxmoesp_udp_requester_t * r = &_udpRequesters[i];
+		if ((r->ip == ip) && (r->port == port) && (r->st == st)) {
+			requester = r;
+			break;
+		}
+		if (!r->pending && ((NULL == oldest) || (now - r->lastSeen > now - oldest->lastSeen))) oldest = r;
+	}
+	if (NULL == requester) {
+		if (_udpRequesterCount < FAUXMO_UDP_MAX_REQUESTERS) {
+			requester = &_udpRequesters[_udpRequesterCount++];
+		} else if (oldest) {
+			requester = oldest;
+		} else {
+			// Every slot is waiting on a reply, answer right away
+			_sendUDPResponse(ip, port);
+			return;
+		}
+		*requester = fauxmoesp_udp_requester_t();
+		requester->ip = ip;
+		requester->port = port;
+		requester->st = st;
+	}
+
+	requester->searches++;
+	requester->lastSeen = now;
+
+	// Echos repeat their search several times, one answer is enough
+	if (requester->pending || ((requester->responses > 0) && (now - requester->lastResponse < FAUXMO_UDP_DEDUP_WINDOW))) {
+		requester->coalesced++;
+		return;
+	}
+
+	// Spread the replies over the MX window so several Echos do not get a burst
+	unsigned long window = min((unsigned long) mx * 1000, (unsigned long) FAUXMO_UDP_MAX_DELAY);
+	requester->pending = true;
+	requester->due = now + ((window > 0) ? random(window + 1) : 0);
+
+}
+
+void fauxmoESP::_flushUDPResponses() {
+	unsigned long now = millis();
+	for (unsigned char i=0; i<_udpRequesterCount; i++) {
+		fauxmoesp_udp_requester_t * requester = &_udpRequesters[i];
+		if (requester->pending && ((long) (now - requester->due) >= 0)) {
+			_sendUDPResponse(requester->ip, requester->port);
+			requester->pending = false;
+			requester->responses++;
+			requester->lastResponse = now;
+		}
+	}
+	_armUDPTimer();
+}
+
+void fauxmoESP::_armUDPTimer() {
+
+	#ifdef ESP32
+		// Wake the async task for the earliest pending reply
+		unsigned long now = millis();
+		long wait = -1;
+		for (unsigned char i=0; i<_udpRequesterCount; i++) {
+			if (!_udpRequesters[i].pending) continue;
+			long left = max((long) (_udpRequesters[i].due - now), 1L);
+			if ((wait < 0) || (left < wait)) wait = left;
+		}
+		_udp.setTimer(max(wait, 0L));
+	#endif
+
+}
+
+const fauxmoesp_udp_requester_t * fauxmoESP::getUDPRequester(unsigned char index) {
+	return (index < _udpRequesterCount) ? &_udpRequesters[index] : NULL;
+}
+
+void fauxmoESP::_onUDPData(const IPAddress remoteIP, unsigned int remotePort, void *data, size_t len) {
 
 	#if DEBUG_FAUXMO_VERBOSE_UDP
-    	DEBUG_MSG_FAUXMO("[FAUXMO] UDP response sent to %s:%d\n%s", _udp.remoteIP().toString().c_str(), _udp.remotePort(), response);
+		DEBUG_MSG_FAUXMO("[FAUXMO] UDP packet received\n%.*s", (int) len, (const char *) data);
 	#endif
 
-    _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-	#if defined(ESP32)
-	    _udp.printf(response);
-	#else
-	    _udp.write(response);
+	unsigned int mx;
+	unsigned char st;
+	if (_parseSearch((const char *) data, len, &mx, &st)) {
+		_scheduleUDPResponse(remoteIP, remotePort, st, mx);
+	}
+
+	#ifdef ESP32
+		// Answer anything already due and re-arm the timer. A timer event lost
+		// to a full async queue would otherwise leave its requester pending,
+		// swallowing every later search from that Echo.
+		_flushUDPResponses();
 	#endif
-    _udp.endPacket();
 
 }
 
 void fauxmoESP::_handleUDP() {
 
+	#ifndef ESP32
 	int len = _udp.parsePacket();
     if (len > 0) {
-
-		unsigned char data[len+1];
-        _udp.read(data, len);
-        data[len] = 0;
-
-		#if DEBUG_FAUXMO_VERBOSE_UDP
-			DEBUG_MSG_FAUXMO("[FAUXMO] UDP packet received\n%s", (const char *) data);
-		#endif
-
-        String request = (const char *) data;
-        if (request.indexOf("M-SEARCH") >= 0) {
-            if ((request.indexOf("ssdp:discover") > 0) || (request.indexOf("upnp:rootdevice") > 0) || (request.indexOf("device:basic:1") > 0)) {
-                _sendUDPResponse();
-            }
-        }
+		// Anything past the buffer is headers we do not look at
+		len = _udp.read((unsigned char *) _udpBuffer, min((size_t) len, (size_t) FAUXMO_UDP_BUFFER_SIZE));
+		if (len > 0) {
+			_udpBuffer[len] = 0;
+			_onUDPData(_udp.remoteIP(), _udp.remotePort(), _udpBuffer, len);
+		}
     }
 
+	_flushUDPResponses();
+	#endif
+
 }
 
 
@@ -93,53 +287,181 @@ void fauxmoESP::_handleUDP() {
 // TCP
 // -----------------------------------------------------------------------------
 
-void fauxmoESP::_sendTCPResponse(AsyncClient *client, const char * code, char * body, const char * mime) {
+void fauxmoESP::_sendTCPResponse(AsyncClient *client, const char * code, const char * body, size_t length, const char * mime, bool constant) {
 
-	char headers[strlen_P(FAUXMO_TCP_HEADERS) + 32];
+	char headers[strlen_P(FAUXMO_TCP_HEADERS) + 48];
 	snprintf_P(
 		headers, sizeof(headers),
 		FAUXMO_TCP_HEADERS,
-		code, mime, strlen(body)
+		code, mime, length, _connectionHeader(client)
 	);
 
 	#if DEBUG_FAUXMO_VERBOSE_TCP
-		DEBUG_MSG_FAUXMO("[FAUXMO] Response:\n%s%s\n", headers, body);
+		DEBUG_MSG_FAUXMO("[FAUXMO] Response:\n%s%.*s\n", headers, (int) length, body);
 	#endif
 
-	client->write(headers);
-	client->write(body);
+	// Headers and body leave in one segment. Constant bodies are queued by
+	// reference, anything rendered into a buffer we may reuse is copied.
+	uint8_t flags = constant ? 0 : ASYNC_WRITE_FLAG_COPY;
+	#ifdef ESP32
+		// Single trip into the lwIP thread for write + write + output.
+		// Nothing is queued when it does not fit, and the client would wait
+		// for an answer that never comes, so reset the connection instead.
+		// Unlike close() this does not free the client under our callers,
+		// the disconnect arrives later as an error event.
+		if (0 == client->write(headers, strlen(headers), body, length, flags)) {
+			DEBUG_MSG_FAUXMO("[FAUXMO] Response does not fit the send buffer, resetting\n");
+			_tcpResponsesFailed++;
+			client->abort();
+			return;
+		}
+		_tcpResponses++;
+		_tcpResponseSegments += client->getTxSegments();
+	#else
+		client->add(headers, strlen(headers), ASYNC_WRITE_FLAG_COPY | ASYNC_WRITE_FLAG_MORE);
+		client->add(body, length, flags);
+		client->send();
+	#endif
 
 }
 
-String fauxmoESP::_deviceJson(unsigned char id, bool all = true) {
+void fauxmoESP::_sendTCPHeaders(AsyncClient *client, const char * code, const char * mime, size_t length) {
+
+	char headers[strlen_P(FAUXMO_TCP_HEADERS) + 48];
+	snprintf_P(
+		headers, sizeof(headers),
+		FAUXMO_TCP_HEADERS,
+		code, mime, length, _connectionHeader(client)
+	);
+
+	#if DEBUG_FAUXMO_VERBOSE_TCP
+		DEBUG_MSG_FAUXMO("[FAUXMO] Response headers:\n%s", headers);
+	#endif
+
+	// Body follows, do not push yet
+	client->add(headers, strlen(headers), ASYNC_WRITE_FLAG_COPY | ASYNC_WRITE_FLAG_MORE);
 
-	if (id >= _devices.size()) return "{}";
+}
 
-	fauxmoesp_device_t device = _devices[id];
+int fauxmoESP::_renderDeviceJson(unsigned char id, bool all, char * buffer, size_t len) {
 
-	DEBUG_MSG_FAUXMO("[FAUXMO] Sending device info for \"%s\", uniqueID = \"%s\"\n", device.name, device.uniqueid);
-	char buffer[strlen_P(FAUXMO_DEVICE_JSON_TEMPLATE) + 64];
+	fauxmoesp_device_t & device = _devices[id];
 
-	if (all)
-	{
-		snprintf_P(
-			buffer, sizeof(buffer),
+	if (all) {
+		return snprintf_P(
+			buffer, len,
 			FAUXMO_DEVICE_JSON_TEMPLATE,
 			device.name, device.uniqueid,
 			device.state ? "true": "false",
 			device.value
 		);
 	}
-	else
-	{
-		snprintf_P(
-			buffer, sizeof(buffer),
-			FAUXMO_DEVICE_JSON_TEMPLATE_SHORT,
-			device.name, device.uniqueid
-		);
+
+	return snprintf_P(
+		buffer, len,
+		FAUXMO_DEVICE_JSON_TEMPLATE_SHORT,
+		device.name, device.uniqueid
+	);
+
+}
+
+const char * fauxmoESP::_deviceJson(unsigned char id, bool all, size_t * len) {
+
+	*len = 2;
+	if (!_devices.used(id)) return "{}";
+
+	fauxmoesp_device_t & device = _devices[id];
+	fauxmoesp_json_cache_t & cache = all ? device.json : device.jsonShort;
+
+	if (!cache.dirty) {
+		_jsonCacheHits++;
+		*len = cache.len;
+		return cache.data;
 	}
+	_jsonCacheMisses++;
+
+	DEBUG_MSG_FAUXMO("[FAUXMO] Rendering device info for \"%s\", uniqueID = \"%s\"\n", device.name, device.uniqueid);
+
+	// Re-render in place unless the new text does not fit anymore
+	int n = _renderDeviceJson(id, all, NULL, 0);
+	if (n + 1 > cache.size) {
+		free(cache.data);
+		cache.size = n + 1 + FAUXMO_JSON_CACHE_SLACK;
+		cache.data = (char *) malloc(cache.size);
+		if (NULL == cache.data) {
+			cache.size = 0;
+			return "{}";
+		}
+	}
+	_renderDeviceJson(id, all, cache.data, cache.size);
+	cache.len = n;
+	cache.dirty = false;
+
+	*len = cache.len;
+	return cache.data;
+
+}
+
+void fauxmoESP::_invalidateJson(unsigned char id, bool all) {
+	if (!_devices.used(id)) return;
+	_devices[id].json.dirty = true;
+	if (all) {
+		_devices[id].jsonShort.dirty = true;
+		_listGeneration++;
+	}
+}
 
-	return String(buffer);
+void fauxmoESP::_applyReverts() {
+	#ifdef ESP32
+		portENTER_CRITICAL(&_revertLock);
+	#endif
+	_revertPending = false;
+	for (unsigned char id = 0; id < FAUXMO_MAX_DEVICES; id++) {
+		if (!_devices.used(id)) continue;
+		fauxmoesp_device_t & device = _devices[id];
+		if (!device.revert.pending) continue;
+		device.revert.pending = false;
+		if ((device.state == device.revert.fromState) && (device.value == device.revert.fromValue)) {
+			device.state = device.revert.state;
+			device.value = device.revert.value;
+			_invalidateJson(id, false);
+		}
+	}
+	#ifdef ESP32
+		portEXIT_CRITICAL(&_revertLock);
+	#endif
+}
+
+void fauxmoESP::_cancelRevert(unsigned char id) {
+	#ifdef ESP32
+		portENTER_CRITICAL(&_revertLock);
+	#endif
+	_devices[id].revert.pending = false;
+	#ifdef ESP32
+		portEXIT_CRITICAL(&_revertLock);
+	#endif
+}
+
+void fauxmoESP::_freeJson(fauxmoesp_device_t & device) {
+	free(device.json.data);
+	free(device.jsonShort.data);
+	device.json = {NULL, 0, 0, true};
+	device.jsonShort = {NULL, 0, 0, true};
+}
+
+int fauxmoESP::_indexOf(const char * data, size_t len, const char * needle, size_t from) {
+	size_t n = strlen(needle);
+	if (n > len) return -1;
+	for (size_t i = from; i + n <= len; i++) {
+		if ((data[i] == needle[0]) && (memcmp(data + i, needle, n) == 0)) return i;
+	}
+	return -1;
+}
+
+long fauxmoESP::_toInt(const char * data, size_t len, size_t pos) {
+	// Views are NUL terminated, strtol stops there at the latest
+	if (pos >= len) return 0;
+	return strtol(data + pos, NULL, 10);
 }
 
 String fauxmoESP::_byte2hex(uint8_t zahl)
@@ -171,179 +493,397 @@ String fauxmoESP::_makeMD5(String text)
   return hash;
 }
 
-bool fauxmoESP::_onTCPDescription(AsyncClient *client, String url, String body) {
+bool fauxmoESP::_onTCPDescription(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len) {
 
 	(void) url;
+	(void) url_len;
 	(void) body;
+	(void) body_len;
 
 	DEBUG_MSG_FAUXMO("[FAUXMO] Handling /description.xml request\n");
 
-	IPAddress ip = WiFi.localIP();
-    String mac = WiFi.macAddress();
-    mac.replace(":", "");
-    mac.toLowerCase();
-
-	char response[strlen_P(FAUXMO_DESCRIPTION_TEMPLATE) + 64];
-    snprintf_P(
-        response, sizeof(response),
-        FAUXMO_DESCRIPTION_TEMPLATE,
-        ip[0], ip[1], ip[2], ip[3], _tcp_port,
-        ip[0], ip[1], ip[2], ip[3], _tcp_port,
-        mac.c_str(), mac.c_str()
-    );
-
-	_sendTCPResponse(client, "200 OK", response, "text/xml");
+	_refreshResponses();
+	_sendTCPResponse(client, "200 OK", _descriptionResponse[bridge], strlen(_descriptionResponse[bridge]), "text/xml");
 
 	return true;
 
 }
 
-bool fauxmoESP::_onTCPList(AsyncClient *client, String url, String body) {
+bool fauxmoESP::_onTCPList(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len) {
 
 	DEBUG_MSG_FAUXMO("[FAUXMO] Handling list request\n");
 
 	// Get the index
-	int pos = url.indexOf("lights");
+	int pos = _indexOf(url, url_len, "lights");
 	if (-1 == pos) return false;
 
-	// Get the id
-	unsigned char id = url.substring(pos+7).toInt();
-
-	// This will hold the response string	
-	String response;
+	// Get the light number on this bridge
+	unsigned int light = _toInt(url, url_len, pos+7);
 
-	// Client is requesting all devices
-	if (0 == id) {
+	// Client is requesting all devices of this bridge
+	if (0 == light) {
 
-		response += "{";
-		for (unsigned char i=0; i< _devices.size(); i++) {
-			if (i>0) response += ",";
-			response += "\"" + String(i+1) + "\":" + _deviceJson(i, false);	// send short template
+		// Stream the listing device by device, it may not fit in the send buffer
+		size_t length = 2;
+		unsigned int first = _bridgeNext(bridge, 0);
+		for (unsigned int i=first; i<_devices.end(); i=_bridgeNext(bridge, i+1)) {
+			char prefix[8];
+			size_t json_len;
+			_deviceJson(i, false, &json_len);
+			length += _listPrefix(_bridgeLight(i), i == first, prefix, sizeof(prefix)) + json_len;
 		}
-		response += "}";
+		_sendTCPHeaders(client, "200 OK", "application/json", length);
+		client->add("{", 1, ASYNC_WRITE_FLAG_COPY | ASYNC_WRITE_FLAG_MORE);
+		int slot = _clientSlot(client);
+		if (slot >= 0) _tcpSlots[slot].listGeneration = _listGeneration;
+		_streamList(client, slot, bridge, first);
+		return true;
+
+	}
 
 	// Client is requesting a single device
+	unsigned int id = _bridgeSlot(bridge, light);
+	if (_devices.used(id)) {
+		size_t len;
+		const char * response = _deviceJson(id, true, &len);
+		_sendTCPResponse(client, "200 OK", response, len, "application/json");
 	} else {
-		response = _deviceJson(id-1);
+		_sendTCPResponse(client, "200 OK", "{}", 2, "application/json", true);
 	}
-
-	_sendTCPResponse(client, "200 OK", (char *) response.c_str(), "application/json");
 	
 	return true;
 
 }
 
-byte* fauxmoESP::_hs2rgb(uint16_t hue, uint8_t sat) {
-	byte *rgb = new byte[3]{0, 0, 0};
+size_t fauxmoESP::_listPrefix(unsigned int light, bool first, char * buffer, size_t len) {
+	// Key of one "<light>":{...} member of the listing
+	return snprintf(buffer, len, "%s\"%u\":", first ? "" : ",", light);
+}
 
-	float h = ((float)hue)/65535.0;
-    float s = ((float)sat)/255.0;
+unsigned int fauxmoESP::_bridgeNext(unsigned char bridge, unsigned int id) {
+	// First used slot of the bridge at or after id, _devices.end() when there is none
+	if (id % _bridges != bridge) id += (bridge + _bridges - id % _bridges) % _bridges;
+	while ((id < _devices.end()) && !_devices.used(id)) id += _bridges;
+	return min(id, _devices.end());
+}
 
-    byte i = floor(h*6);
-    float f = h * 6-i;
-    float p = 255 * (1-s);
-    float q = 255 * (1-f*s);
-    float t = 255 * (1-(1-f)*s);
-    switch (i%6) {
-      case 0: rgb[0]=255,rgb[1]=t,rgb[2]=p;break;
-      case 1: rgb[0]=q,rgb[1]=255,rgb[2]=p;break;
-      case 2: rgb[0]=p,rgb[1]=255,rgb[2]=t;break;
-      case 3: rgb[0]=p,rgb[1]=q,rgb[2]=255;break;
-      case 4: rgb[0]=t,rgb[1]=p,rgb[2]=255;break;
-      case 5: rgb[0]=255,rgb[1]=p,rgb[2]=q;
-    }
-	return rgb;
-}
-
-byte* fauxmoESP::_ct2rgb(uint16_t ct) {
-	byte *rgb = new byte[3]{0, 0, 0};
-	float temp = 10000/ ct; //kelvins = 1,000,000/mired (and that /100)
-    float r, g, b;
-
-    if (temp <= 66) { 
-      r = 255; 
-      g = temp;
-      g = 99.470802 * log(g) - 161.119568;
-      if (temp <= 19) {
-          b = 0;
-      } else {
-          b = temp-10;
-          b = 138.517731 * log(b) - 305.044793;
-      }
-    } else {
-      r = temp - 60;
-      r = 329.698727 * pow(r, -0.13320476);
-      g = temp - 60;
-      g = 288.12217 * pow(g, -0.07551485 );
-      b = 255;
-    }
-    
-    rgb[0] = (byte)constrain(r,0.1,255.1);
-    rgb[1] = (byte)constrain(g,0.1,255.1);
-    rgb[2] = (byte)constrain(b,0.1,255.1);
+bool fauxmoESP::_streamList(AsyncClient *client, int slot, unsigned char bridge, unsigned int id) {
+
+	// Queue as many entries as the send buffer takes, the rest goes out from onAck
+	// Slots are stable, so skip the free ones and those of other bridges
+	unsigned int first = _bridgeNext(bridge, 0);
+	id = _bridgeNext(bridge, id);
+	while (id < _devices.end()) {
+		char prefix[8];
+		size_t prefix_len = _listPrefix(_bridgeLight(id), id == first, prefix, sizeof(prefix));
+		size_t json_len;
+		const char * json = _deviceJson(id, false, &json_len);
+		if (client->space() < prefix_len + json_len) break;
+		client->add(prefix, prefix_len, ASYNC_WRITE_FLAG_COPY | ASYNC_WRITE_FLAG_MORE);
+		client->add(json, json_len, ASYNC_WRITE_FLAG_COPY | ASYNC_WRITE_FLAG_MORE);
+		id = _bridgeNext(bridge, id + 1);
+	}
+
+	bool done = (id >= _devices.end()) && (client->add("}", 1) == 1);
+	client->send();
+
+	if (slot >= 0) {
+		_tcpSlots[slot].listCursor = done ? -1 : id;
+	} else if (!done) {
+		DEBUG_MSG_FAUXMO("[FAUXMO] Listing truncated, external client has no room\n");
+	}
+
+	return done;
+
+}
+
+void fauxmoESP::_onTCPAck(AsyncClient *client, unsigned char slot) {
+	fauxmoesp_tcp_slot_t * s = &_tcpSlots[slot];
+	s->lastActivity = millis();
+	if (s->listCursor >= 0) {
+		// Content-Length was computed from the devices as they were. After an
+		// add, remove or rename the rest of the body would not match it, and a
+		// keep-alive client would read the next response out of step. Reset.
+		if (s->listGeneration != _listGeneration) {
+			DEBUG_MSG_FAUXMO("[FAUXMO] Devices changed while streaming on client #%d, resetting\n", slot);
+			s->listCursor = -1;
+			s->closeOnAck = false;
+			client->abort();
+			return;
+		}
+		_streamList(client, slot, s->bridge, s->listCursor);
+	}
+	// Response announced "Connection: close", lwIP flushes what is still queued before the FIN
+	if ((s->listCursor < 0) && s->closeOnAck) {
+		s->closeOnAck = false;
+		client->close();
+	}
+}
+
+const char * fauxmoESP::_connectionHeader(AsyncClient *client) {
+	int slot = _clientSlot(client);
+	return ((slot >= 0) && _tcpSlots[slot].request.keepAlive) ? "keep-alive" : "close";
+}
+
+int fauxmoESP::_clientSlot(AsyncClient *client) {
+	uint32_t used = _tcpSlotsUsed;
+	while (used) {
+		unsigned char i = __builtin_ctz(used);
+		if (_tcpSlots[i].client == client) return i;
+		used &= used - 1;
+	}
+	return -1;
+}
+
+int fauxmoESP::_allocTCPSlot() {
+
+	if (NULL == _tcpSlots) {
+		_tcpSlots = (fauxmoesp_tcp_slot_t *) calloc(_tcpMaxClients, sizeof(fauxmoesp_tcp_slot_t));
+		if (NULL == _tcpSlots) return -1;
+	}
+
+	uint32_t mask = (_tcpMaxClients >= 32) ? 0xFFFFFFFF : ((1UL << _tcpMaxClients) - 1);
+	uint32_t available = ~_tcpSlotsUsed & mask;
+	if (0 == available) return -1;
+	return __builtin_ctz(available);
+
+}
+
+// Frees the slot of the connection that has been quiet the longest. Only
+// connections parked between requests are considered, a client in the middle
+// of a request or of a streamed listing is never cut off.
+int fauxmoESP::_evictTCPSlot() {
+
+	int victim = -1;
+	unsigned long now = millis();
+	unsigned long oldest = 0;
+
+	uint32_t used = _tcpSlotsUsed;
+	while (used) {
+		unsigned char i = __builtin_ctz(used);
+		used &= used - 1;
+		fauxmoesp_tcp_slot_t * s = &_tcpSlots[i];
+		if ((s->listCursor >= 0) || s->closeOnAck) continue;
+		if ((FAUXMO_PARSE_METHOD != s->request.state) || (s->request.line_len > 0)) continue;
+		if ((victim < 0) || (now - s->lastActivity > oldest)) {
+			victim = i;
+			oldest = now - s->lastActivity;
+		}
+	}
+	if (victim < 0) return -1;
+
+	// Release first, the disconnect callback then finds a stale generation
+	AsyncClient * client = _tcpSlots[victim].client;
+	_releaseTCPSlot(victim);
+	client->close(true);
+	_tcpEvicted++;
+	DEBUG_MSG_FAUXMO("[FAUXMO] Evicted client #%d, idle for %lu ms\n", victim, oldest);
+	return victim;
 
-	return rgb;
 }
 
-bool fauxmoESP::_onTCPControl(AsyncClient *client, String url, String body) {
+void fauxmoESP::_releaseTCPSlot(unsigned char slot) {
+	_tcpSlots[slot].client = NULL;
+	_tcpSlots[slot].listCursor = -1;
+	_tcpSlots[slot].generation++;
+	_tcpSlotsUsed &= ~(1UL << slot);
+}
+
+bool fauxmoESP::_ownsTCPSlot(unsigned char slot, uint16_t generation, AsyncClient *client) {
+	return (_tcpSlotsUsed & (1UL << slot))
+		&& (_tcpSlots[slot].generation == generation)
+		&& (_tcpSlots[slot].client == client);
+}
+
+bool fauxmoESP::setMaxClients(unsigned char clients) {
+	clients = constrain(clients, 1, FAUXMO_TCP_SLOTS_LIMIT);
+	if (clients == _tcpMaxClients) return true;
+	if (_tcpSlotsUsed) return false;
+	free(_tcpSlots);
+	_tcpSlots = NULL;
+	_tcpMaxClients = clients;
+	return true;
+}
+
+long fauxmoESP::_parseFixed(const char * data, size_t len, size_t * pos) {
+
+	// Decimal number to 1/10000 units, enough for Hue xy coordinates
+	size_t i = *pos;
+	bool negative = (i < len) && (data[i] == '-');
+	if (negative) i++;
+	// The integer part saturates: every field clamps below 100000 anyway
+	// and value * 10000 has to fit the ESP32's 32 bit long
+	long value = 0;
+	while ((i < len) && isdigit(data[i])) {
+		value = (value < 10000) ? value * 10 + (data[i] - '0') : 99999;
+		i++;
+	}
+	value *= 10000;
+	if ((i < len) && (data[i] == '.')) {
+		long scale = 1000;
+		i++;
+		while ((i < len) && isdigit(data[i])) {
+			value += (data[i++] - '0') * scale;
+			scale /= 10;
+		}
+	}
+	*pos = i;
+	return negative ? -value : value;
+
+}
+
+bool fauxmoESP::_parseState(const char * body, size_t len, fauxmoesp_state_t * state) {
+
+	// Single pass over a flat JSON object like {"on":true,"bri":128,"xy":[0.3,0.3]}
+	memset(state, 0, sizeof(fauxmoesp_state_t));
+	size_t i = 0;
+
+	while (i < len) {
+
+		// Key
+		if (body[i] != '"') { i++; continue; }
+		const char * key = body + (++i);
+		while ((i < len) && (body[i] != '"')) i++;
+		size_t key_len = (body + i) - key;
+		i++;
+
+		// Separator
+		while ((i < len) && ((body[i] == ' ') || (body[i] == ':'))) i++;
+		if (i >= len) break;
+
+		// Value
+		char c = body[i];
+		long values[2] = {0, 0};
+		unsigned char count = 0;
+		bool flag = false;
+		bool boolean = false;
+		if ((c == 't') || (c == 'f')) {
+			flag = (c == 't');
+			boolean = true;
+			while ((i < len) && isalpha(body[i])) i++;
+		} else if (c == '[') {
+			while ((i < len) && (body[i] != ']')) {
+				if (isdigit(body[i]) || (body[i] == '-')) {
+					long v = _parseFixed(body, len, &i);
+					if (count < 2) values[count++] = v;
+				} else {
+					i++;
+				}
+			}
+		} else if (isdigit(c) || (c == '-')) {
+			values[0] = _parseFixed(body, len, &i);
+			count = 1;
+		} else if (c == '"') {
+			i++;
+			while ((i < len) && (body[i] != '"')) i++;
+			i++;
+			continue;
+		}
+
+		long number = constrain(values[0] / 10000, 0L, 65535L);
+		if ((key_len == 2) && (strncmp(key, "on", 2) == 0) && boolean) {
+			state->on = flag;
+			state->fields |= FAUXMO_STATE_ON;
+		} else if ((key_len == 3) && (strncmp(key, "bri", 3) == 0) && count) {
+			state->bri = min(number, 255L);
+			state->fields |= FAUXMO_STATE_BRI;
+		} else if ((key_len == 3) && (strncmp(key, "hue", 3) == 0) && count) {
+			state->hue = number;
+			state->fields |= FAUXMO_STATE_HUE;
+		} else if ((key_len == 3) && (strncmp(key, "sat", 3) == 0) && count) {
+			state->sat = min(number, 255L);
+			state->fields |= FAUXMO_STATE_SAT;
+		} else if ((key_len == 2) && (strncmp(key, "ct", 2) == 0) && count) {
+			state->ct = number;
+			state->fields |= FAUXMO_STATE_CT;
+		} else if ((key_len == 2) && (strncmp(key, "xy", 2) == 0) && (count == 2)) {
+			state->x = constrain(values[0], 0L, 10000L);
+			state->y = constrain(values[1], 0L, 10000L);
+			state->fields |= FAUXMO_STATE_XY;
+		} else if ((key_len == 14) && (strncmp(key, "transitiontime", 14) == 0) && count) {
+			state->transitiontime = number;
+			state->fields |= FAUXMO_STATE_TRANSITION;
+		}
+
+	}
+
+	return state->fields != 0;
+
+}
+
+void fauxmoESP::_applyState(unsigned char id, const fauxmoesp_state_t * state) {
+
+	// All attributes of one request are applied together, colour
+	// precedence follows the Hue API (xy over ct over hue/sat)
+	fauxmoesp_device_t & device = _devices[id];
+
+	if (state->fields & FAUXMO_STATE_BRI) {
+		device.value = state->bri;
+		device.state = (state->bri > 0);
+	}
+
+	if (state->fields & FAUXMO_STATE_XY) {
+		fauxmoesp_xy2rgb(state->x, state->y, device.rgb);
+		device.state = true;
+	} else if (state->fields & FAUXMO_STATE_CT) {
+		fauxmoesp_ct2rgb(state->ct, device.rgb);
+		device.state = true;
+	} else if (state->fields & (FAUXMO_STATE_HUE | FAUXMO_STATE_SAT)) {
+		fauxmoesp_hs2rgb(state->hue, (state->fields & FAUXMO_STATE_SAT) ? state->sat : 254, device.rgb);
+		device.state = true;
+	}
+
+	// Explicit on/off wins over what brightness or colour implied
+	if (state->fields & FAUXMO_STATE_ON) {
+		device.state = state->on;
+		if (device.state && !(state->fields & FAUXMO_STATE_BRI) && (0 == device.value)) device.value = 255;
+	}
+
+	_invalidateJson(id, false);
+
+}
+
+bool fauxmoESP::_onTCPControl(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len) {
+
+	_timing.routed = micros();
+
 	// "devicetype" request
-	if (body.indexOf("devicetype") > 0) {
+	if (_indexOf(body, body_len, "devicetype") > 0) {
 		DEBUG_MSG_FAUXMO("[FAUXMO] Handling devicetype request\n");
-		_sendTCPResponse(client, "200 OK", (char *) "[{\"success\":{\"username\": \"2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr\"}}]", "application/json");
+		static const char response[] = "[{\"success\":{\"username\": \"2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr\"}}]";
+		_sendTCPResponse(client, "200 OK", response, sizeof(response) - 1, "application/json", true);
 		return true;
 	}
 
 	// "state" request
-	if ((url.indexOf("state") > 0) && (body.length() > 0)) {
+	if ((_indexOf(url, url_len, "state") > 0) && (body_len > 0)) {
 
 		// Get the index
-		int pos = url.indexOf("lights");
+		int pos = _indexOf(url, url_len, "lights");
 		if (-1 == pos) return false;
 
 		DEBUG_MSG_FAUXMO("[FAUXMO] Handling state request\n");
 
-		// Get the index
-		unsigned char id = url.substring(pos+7).toInt();
-		if (id > 0) {
-
-			--id;
-
-			// Brightness
-			if ((pos = body.indexOf("bri")) > 0) {
-				unsigned char value = body.substring(pos+5).toInt();
-				_devices[id].value = value;
-				_devices[id].state = (value > 0);
-			} else if ((pos = body.indexOf("hue")) > 0) {
-				_devices[id].state = true;
-				unsigned int pos_comma = body.indexOf(",", pos);
-				uint16_t hue = body.substring(pos+5, pos_comma).toInt();
-				pos = body.indexOf("sat", pos_comma);
-				uint8_t sat = body.substring(pos+5).toInt();
-				byte* rgb = _hs2rgb(hue, sat);
-				_devices[id].rgb[0] = rgb[0];
-				_devices[id].rgb[1] = rgb[1];
-				_devices[id].rgb[2] = rgb[2];
-			} else if ((pos = body.indexOf("ct")) > 0) {
-				_devices[id].state = true;
-				uint16_t ct = body.substring(pos+4).toInt();
-				byte* rgb = _ct2rgb(ct);
-				_devices[id].rgb[0] = rgb[0];
-				_devices[id].rgb[1] = rgb[1];
-				_devices[id].rgb[2] = rgb[2];
-			} else if (body.indexOf("false") > 0) {
-				_devices[id].state = false;
-			} else {
-				_devices[id].state = true;
-				if (0 == _devices[id].value) _devices[id].value = 255;
-			}
+		// Get the index, light numbers are local to the bridge
+		unsigned int light = _toInt(url, url_len, pos+7);
+		unsigned int slot = _bridgeSlot(bridge, light);
+		if ((light > 0) && _devices.used(slot)) {
+
+			unsigned char id = slot;
+
+			fauxmoesp_state_t state;
+			_parseState(body, body_len, &state);
+			_applyState(id, &state);
+			_cancelRevert(id);      // a newer request wins over a pending rollback
 
 			char response[strlen_P(FAUXMO_TCP_STATE_RESPONSE)+10];
 			snprintf_P(
 				response, sizeof(response),
 				FAUXMO_TCP_STATE_RESPONSE,
-				id+1, _devices[id].state ? "true" : "false"
+				light, _devices[id].state ? "true" : "false"
 			);
-			_sendTCPResponse(client, "200 OK", response, "text/xml");
+			_sendTCPResponse(client, "200 OK", response, strlen(response), "text/xml");
+			_timing.replied = micros();
 
 			if (_setStateCallback) {
 				_setStateCallback(id, _devices[id].name, _devices[id].state, _devices[id].value);
@@ -362,24 +902,26 @@ bool fauxmoESP::_onTCPControl(AsyncClient *client, String url, String body) {
 	
 }
 
-bool fauxmoESP::_onTCPRequest(AsyncClient *client, bool isGet, String url, String body) {
+bool fauxmoESP::_onTCPRequest(AsyncClient *client, unsigned char bridge, bool isGet, const char * url, size_t url_len, const char * body, size_t body_len) {
     if (!_enabled) return false;
 
+	if (_revertPending) _applyReverts();
+
 	#if DEBUG_FAUXMO_VERBOSE_TCP
 		DEBUG_MSG_FAUXMO("[FAUXMO] isGet: %s\n", isGet ? "true" : "false");
-		DEBUG_MSG_FAUXMO("[FAUXMO] URL: %s\n", url.c_str());
-		if (!isGet) DEBUG_MSG_FAUXMO("[FAUXMO] Body:\n%s\n", body.c_str());
+		DEBUG_MSG_FAUXMO("[FAUXMO] URL: %s\n", url);
+		if (!isGet) DEBUG_MSG_FAUXMO("[FAUXMO] Body:\n%s\n", body);
 	#endif
 
-	if (url.equals("/description.xml")) {
-        return _onTCPDescription(client, url, body);
+	if ((url_len == 16) && (strncmp(url, "/description.xml", 16) == 0)) {
+        return _onTCPDescription(client, bridge, url, url_len, body, body_len);
     }
 
-	if (url.startsWith("/api")) {
+	if ((url_len >= 4) && (strncmp(url, "/api", 4) == 0)) {
 		if (isGet) {
-			return _onTCPList(client, url, body);
+			return _onTCPList(client, bridge, url, url_len, body, body_len);
 		} else {
-       		return _onTCPControl(client, url, body);
+       		return _onTCPControl(client, bridge, url, url_len, body, body_len);
 		}
 	}
 
@@ -387,94 +929,277 @@ bool fauxmoESP::_onTCPRequest(AsyncClient *client, bool isGet, String url, Strin
 
 }
 
-bool fauxmoESP::_onTCPData(AsyncClient *client, void *data, size_t len) {
+void fauxmoESP::_resetTCPRequest(fauxmoesp_request_t * request) {
+	request->state = FAUXMO_PARSE_METHOD;
+	request->isGet = false;
+	request->keepAlive = false;
+	request->line_len = 0;
+	request->url_len = 0;
+	request->body_len = 0;
+	request->content_length = 0;
+	request->has_length = false;
+}
 
-    if (!_enabled) return false;
+size_t fauxmoESP::_parseLength(const char * value) {
+
+	// Digits only: strtoul would take a sign ("-1" wraps to the largest value)
+	// and saturate silently. Anything malformed comes back as SIZE_MAX, which
+	// no buffer can hold, so the request is refused as too large.
+	while ((*value == ' ') || (*value == '\t')) value++;
+	if ((*value < '0') || (*value > '9')) return SIZE_MAX;
+	size_t length = 0;
+	while ((*value >= '0') && (*value <= '9')) {
+		unsigned char digit = *value++ - '0';
+		if (length > (SIZE_MAX - digit) / 10) return SIZE_MAX;
+		length = length * 10 + digit;
+	}
+	while ((*value == ' ') || (*value == '\t')) value++;
+	return (*value == 0) ? length : SIZE_MAX;
+
+}
+
+void fauxmoESP::_onTCPHeader(fauxmoesp_request_t * request) {
+
+	// Only framing and persistence headers matter here
+	if (strncasecmp(request->line, "Content-Length:", 15) == 0) {
+		request->content_length = _parseLength(request->line + 15);
+		request->has_length = true;
+	} else if (strncasecmp(request->line, "Connection:", 11) == 0) {
+		const char * value = request->line + 11;
+		while (*value == ' ') value++;
+		if (strncasecmp(value, "close", 5) == 0) request->keepAlive = false;
+		if (strncasecmp(value, "keep-alive", 10) == 0) request->keepAlive = true;
+	}
+
+}
+
+bool fauxmoESP::_onTCPData(AsyncClient *client, unsigned char slot, const char * data, size_t len) {
 
-	char * p = (char *) data;
-	p[len] = 0;
+    if (!_enabled) return false;
 
 	#if DEBUG_FAUXMO_VERBOSE_TCP
-		DEBUG_MSG_FAUXMO("[FAUXMO] TCP request\n%s\n", p);
+		DEBUG_MSG_FAUXMO("[FAUXMO] TCP data (%d bytes) on client #%d\n", len, slot);
 	#endif
 
-	// Method is the first word of the request
-	char * method = p;
-
-	while (*p != ' ') p++;
-	*p = 0;
-	p++;
-	
-	// Split word and flag start of url
-	char * url = p;
-
-	// Find next space
-	while (*p != ' ') p++;
-	*p = 0;
-	p++;
-
-	// Find double line feed
-	unsigned char c = 0;
-	while ((*p != 0) && (c < 2)) {
-		if (*p != '\r') {
-			c = (*p == '\n') ? c + 1 : 0;
-		}
-		p++;
-	}
-	char * body = p;
+	// Requests may arrive split over several segments (or several requests
+	// in one segment), so feed the bytes through the slot's state machine
+	fauxmoesp_tcp_slot_t * s = &_tcpSlots[slot];
+	fauxmoesp_request_t * request = &s->request;
+	s->lastActivity = millis();
+	bool handled = false;
+	size_t i = 0;
+
+	uint32_t now = micros();
+	#ifdef ESP32
+		uint32_t received = client->getRxStamp();
+	#else
+		uint32_t received = now;
+	#endif
 
-	bool isGet = (strncmp(method, "GET", 3) == 0);
+	while (i < len) {
 
-	return _onTCPRequest(client, isGet, url, body);
+		// First byte of a new request
+		if ((FAUXMO_PARSE_METHOD == request->state) && (0 == request->line_len)) {
+			request->received = received;
+			request->started = now;
+		}
 
-}
+		char c = data[i];
+
+		switch (request->state) {
+
+			case FAUXMO_PARSE_METHOD:
+				// Method is the first word of the request
+				if (c == ' ') {
+					request->line[request->line_len] = 0;
+					request->isGet = (strcmp(request->line, "GET") == 0);
+					request->line_len = 0;
+					request->state = FAUXMO_PARSE_URL;
+				} else if ((c != '\r') && (c != '\n') && (request->line_len < FAUXMO_RX_LINE_LENGTH - 1)) {
+					request->line[request->line_len++] = c;
+				}
+				i++;
+				break;
+
+			case FAUXMO_PARSE_URL:
+				if (c == ' ') {
+					request->buffer[request->url_len] = 0;
+					request->state = FAUXMO_PARSE_VERSION;
+					#ifdef ESP32
+						// A single light (state PUT or the GET that follows it) is a voice
+						// command: serve this connection ahead of discovery and listings
+						client->setPriority((_indexOf(request->buffer, request->url_len, "/lights/") > 0) ?
+							ASYNC_PRIORITY_HIGH : ASYNC_PRIORITY_NORMAL);
+					#endif
+				} else if (request->url_len < FAUXMO_RX_BUFFER_SIZE - 2) {
+					request->buffer[request->url_len++] = c;
+				} else {
+					goto overflow;
+				}
+				i++;
+				break;
+
+			case FAUXMO_PARSE_VERSION:
+				// HTTP/1.1 connections persist unless told otherwise
+				if (c == '\n') {
+					request->line[request->line_len] = 0;
+					request->keepAlive = (strcmp(request->line, "HTTP/1.1") == 0);
+					request->line_len = 0;
+					request->state = FAUXMO_PARSE_HEADER;
+				} else if ((c != '\r') && (request->line_len < FAUXMO_RX_LINE_LENGTH - 1)) {
+					request->line[request->line_len++] = c;
+				}
+				i++;
+				break;
+
+			case FAUXMO_PARSE_HEADER:
+				i++;
+				if (c == '\r') break;
+				if (c != '\n') {
+					if (request->line_len < FAUXMO_RX_LINE_LENGTH - 1) {
+						request->line[request->line_len++] = c;
+					}
+					break;
+				}
+				if (request->line_len > 0) {
+					request->line[request->line_len] = 0;
+					_onTCPHeader(request);
+					request->line_len = 0;
+					break;
+				}
+				// Empty line, headers are done. Without a Content-Length there
+				// is no telling where the body ends (it may span segments),
+				// refuse it and close once the answer is out.
+				if (!request->isGet && !request->has_length) {
+					DEBUG_MSG_FAUXMO("[FAUXMO] Body without Content-Length on client #%d\n", slot);
+					request->keepAlive = false;
+					_sendTCPResponse(client, "411 Length Required", "", 0, "text/plain", true);
+					_resetTCPRequest(request);
+					s->closeOnAck = true;
+					return true;
+				}
+				// url_len stays below FAUXMO_RX_BUFFER_SIZE - 2, so this cannot wrap
+				if (request->content_length > FAUXMO_RX_BUFFER_SIZE - request->url_len - 2) {
+					goto overflow;
+				}
+				request->state = FAUXMO_PARSE_BODY;
+				break;
+
+			case FAUXMO_PARSE_BODY:
+				{
+					size_t n = request->content_length - request->body_len;
+					if (n > len - i) n = len - i;
+					memcpy(request->buffer + request->url_len + 1 + request->body_len, data + i, n);
+					request->body_len += n;
+					i += n;
+				}
+				break;
 
-void fauxmoESP::_onTCPClient(AsyncClient *client) {
+		}
 
-	if (_enabled) {
+		// Dispatch as soon as the body is complete
+		if ((FAUXMO_PARSE_BODY == request->state) && (request->body_len == request->content_length)) {
 
-	    for (unsigned char i = 0; i < FAUXMO_TCP_MAX_CLIENTS; i++) {
+			// A pipelined request behind a listing still being streamed
+			// would interleave with it, drop it and let the client retry
+			if (s->listCursor >= 0) {
+				DEBUG_MSG_FAUXMO("[FAUXMO] Request while streaming on client #%d, closing\n", slot);
+				_resetTCPRequest(request);
+				s->closeOnAck = true;
+				return handled;
+			}
 
-	        if (!_tcpClients[i] || !_tcpClients[i]->connected()) {
+			_tcpRequestsServed++;
+			if (++s->requestCount > 1) _tcpRequestsReused++;
+			if (!_keepAlive || (s->requestCount >= _keepAliveMaxRequests)) {
+				request->keepAlive = false;
+			}
+			if (_keepAlive && !request->keepAlive) s->closeOnAck = true;
+
+			char * url = request->buffer;
+			char * body = request->buffer + request->url_len + 1;
+			body[request->body_len] = 0;
+			_timing.received = request->received;
+			_timing.started = request->started;
+			_timing.parsed = micros();
+			handled = _onTCPRequest(client, s->bridge, request->isGet, url, request->url_len, body, request->body_len);
+			_resetTCPRequest(request);
+		}
 
-	            _tcpClients[i] = client;
+	}
 
-	            client->onAck([i](void *s, AsyncClient *c, size_t len, uint32_t time) {
-	            }, 0);
+	return handled;
 
-	            client->onData([this, i](void *s, AsyncClient *c, void *data, size_t len) {
-	                _onTCPData(c, data, len);
-	            }, 0);
-	            client->onDisconnect([this, i](void *s, AsyncClient *c) {
-			if(_tcpClients[i] != NULL) {
-	                    _tcpClients[i]->free();
-	                    _tcpClients[i] = NULL;
-	                }
-			else {
-	                    DEBUG_MSG_FAUXMO("[FAUXMO] Client %d already disconnected\n", i);
-	                }
-	                delete c;
-	                DEBUG_MSG_FAUXMO("[FAUXMO] Client #%d disconnected\n", i);
-	            }, 0);
+overflow:
 
-	            client->onError([i](void *s, AsyncClient *c, int8_t error) {
-	                DEBUG_MSG_FAUXMO("[FAUXMO] Error %s (%d) on client #%d\n", c->errorToString(error), error, i);
-	            }, 0);
+	// Reset rather than close: close() runs the disconnect callback, which
+	// deletes the client while AsyncClient::_recv is still using it
+	DEBUG_MSG_FAUXMO("[FAUXMO] Request too large on client #%d, resetting\n", slot);
+	_resetTCPRequest(request);
+	client->abort();
+	return false;
 
-	            client->onTimeout([i](void *s, AsyncClient *c, uint32_t time) {
-	                DEBUG_MSG_FAUXMO("[FAUXMO] Timeout on client #%d at %i\n", i, time);
-	                c->close();
-	            }, 0);
+}
 
-                    client->setRxTimeout(FAUXMO_RX_TIMEOUT);
+void fauxmoESP::_onTCPClient(AsyncClient *client, unsigned char bridge) {
 
-	            DEBUG_MSG_FAUXMO("[FAUXMO] Client #%d connected\n", i);
-	            return;
+	if (_enabled) {
 
-	        }
+		// Free slot from the bitmap, or make room by dropping an idle keep-alive connection
+		int slot = _allocTCPSlot();
+		if (slot < 0) slot = _evictTCPSlot();
+
+		if (slot >= 0) {
+
+			fauxmoesp_tcp_slot_t * s = &_tcpSlots[slot];
+			s->client = client;
+			s->lastActivity = millis();
+			s->listCursor = -1;
+			s->requestCount = 0;
+			s->closeOnAck = false;
+			s->bridge = bridge;
+			_resetTCPRequest(&s->request);
+			_tcpSlotsUsed |= (1UL << slot);
+			_tcpConnections++;
+
+			// Callbacks only act while the slot is still theirs
+			uint16_t generation = s->generation;
+
+			client->onAck([this, slot, generation](void *s, AsyncClient *c, size_t len, uint32_t time) {
+				if (_ownsTCPSlot(slot, generation, c)) _onTCPAck(c, slot);
+			}, 0);
+
+			client->onData([this, slot, generation](void *s, AsyncClient *c, void *data, size_t len) {
+				if (_ownsTCPSlot(slot, generation, c)) _onTCPData(c, slot, (const char *) data, len);
+			}, 0);
+
+			client->onDisconnect([this, slot, generation](void *s, AsyncClient *c) {
+				if (_ownsTCPSlot(slot, generation, c)) {
+					_releaseTCPSlot(slot);
+					DEBUG_MSG_FAUXMO("[FAUXMO] Client #%d disconnected\n", slot);
+				} else {
+					DEBUG_MSG_FAUXMO("[FAUXMO] Client #%d already released\n", slot);
+				}
+				delete c;
+			}, 0);
+
+			client->onError([slot](void *s, AsyncClient *c, int8_t error) {
+				DEBUG_MSG_FAUXMO("[FAUXMO] Error %s (%d) on client #%d\n", c->errorToString(error), error, slot);
+			}, 0);
+
+			client->onTimeout([slot](void *s, AsyncClient *c, uint32_t time) {
+				DEBUG_MSG_FAUXMO("[FAUXMO] Timeout on client #%d at %i\n", slot, time);
+				c->close();
+			}, 0);
+
+			client->setRxTimeout(_keepAlive ? _keepAliveTimeout : FAUXMO_RX_TIMEOUT);
+
+			DEBUG_MSG_FAUXMO("[FAUXMO] Client #%d connected\n", slot);
+			return;
 
-	    }
+		}
 
+		_tcpRejected++;
 		DEBUG_MSG_FAUXMO("[FAUXMO] Rejecting - Too many connections\n");
 
 	} else {
@@ -494,29 +1219,48 @@ void fauxmoESP::_onTCPClient(AsyncClient *client) {
 // -----------------------------------------------------------------------------
 
 fauxmoESP::~fauxmoESP() {
-  	
-	// Free the name for each device
-	for (auto& device : _devices) {
-		free(device.name);
-  	}
-  	
-	// Delete devices  
+	removeAllDevices();
+	free(_tcpSlots);
+}
+
+void fauxmoESP::removeAllDevices() {
+
+	// Names live in the table arena, only the rendered JSON is on the heap
+	for (unsigned int id=_devices.next(0); id<_devices.end(); id=_devices.next(id+1)) {
+		_freeJson(_devices[id]);
+	}
 	_devices.clear();
+	_nameIndex.clear();
+	_listGeneration++;
+
+}
 
+size_t fauxmoESP::getJsonCacheMemory() {
+	size_t size = 0;
+	for (unsigned int id=_devices.next(0); id<_devices.end(); id=_devices.next(id+1)) {
+		size += _devices[id].json.size + _devices[id].jsonShort.size;
+	}
+	return size;
 }
 
 void fauxmoESP::setDeviceUniqueId(unsigned char id, const char *uniqueid)
 {
+    if (!_devices.used(id)) return;
     strncpy(_devices[id].uniqueid, uniqueid, FAUXMO_DEVICE_UNIQUE_ID_LENGTH);
+    _invalidateJson(id, true);
 }
 
 unsigned char fauxmoESP::addDevice(const char * device_name) {
 
-    fauxmoesp_device_t device;
-    unsigned int device_id = _devices.size();
+    // Take a free slot, the name is copied into the table arena
+    unsigned char device_id = _devices.add(device_name);
+    if (FAUXMO_INVALID_ID == device_id) {
+        DEBUG_MSG_FAUXMO("[FAUXMO] No room for device '%s' (%u/%u devices, %u/%u name bytes)\n", device_name,
+            _devices.size(), _devices.capacity(), (unsigned int) _devices.arenaUsed(), (unsigned int) _devices.arenaSize());
+        return FAUXMO_INVALID_ID;
+    }
 
-    // init properties
-    device.name = strdup(device_name);
+    fauxmoesp_device_t & device = _devices[device_id];
   	device.state = false;
 	  device.value = 0;
 
@@ -525,9 +1269,8 @@ unsigned char fauxmoESP::addDevice(const char * device_name) {
 
     snprintf(device.uniqueid, FAUXMO_DEVICE_UNIQUE_ID_LENGTH, "%02X:%s:%s", device_id, mac.c_str(), "00:00");
 
-
-    // Attach
-    _devices.push_back(device);
+    _nameIndex.insert(device.name, device_id);
+    _listGeneration++;
 
     DEBUG_MSG_FAUXMO("[FAUXMO] Device '%s' added as #%d\n", device_name, device_id);
 
@@ -536,18 +1279,25 @@ unsigned char fauxmoESP::addDevice(const char * device_name) {
 }
 
 int fauxmoESP::getDeviceId(const char * device_name) {
-    for (unsigned int id=0; id < _devices.size(); id++) {
-        if (strcmp(_devices[id].name, device_name) == 0) {
-            return id;
-        }
+    // Case and accent insensitive, same matching the bridge app uses
+    return _nameIndex.find(device_name);
+}
+
+const char * fauxmoESP::_indexName(void * self, int id) {
+    return ((fauxmoESP *) self)->_devices[id].name;
+}
+
+void fauxmoESP::_rebuildIndex() {
+    _nameIndex.clear();
+    for (unsigned int id=_devices.next(0); id<_devices.end(); id=_devices.next(id+1)) {
+        _nameIndex.insert(_devices[id].name, id);
     }
-    return -1;
 }
 
 bool fauxmoESP::renameDevice(unsigned char id, const char * device_name) {
-    if (id < _devices.size()) {
-        free(_devices[id].name);
-        _devices[id].name = strdup(device_name);
+    if (_devices.rename(id, device_name)) {
+        _rebuildIndex();
+        _invalidateJson(id, true);
         DEBUG_MSG_FAUXMO("[FAUXMO] Device #%d renamed to '%s'\n", id, device_name);
         return true;
     }
@@ -561,9 +1311,11 @@ bool fauxmoESP::renameDevice(const char * old_device_name, const char * new_devi
 }
 
 bool fauxmoESP::removeDevice(unsigned char id) {
-    if (id < _devices.size()) {
-        free(_devices[id].name);
-		_devices.erase(_devices.begin()+id);
+    if (_devices.used(id)) {
+        _freeJson(_devices[id]);
+        _devices.remove(id);
+        _rebuildIndex();
+        _listGeneration++;
         DEBUG_MSG_FAUXMO("[FAUXMO] Device #%d removed\n", id);
         return true;
     }
@@ -577,16 +1329,17 @@ bool fauxmoESP::removeDevice(const char * device_name) {
 }
 
 char * fauxmoESP::getDeviceName(unsigned char id, char * device_name, size_t len) {
-    if ((id < _devices.size()) && (device_name != NULL)) {
+    if (_devices.used(id) && (device_name != NULL)) {
         strncpy(device_name, _devices[id].name, len);
     }
     return device_name;
 }
 
 bool fauxmoESP::setState(unsigned char id, bool state, unsigned char value) {
-    if (id < _devices.size()) {
+    if (_devices.used(id)) {
 		_devices[id].state = state;
 		_devices[id].value = value;
+		_invalidateJson(id, false);
 		return true;
 	}
 	return false;
@@ -596,8 +1349,23 @@ bool fauxmoESP::setState(const char * device_name, bool state, unsigned char val
 	return setState(getDeviceId(device_name), state, value);
 }
 
+// Can be called from any task: the device goes back to state/value before the
+// next request is served, unless another PUT changed it in the meantime
+bool fauxmoESP::revertState(unsigned char id, bool fromState, unsigned char fromValue, bool state, unsigned char value) {
+	if (!_devices.used(id)) return false;
+	#ifdef ESP32
+		portENTER_CRITICAL(&_revertLock);
+	#endif
+	_devices[id].revert = {true, fromState, fromValue, state, value};
+	_revertPending = true;
+	#ifdef ESP32
+		portEXIT_CRITICAL(&_revertLock);
+	#endif
+	return true;
+}
+
 bool fauxmoESP::setState(unsigned char id, bool state, unsigned char value, byte* rgb){
-	if (id >= _devices.size()) return false;
+	if (!_devices.used(id)) return false;
 	bool success = setState(id, state, value);
 	if (success) {
 		_devices[id].rgb[0] = rgb[0];
@@ -616,7 +1384,9 @@ bool fauxmoESP::setState(const char * device_name, bool state, unsigned char val
 // -----------------------------------------------------------------------------
 
 bool fauxmoESP::process(AsyncClient *client, bool isGet, String url, String body) {
-	return _onTCPRequest(client, isGet, url, body);
+	// External servers only serve the first bridge, the request was parsed by them
+	_timing.received = _timing.started = _timing.parsed = micros();
+	return _onTCPRequest(client, 0, isGet, url.c_str(), url.length(), body.c_str(), body.length());
 }
 
 void fauxmoESP::handle() {
@@ -635,25 +1405,44 @@ void fauxmoESP::enable(bool enable) {
 
     if (_enabled) {
 
-		// Start TCP server if internal
+		// Pre-render discovery payloads
+		_renderResponses();
+
+		// Start TCP servers if internal, one per virtual bridge
 		if (_internal) {
-			if (NULL == _server) {
-				_server = new AsyncServer(_tcp_port);
-				_server->onClient([this](void *s, AsyncClient* c) {
-					_onTCPClient(c);
-				}, 0);
+			for (unsigned char bridge=0; bridge<_bridges; bridge++) {
+				if (NULL == _servers[bridge]) {
+					_servers[bridge] = new AsyncServer(_tcp_port + bridge);
+					_servers[bridge]->onClient([this, bridge](void *s, AsyncClient* c) {
+						_onTCPClient(c, bridge);
+					}, 0);
+				}
+				_servers[bridge]->begin();
 			}
-			_server->begin();
 		}
 
 		// UDP setup
 		#ifdef ESP32
-            _udp.beginMulticast(FAUXMO_UDP_MULTICAST_IP, FAUXMO_UDP_MULTICAST_PORT);
+            // Searches and delayed replies are handled on the async_tcp task,
+            // whatever the main loop is doing
+            _udp.onPacket([this](void *s, AsyncUDPSocket *u, const IPAddress & ip, uint16_t port, const uint8_t * data, size_t len) {
+                if (_enabled) _onUDPData(ip, port, (void *) data, len);
+            }, 0);
+            _udp.onTimer([this](void *s, AsyncUDPSocket *u) {
+                _flushUDPResponses();
+            }, 0);
+            _udp.listenMulticast(FAUXMO_UDP_MULTICAST_IP, FAUXMO_UDP_MULTICAST_PORT);
         #else
             _udp.beginMulticast(WiFi.localIP(), FAUXMO_UDP_MULTICAST_IP, FAUXMO_UDP_MULTICAST_PORT);
         #endif
         DEBUG_MSG_FAUXMO("[FAUXMO] UDP server started\n");
 
+	} else {
+
+		#ifdef ESP32
+			_udp.close();
+		#endif
+
 	}
 
 }
@@ -30,10 +30,34 @@ THE SOFTWARE.
 
 #define FAUXMO_UDP_MULTICAST_IP     IPAddress(239,255,255,250)
 #define FAUXMO_UDP_MULTICAST_PORT   1900
-#define FAUXMO_TCP_MAX_CLIENTS      10
+#define FAUXMO_UDP_BUFFER_SIZE      512     // M-SEARCH requests are a few hundred bytes
+#define FAUXMO_UDP_MAX_DELAY        1000    // ms, cap on the MX based response delay
+#define FAUXMO_UDP_DEDUP_WINDOW     2000    // ms, repeated searches from one searcher get a single reply
+#define FAUXMO_UDP_MAX_REQUESTERS   8
+#define FAUXMO_TCP_MAX_CLIENTS      10      // default client slots, see setMaxClients()
+#define FAUXMO_TCP_SLOTS_LIMIT      32      // slots in use are tracked in a 32 bit bitmap
+#ifndef FAUXMO_MAX_DEVICES
+#define FAUXMO_MAX_DEVICES          100     // device table slots, at most 254 (ids are an unsigned char)
+#endif
+#ifndef FAUXMO_DEVICE_NAME_LENGTH
+#define FAUXMO_DEVICE_NAME_LENGTH   50      // longest name the arena is sized for, longer ones use up the slack
+#endif
+#ifndef FAUXMO_NAME_ARENA_SIZE
+#define FAUXMO_NAME_ARENA_SIZE      (FAUXMO_MAX_DEVICES * (FAUXMO_DEVICE_NAME_LENGTH + 1))  // every slot with a full length name
+#endif
+#define FAUXMO_INVALID_ID           0xFF
 #define FAUXMO_TCP_PORT             1901
+#ifndef FAUXMO_MAX_BRIDGES
+#define FAUXMO_MAX_BRIDGES          4       // virtual Hue bridges, on consecutive ports
+#endif
+static_assert(FAUXMO_MAX_BRIDGES <= 64, "bridge index must fit the 6 upper bits of the first MAC octet");
 #define FAUXMO_RX_TIMEOUT           3
+#define FAUXMO_KEEPALIVE_TIMEOUT    15      // idle seconds before a persistent connection is dropped
+#define FAUXMO_KEEPALIVE_MAX_REQUESTS   100 // requests served on one connection before asking to close
 #define FAUXMO_DEVICE_UNIQUE_ID_LENGTH  27
+#define FAUXMO_RX_BUFFER_SIZE       512     // per client, holds url + body of one request
+#define FAUXMO_RX_LINE_LENGTH       32      // header lines are only inspected up to this length
+#define FAUXMO_JSON_CACHE_SLACK     8       // spare bytes so state/bri changes re-render in place
 
 //#define DEBUG_FAUXMO                Serial
 #ifdef DEBUG_FAUXMO
@@ -70,21 +94,255 @@ THE SOFTWARE.
 
 #include <WiFiUdp.h>
 #include <functional>
-#include <vector>
 #include <MD5Builder.h>
 #include "templates.h"
+#include "nameindex.h"
 
 typedef std::function<void(unsigned char, const char *, bool, unsigned char)> TSetStateCallback;
 typedef std::function<void(unsigned char, const char *, bool, unsigned char, byte *)> TSetStateWithColorCallback;
 
+// Attributes found in a Hue state body, see FAUXMO_STATE_* for which ones were present.
+// xy is kept in 1/10000 units.
+#define FAUXMO_STATE_ON             0x01
+#define FAUXMO_STATE_BRI            0x02
+#define FAUXMO_STATE_HUE            0x04
+#define FAUXMO_STATE_SAT            0x08
+#define FAUXMO_STATE_CT             0x10
+#define FAUXMO_STATE_XY             0x20
+#define FAUXMO_STATE_TRANSITION     0x40
+
+typedef struct {
+    unsigned char fields;
+    bool on;
+    unsigned char bri;
+    uint16_t hue;
+    unsigned char sat;
+    uint16_t ct;
+    uint16_t x;
+    uint16_t y;
+    uint16_t transitiontime;
+} fauxmoesp_state_t;
+
+// Rollback of a device whose action failed, posted by revertState() and
+// applied by the TCP handler. Dropped if the device changed meanwhile.
+typedef struct {
+    bool pending;
+    bool fromState;             // state the failed request set
+    unsigned char fromValue;
+    bool state;                 // state to go back to
+    unsigned char value;
+} fauxmoesp_revert_t;
+
+// Rendered device JSON, kept until one of the rendered fields changes
+typedef struct {
+    char * data;
+    uint16_t size;      // allocated bytes
+    uint16_t len;       // rendered length
+    bool dirty;
+} fauxmoesp_json_cache_t;
+
 typedef struct {
     char * name;
     bool state;
     unsigned char value;
     byte rgb[3] = {255, 255, 255};
     char uniqueid[FAUXMO_DEVICE_UNIQUE_ID_LENGTH];
+    fauxmoesp_json_cache_t json = {NULL, 0, 0, true};
+    fauxmoesp_json_cache_t jsonShort = {NULL, 0, 0, true};
+    fauxmoesp_revert_t revert = {false, false, 0, false, 0};
 } fauxmoesp_device_t;
 
+// Search targets we answer to, part of the requester key
+#define FAUXMO_SSDP_ST_NONE         0       // MAN: ssdp:discover only
+#define FAUXMO_SSDP_ST_ROOTDEVICE   1
+#define FAUXMO_SSDP_ST_BASIC        2
+#define FAUXMO_SSDP_ST_ALL          3
+
+// Discovery state per searcher, keyed on source ip, port and ST (an Echo may
+// search from several sockets or for several targets). A searcher has at
+// most one reply pending, repeats of the same search are folded into it.
+typedef struct {
+    IPAddress ip;
+    uint16_t port;
+    unsigned char st;           // FAUXMO_SSDP_ST_*
+    bool pending;
+    unsigned long due;
+    unsigned long lastSeen;
+    unsigned long lastResponse;
+    unsigned long searches;
+    unsigned long responses;
+    unsigned long coalesced;
+} fauxmoesp_udp_requester_t;
+
+// Fixed-capacity device table. Slots never move, so a device keeps its id
+// until it is removed, and freed slots are reused through a free list.
+// Names are stored back to back in one arena that is compacted on remove.
+template <unsigned int CAPACITY, size_t ARENA_SIZE>
+class fauxmoDeviceTable {
+
+    static_assert(CAPACITY < FAUXMO_INVALID_ID, "device ids must fit an unsigned char");
+
+    public:
+
+        fauxmoDeviceTable() { clear(); }
+
+        void clear() {
+            for (unsigned int i=0; i<CAPACITY; i++) {
+                _used[i] = false;
+                _next[i] = (i + 1 < CAPACITY) ? i + 1 : FAUXMO_INVALID_ID;
+            }
+            _free = 0;
+            _count = 0;
+            _end = 0;
+            _arenaUsed = 0;
+        }
+
+        // Returns the new slot, FAUXMO_INVALID_ID when the table or the arena is full
+        unsigned char add(const char * name) {
+            if (FAUXMO_INVALID_ID == _free) return FAUXMO_INVALID_ID;
+            char * stored = _store(name);
+            if (NULL == stored) return FAUXMO_INVALID_ID;
+            unsigned char id = _free;
+            _free = _next[id];
+            _devices[id] = fauxmoesp_device_t();
+            _devices[id].name = stored;
+            _used[id] = true;
+            _count++;
+            if (id >= _end) _end = id + 1;
+            return id;
+        }
+
+        bool rename(unsigned char id, const char * name) {
+            if (!used(id)) return false;
+            char * old = _devices[id].name;
+            size_t len = strlen(name) + 1;
+            // A name read back from the arena (this device's or another's) would be
+            // moved or overwritten by the compaction, so it is copied before the old
+            // one goes, which takes room for both for a moment
+            bool inArena = (name >= _arena) && (name < _arena + ARENA_SIZE);
+            size_t needed = inArena ? _arenaUsed + len : _arenaUsed - (strlen(old) + 1) + len;
+            if (needed > ARENA_SIZE) return false;
+            if (inArena) {
+                _devices[id].name = _store(name);
+                _release(old);
+            } else {
+                _release(old);
+                _devices[id].name = _store(name);
+            }
+            return true;
+        }
+
+        bool remove(unsigned char id) {
+            if (!used(id)) return false;
+            _release(_devices[id].name);
+            _devices[id].name = NULL;
+            _used[id] = false;
+            _next[id] = _free;
+            _free = id;
+            _count--;
+            while ((_end > 0) && !_used[_end - 1]) _end--;
+            return true;
+        }
+
+        bool used(unsigned int id) const { return (id < CAPACITY) && _used[id]; }
+        fauxmoesp_device_t & operator[](unsigned char id) { return _devices[id]; }
+
+        // First used slot at or after id, end() when there is none
+        unsigned int next(unsigned int id) const {
+            while ((id < _end) && !_used[id]) id++;
+            return id < _end ? id : _end;
+        }
+        unsigned int end() const { return _end; }
+        unsigned int size() const { return _count; }
+        unsigned int capacity() const { return CAPACITY; }
+
+        size_t memory() const { return sizeof(*this); }
+        size_t arenaUsed() const { return _arenaUsed; }
+        size_t arenaSize() const { return ARENA_SIZE; }
+
+    private:
+
+        fauxmoesp_device_t _devices[CAPACITY];
+        bool _used[CAPACITY];
+        unsigned char _next[CAPACITY];      // free list links
+        unsigned char _free;
+        unsigned int _count;
+        unsigned int _end;                  // one past the highest used slot
+        char _arena[ARENA_SIZE];
+        size_t _arenaUsed;
+
+        char * _store(const char * name) {
+            size_t len = strlen(name) + 1;
+            if (_arenaUsed + len > ARENA_SIZE) return NULL;
+            char * stored = _arena + _arenaUsed;
+            memcpy(stored, name, len);
+            _arenaUsed += len;
+            return stored;
+        }
+
+        void _release(char * name) {
+            size_t len = strlen(name) + 1;
+            char * tail = name + len;
+            memmove(name, tail, _arena + _arenaUsed - tail);
+            _arenaUsed -= len;
+            for (unsigned int i=0; i<_end; i++) {
+                if (_used[i] && (_devices[i].name >= tail)) _devices[i].name -= len;
+            }
+        }
+
+};
+
+enum {
+    FAUXMO_PARSE_METHOD,
+    FAUXMO_PARSE_URL,
+    FAUXMO_PARSE_VERSION,
+    FAUXMO_PARSE_HEADER,
+    FAUXMO_PARSE_BODY
+};
+
+// Incremental request parser state, one per TCP client slot.
+// Url and body are stored back to back (each NUL terminated) in buffer,
+// so route handlers get pointer + length views into it without copies.
+typedef struct {
+    unsigned char state;
+    bool isGet;
+    bool keepAlive;
+    unsigned char line_len;
+    char line[FAUXMO_RX_LINE_LENGTH];
+    char buffer[FAUXMO_RX_BUFFER_SIZE];
+    size_t url_len;
+    size_t body_len;
+    size_t content_length;
+    bool has_length;            // a Content-Length header was seen
+    uint32_t received;          // micros() when the first segment reached lwIP
+    uint32_t started;           // micros() when it reached the parser
+} fauxmoesp_request_t;
+
+// Checkpoints of the request being handled, in micros(). Only meaningful
+// inside the state callbacks, which run synchronously from _onTCPControl.
+typedef struct {
+    uint32_t received;          // lwIP handed over the first segment (ESP32, else = started)
+    uint32_t started;           // first byte seen by the parser, in the AsyncTCP _recv path
+    uint32_t parsed;            // request complete
+    uint32_t routed;            // _onTCPControl entered
+    uint32_t replied;           // response queued
+} fauxmoesp_timing_t;
+
+// TCP client slot. The generation is bumped whenever the slot is released,
+// so callbacks of a connection that lost its slot (evicted, or already
+// disconnected) can tell it now belongs to someone else.
+typedef struct {
+    AsyncClient * client;
+    uint16_t generation;
+    unsigned long lastActivity;
+    int listCursor;                 // next device to stream in a listing, -1 when idle
+    uint16_t listGeneration;        // fauxmoESP::_listGeneration the listing was sized with
+    unsigned int requestCount;
+    unsigned char bridge;
+    bool closeOnAck;
+    fauxmoesp_request_t request;
+} fauxmoesp_tcp_slot_t;
+
 class fauxmoESP {
 
     public:
@@ -98,6 +356,7 @@ class fauxmoESP {
         bool removeDevice(const char * device_name);
         char * getDeviceName(unsigned char id, char * buffer, size_t len);
         int getDeviceId(const char * device_name);
+        void removeAllDevices();
         void setDeviceUniqueId(unsigned char id, const char *uniqueid);
         void onSetState(TSetStateCallback fn) { _setStateCallback = fn; }
         void onSetState(TSetStateWithColorCallback fn) { _setStateWithColorCallback = fn; }
@@ -105,43 +364,146 @@ class fauxmoESP {
         bool setState(const char * device_name, bool state, unsigned char value);
         bool setState(unsigned char id, bool state, unsigned char value, byte* rgb);
         bool setState(const char * device_name, bool state, unsigned char value, byte* rgb);
+        bool revertState(unsigned char id, bool fromState, unsigned char fromValue, bool state, unsigned char value);
         bool process(AsyncClient *client, bool isGet, String url, String body);
         void enable(bool enable);
         void createServer(bool internal) { _internal = internal; }
         void setPort(unsigned long tcp_port) { _tcp_port = tcp_port; }
+        void setBridges(unsigned char bridges) { _bridges = constrain(bridges, 1, FAUXMO_MAX_BRIDGES); }     // before enable()
+        unsigned char getBridges() { return _bridges; }
+        void setKeepAlive(bool enable, unsigned int timeout = FAUXMO_KEEPALIVE_TIMEOUT, unsigned int max_requests = FAUXMO_KEEPALIVE_MAX_REQUESTS) {
+            _keepAlive = enable;
+            _keepAliveTimeout = timeout;
+            _keepAliveMaxRequests = max_requests;
+        }
+        bool setMaxClients(unsigned char clients);     // before enable(), false while clients are connected
+        unsigned char getMaxClients() { return _tcpMaxClients; }
         void handle();
+        unsigned long getJsonCacheHits() { return _jsonCacheHits; }
+        unsigned long getJsonCacheMisses() { return _jsonCacheMisses; }
+        unsigned long getTCPConnections() { return _tcpConnections; }
+        unsigned long getTCPRequests() { return _tcpRequestsServed; }
+        unsigned long getTCPReusedRequests() { return _tcpRequestsReused; }
+        unsigned char getTCPClients() { return __builtin_popcount(_tcpSlotsUsed); }
+        unsigned long getTCPRejected() { return _tcpRejected; }
+        unsigned long getTCPEvicted() { return _tcpEvicted; }
+        unsigned long getTCPResponses() { return _tcpResponses; }                 // single call responses (ESP32)
+        unsigned long getTCPResponseSegments() { return _tcpResponseSegments; }   // TCP segments they took
+        unsigned long getTCPResponsesFailed() { return _tcpResponsesFailed; }     // did not fit, connection closed
+        size_t getDeviceTableMemory() { return _devices.memory(); }
+        size_t getNameArenaUsed() { return _devices.arenaUsed(); }
+        size_t getJsonCacheMemory();
+        const fauxmoesp_udp_requester_t * getUDPRequester(unsigned char index);     // NULL past the last one
+        const fauxmoesp_timing_t & getRequestTiming() { return _timing; }
 
     private:
 
-        AsyncServer * _server;
+        AsyncServer * _servers[FAUXMO_MAX_BRIDGES] = {NULL};
+        unsigned char _bridges = 1;
         bool _enabled = false;
         bool _internal = true;
         unsigned int _tcp_port = FAUXMO_TCP_PORT;
-        std::vector<fauxmoesp_device_t> _devices;
+        bool _keepAlive = false;
+        unsigned int _keepAliveTimeout = FAUXMO_KEEPALIVE_TIMEOUT;
+        unsigned int _keepAliveMaxRequests = FAUXMO_KEEPALIVE_MAX_REQUESTS;
+        unsigned long _tcpConnections = 0;
+        unsigned long _tcpRequestsServed = 0;
+        unsigned long _tcpRequestsReused = 0;
+        unsigned long _tcpResponses = 0;
+        unsigned long _tcpResponseSegments = 0;
+        unsigned long _tcpResponsesFailed = 0;
+        fauxmoDeviceTable<FAUXMO_MAX_DEVICES, FAUXMO_NAME_ARENA_SIZE> _devices;
+        NameIndex<FAUXMO_MAX_DEVICES> _nameIndex{_indexName, this};
 		#ifdef ESP8266
         WiFiEventHandler _handler;
 		#endif
+        #ifdef ESP32
+        AsyncUDPSocket _udp;        // SSDP is served from the async_tcp task
+        #else
         WiFiUDP _udp;
-        AsyncClient * _tcpClients[FAUXMO_TCP_MAX_CLIENTS];
+        char _udpBuffer[FAUXMO_UDP_BUFFER_SIZE + 1];
+        #endif
+        fauxmoesp_udp_requester_t _udpRequesters[FAUXMO_UDP_MAX_REQUESTERS];
+        unsigned char _udpRequesterCount = 0;
+        fauxmoesp_tcp_slot_t * _tcpSlots = NULL;       // allocated on the first connection
+        unsigned char _tcpMaxClients = FAUXMO_TCP_MAX_CLIENTS;
+        uint32_t _tcpSlotsUsed = 0;
+        unsigned long _tcpRejected = 0;
+        unsigned long _tcpEvicted = 0;
+        fauxmoesp_timing_t _timing = {0, 0, 0, 0, 0};
+        volatile bool _revertPending = false;
+        #ifdef ESP32
+        portMUX_TYPE _revertLock = portMUX_INITIALIZER_UNLOCKED;
+        #endif
         TSetStateCallback _setStateCallback = NULL;
         TSetStateWithColorCallback _setStateWithColorCallback = NULL;
 
-        String _deviceJson(unsigned char id, bool all); 	// all = true means we are listing all devices so use full description template
+        // Discovery payloads are rendered once and only re-rendered when the IP, port or bridge count changes
+        IPAddress _renderedIP;
+        unsigned int _renderedPort = 0;
+        unsigned char _renderedBridges = 0;
+        char _bridgeId[FAUXMO_MAX_BRIDGES][13];
+        char _udpResponse[FAUXMO_MAX_BRIDGES][sizeof(FAUXMO_UDP_RESPONSE_TEMPLATE) + 32];
+        size_t _udpResponseLen[FAUXMO_MAX_BRIDGES];
+        char _descriptionResponse[FAUXMO_MAX_BRIDGES][sizeof(FAUXMO_DESCRIPTION_TEMPLATE) + 64];
+
+        unsigned long _jsonCacheHits = 0;
+        unsigned long _jsonCacheMisses = 0;
+        uint16_t _listGeneration = 0;   // bumped when a device enters, leaves or changes its listing entry
+
+        const char * _deviceJson(unsigned char id, bool all, size_t * len); 	// all = true means full description template, false the short listing one
+        int _renderDeviceJson(unsigned char id, bool all, char * buffer, size_t len);
+        void _invalidateJson(unsigned char id, bool all);
+        void _applyReverts();
+        void _cancelRevert(unsigned char id);
+        void _freeJson(fauxmoesp_device_t & device);
+        static const char * _indexName(void * self, int id);
+        void _rebuildIndex();
+
+        void _renderResponses();
+        void _refreshResponses();
 
         void _handleUDP();
         void _onUDPData(const IPAddress remoteIP, unsigned int remotePort, void *data, size_t len);
-        void _sendUDPResponse();
+        bool _parseSearch(const char * data, size_t len, unsigned int * mx, unsigned char * st);
+        void _scheduleUDPResponse(const IPAddress & ip, unsigned int port, unsigned char st, unsigned int mx);
+        void _flushUDPResponses();
+        void _armUDPTimer();
+        void _sendUDPResponse(const IPAddress & ip, unsigned int port);
+
+        void _onTCPClient(AsyncClient *client, unsigned char bridge = 0);
+        void _resetTCPRequest(fauxmoesp_request_t * request);
+        size_t _parseLength(const char * value);
+        void _onTCPHeader(fauxmoesp_request_t * request);
+        bool _onTCPData(AsyncClient *client, unsigned char slot, const char * data, size_t len);
+        bool _onTCPRequest(AsyncClient *client, unsigned char bridge, bool isGet, const char * url, size_t url_len, const char * body, size_t body_len);
+        bool _onTCPDescription(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len);
+        bool _onTCPList(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len);
+        size_t _listPrefix(unsigned int light, bool first, char * buffer, size_t len);
+        bool _streamList(AsyncClient *client, int slot, unsigned char bridge, unsigned int id);
+        void _onTCPAck(AsyncClient *client, unsigned char slot);
+        int _clientSlot(AsyncClient *client);
+        int _allocTCPSlot();
+        int _evictTCPSlot();
+        void _releaseTCPSlot(unsigned char slot);
+        bool _ownsTCPSlot(unsigned char slot, uint16_t generation, AsyncClient *client);
+        const char * _connectionHeader(AsyncClient *client);
+        bool _onTCPControl(AsyncClient *client, unsigned char bridge, const char * url, size_t url_len, const char * body, size_t body_len);
+
+        // Device slots are dealt round robin, slot = (light - 1) * _bridges + bridge
+        unsigned int _bridgeNext(unsigned char bridge, unsigned int id);
+        unsigned int _bridgeSlot(unsigned char bridge, unsigned int light) { return (light - 1) * _bridges + bridge; }
+        unsigned int _bridgeLight(unsigned int id) { return id / _bridges + 1; }
+        void _sendTCPHeaders(AsyncClient *client, const char * code, const char * mime, size_t length);
+        void _sendTCPResponse(AsyncClient *client, const char * code, const char * body, size_t length, const char * mime, bool constant = false);
+
+        bool _parseState(const char * body, size_t len, fauxmoesp_state_t * state);     // false when no known attribute was found
+        void _applyState(unsigned char id, const fauxmoesp_state_t * state);
+        long _parseFixed(const char * data, size_t len, size_t * pos);
 
-        void _onTCPClient(AsyncClient *client);
-        bool _onTCPData(AsyncClient *client, void *data, size_t len);
-        bool _onTCPRequest(AsyncClient *client, bool isGet, String url, String body);
-        bool _onTCPDescription(AsyncClient *client, String url, String body);
-        bool _onTCPList(AsyncClient *client, String url, String body);
-        bool _onTCPControl(AsyncClient *client, String url, String body);
-        void _sendTCPResponse(AsyncClient *client, const char * code, char * body, const char * mime);
+        int _indexOf(const char * data, size_t len, const char * needle, size_t from = 0);
+        long _toInt(const char * data, size_t len, size_t pos);
 
         String _byte2hex(uint8_t zahl);
         String _makeMD5(String text);
-        byte* _hs2rgb(uint16_t hue, uint8_t sat);
-        byte* _ct2rgb(uint16_t ct);
 };
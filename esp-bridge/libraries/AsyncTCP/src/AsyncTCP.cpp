@@ -29,6 +29,11 @@ extern "C" {
 #include "lwip/inet.h"
 #include "lwip/opt.h"
 #include "lwip/tcp.h"
+#ifndef LIBRETINY
+#include "lwip/igmp.h"
+#include "lwip/udp.h"
+#include "esp_timer.h"
+#endif
 }
 
 #if CONFIG_ASYNC_TCP_USE_WDT
@@ -80,12 +85,16 @@ typedef enum {
   LWIP_TCP_CLEAR,
   LWIP_TCP_ACCEPT,
   LWIP_TCP_CONNECTED,
-  LWIP_TCP_DNS
+  LWIP_TCP_DNS,
+  LWIP_UDP_RECV,
+  LWIP_UDP_TIMER
 } lwip_event_t;
 
 typedef struct {
     lwip_event_t event;
     void* arg;
+    uint8_t priority; // class of the connection when lwIP queued the event
+    uint32_t queued;  // micros() when lwIP queued the event
     union {
         struct {
             tcp_pcb* pcb;
@@ -102,6 +111,7 @@ typedef struct {
             tcp_pcb* pcb;
             pbuf* pb;
             int8_t err;
+            uint32_t stamp;
         } recv;
         struct {
             tcp_pcb* pcb;
@@ -117,10 +127,16 @@ typedef struct {
             const char* name;
             ip_addr_t addr;
         } dns;
+        struct {
+            pbuf* pb;
+            ip_addr_t addr;
+            uint16_t port;
+        } udp;
     };
 } lwip_event_packet_t;
 
 static QueueHandle_t _async_queue;
+static QueueHandle_t _async_clear_queue; // clients closed outside the service task, see _tcp_clear_events
 static TaskHandle_t _async_service_task_handle = NULL;
 
 SemaphoreHandle_t _slots_lock;
@@ -142,30 +158,185 @@ static inline bool _init_async_event_queue() {
       return false;
     }
   }
+  if (!_async_clear_queue) {
+    _async_clear_queue = xQueueCreate(CONFIG_LWIP_MAX_ACTIVE_TCP, sizeof(void*));
+    if (!_async_clear_queue) {
+      return false;
+    }
+  }
   return true;
 }
 
-static inline bool _send_async_event(lwip_event_packet_t** e, TickType_t wait = portMAX_DELAY) {
+static inline bool _send_async_event(lwip_event_packet_t** e, TickType_t wait = portMAX_DELAY, uint8_t priority = ASYNC_PRIORITY_NORMAL) {
+  (*e)->priority = priority;
+  (*e)->queued = micros();
   return _async_queue && xQueueSend(_async_queue, e, wait) == pdPASS;
 }
 
-static inline bool _prepend_async_event(lwip_event_packet_t** e, TickType_t wait = portMAX_DELAY) {
+static inline bool _prepend_async_event(lwip_event_packet_t** e, TickType_t wait = portMAX_DELAY, uint8_t priority = ASYNC_PRIORITY_NORMAL) {
+  (*e)->priority = priority;
+  (*e)->queued = micros();
   return _async_queue && xQueueSendToFront(_async_queue, e, wait) == pdPASS;
 }
 
+// Priority class of a client, read in the lwIP thread when its event is queued.
+// The client is the arg of a pcb with our callbacks, _close() unhooks them first.
+static inline uint8_t _client_priority(void* arg) {
+  return arg ? reinterpret_cast<AsyncClient*>(arg)->getPriority() : ASYNC_PRIORITY_NORMAL;
+}
+
+/*
+  Priority classes. lwIP stamps each event with its connection's class when it
+  queues it, and the service task moves events from _async_queue into one FIFO
+  per class without touching the client. An event that finds earlier events of
+  its connection staged in the other class joins them, so a connection changing
+  class is never reordered. High events are handled first, but after
+  CONFIG_ASYNC_TCP_PRIORITY_BURST of them in a row a waiting normal one goes.
+  At most CONFIG_ASYNC_TCP_QUEUE_SIZE events are staged at once.
+*/
+
+typedef struct {
+    lwip_event_packet_t* events[CONFIG_ASYNC_TCP_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t count;
+} event_fifo_t;
+
+static event_fifo_t _staged_events[2];
+static volatile uint16_t _staged_count = 0;
+static uint16_t _high_streak = 0;
+
+// Written by the service task only and read without locking, see AsyncClient::getQueueStats
+static uint32_t _queue_events[2];
+static uint64_t _queue_wait_total[2];
+static uint32_t _queue_wait_max[2];
+static uint32_t _queue_forced = 0;
+
+static inline void _fifo_push(event_fifo_t* fifo, lwip_event_packet_t* e, bool front) {
+  if (front) {
+    fifo->head = (fifo->head + CONFIG_ASYNC_TCP_QUEUE_SIZE - 1) % CONFIG_ASYNC_TCP_QUEUE_SIZE;
+    fifo->events[fifo->head] = e;
+  } else {
+    fifo->events[(fifo->head + fifo->count) % CONFIG_ASYNC_TCP_QUEUE_SIZE] = e;
+  }
+  fifo->count++;
+}
+
+static inline lwip_event_packet_t* _fifo_peek(event_fifo_t* fifo) {
+  return fifo->count ? fifo->events[fifo->head] : NULL;
+}
+
+static inline lwip_event_packet_t* _fifo_pop(event_fifo_t* fifo) {
+  lwip_event_packet_t* e = fifo->events[fifo->head];
+  fifo->head = (fifo->head + 1) % CONFIG_ASYNC_TCP_QUEUE_SIZE;
+  fifo->count--;
+  return e;
+}
+
+// moves the events of arg to the back of "to" in their order, or frees them if "to" is NULL
+static void _fifo_extract(event_fifo_t* fifo, void* arg, event_fifo_t* to) {
+  uint16_t kept = 0;
+  for (uint16_t i = 0; i < fifo->count; i++) {
+    lwip_event_packet_t* e = fifo->events[(fifo->head + i) % CONFIG_ASYNC_TCP_QUEUE_SIZE];
+    if (e->arg != arg) {
+      fifo->events[(fifo->head + kept++) % CONFIG_ASYNC_TCP_QUEUE_SIZE] = e;
+    } else if (to) {
+      _fifo_push(to, e, false);
+    } else {
+      free(e);
+      _staged_count--;
+    }
+  }
+  fifo->count = kept;
+}
+
+static bool _fifo_contains(event_fifo_t* fifo, void* arg) {
+  for (uint16_t i = 0; i < fifo->count; i++) {
+    if (fifo->events[(fifo->head + i) % CONFIG_ASYNC_TCP_QUEUE_SIZE]->arg == arg) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint32_t _async_events_waiting() {
+  return uxQueueMessagesWaiting(_async_queue) + _staged_count;
+}
+
+static bool _remove_events_with_arg(void* arg);
+
+static void _stage_async_event(lwip_event_packet_t* e) {
+  if (e->event == LWIP_TCP_CLEAR) {
+    // only wakes the service task, the clients to clear are in _async_clear_queue
+    free((void*)(e));
+    return;
+  }
+  uint8_t priority = e->priority ? ASYNC_PRIORITY_HIGH : ASYNC_PRIORITY_NORMAL;
+  event_fifo_t* other = &_staged_events[!priority];
+  if (other->count && e->arg && _fifo_contains(other, e->arg)) {
+    priority = !priority;
+  }
+  // accept/connected were prepended to the queue, keep them ahead of their class
+  bool front = (e->event == LWIP_TCP_ACCEPT || e->event == LWIP_TCP_CONNECTED);
+  _fifo_push(&_staged_events[priority], e, front);
+  _staged_count++;
+}
+
+// drops the events of clients closed outside the service task, before any is handed out
+static void _receive_clear_events() {
+  void* arg;
+  while (_async_clear_queue && xQueueReceive(_async_clear_queue, &arg, 0) == pdPASS) {
+    _remove_events_with_arg(arg);
+  }
+}
+
 static inline bool _get_async_event(lwip_event_packet_t** e) {
   if (!_async_queue) {
     return false;
   }
 
+  lwip_event_packet_t* next_pkt = NULL;
+  if (!_staged_count) {
 #if CONFIG_ASYNC_TCP_USE_WDT
-  // need to return periodically to feed the dog
-  if (xQueueReceive(_async_queue, e, pdMS_TO_TICKS(1000)) != pdPASS)
-    return false;
+    // need to return periodically to feed the dog
+    if (xQueueReceive(_async_queue, &next_pkt, pdMS_TO_TICKS(1000)) != pdPASS)
+      return false;
 #else
-  if (xQueueReceive(_async_queue, e, portMAX_DELAY) != pdPASS)
-    return false;
+    if (xQueueReceive(_async_queue, &next_pkt, portMAX_DELAY) != pdPASS)
+      return false;
 #endif
+    _stage_async_event(next_pkt);
+  }
+  while (_staged_count < CONFIG_ASYNC_TCP_QUEUE_SIZE && xQueueReceive(_async_queue, &next_pkt, 0) == pdPASS) {
+    _stage_async_event(next_pkt);
+  }
+  // even with staging full, a closed client must not get another event
+  _receive_clear_events();
+  if (!_staged_count) {
+    return false;
+  }
+
+  uint8_t priority = ASYNC_PRIORITY_HIGH;
+  bool normal_waiting = _staged_events[ASYNC_PRIORITY_NORMAL].count > 0;
+  if (!_staged_events[ASYNC_PRIORITY_HIGH].count) {
+    priority = ASYNC_PRIORITY_NORMAL;
+    _high_streak = 0;
+  } else if (normal_waiting && _high_streak >= CONFIG_ASYNC_TCP_PRIORITY_BURST) {
+    priority = ASYNC_PRIORITY_NORMAL;
+    _high_streak = 0;
+    _queue_forced++;
+  } else {
+    _high_streak = normal_waiting ? _high_streak + 1 : 0;
+  }
+  event_fifo_t* fifo = &_staged_events[priority];
+  *e = _fifo_pop(fifo);
+  _staged_count--;
+
+  uint32_t wait = micros() - (*e)->queued;
+  _queue_events[priority]++;
+  _queue_wait_total[priority] += wait;
+  if (wait > _queue_wait_max[priority]) {
+    _queue_wait_max[priority] = wait;
+  }
 
   if ((*e)->event != LWIP_TCP_POLL)
     return true;
@@ -178,19 +349,11 @@ static inline bool _get_async_event(lwip_event_packet_t** e) {
     It won't be effective if user would run multiple simultaneous long running callbacks due to message interleaving.
     todo: implement some kind of fair dequeing or (better) simply punish user for a bad designed callbacks by resetting hog connections
   */
-  lwip_event_packet_t* next_pkt = NULL;
-  while (xQueuePeek(_async_queue, &next_pkt, 0) == pdPASS) {
-    if (next_pkt->arg == (*e)->arg && next_pkt->event == LWIP_TCP_POLL) {
-      if (xQueueReceive(_async_queue, &next_pkt, 0) == pdPASS) {
-        free(next_pkt);
-        next_pkt = NULL;
-        log_d("coalescing polls, network congestion or async callbacks might be too slow!");
-        continue;
-      }
-    }
-
-    // quit while loop if next event can't be discarded
-    break;
+  while ((next_pkt = _fifo_peek(fifo)) != NULL && next_pkt->arg == (*e)->arg && next_pkt->event == LWIP_TCP_POLL) {
+    _fifo_pop(fifo);
+    _staged_count--;
+    free(next_pkt);
+    log_d("coalescing polls, network congestion or async callbacks might be too slow!");
   }
 
   /*
@@ -202,7 +365,7 @@ static inline bool _get_async_event(lwip_event_packet_t** e) {
     Let's discard poll events processing using linear-increasing probability curve when queue size grows over 3/4
     Poll events are periodic and connection could get another chance next time
   */
-  if (uxQueueMessagesWaiting(_async_queue) > (rand() % CONFIG_ASYNC_TCP_QUEUE_SIZE / 4 + CONFIG_ASYNC_TCP_QUEUE_SIZE * 3 / 4)) {
+  if (_async_events_waiting() > (rand() % CONFIG_ASYNC_TCP_QUEUE_SIZE / 4 + CONFIG_ASYNC_TCP_QUEUE_SIZE * 3 / 4)) {
     free(*e);
     *e = NULL;
     log_d("discarding poll due to queue congestion");
@@ -219,6 +382,9 @@ static bool _remove_events_with_arg(void* arg) {
     return false;
   }
 
+  _fifo_extract(&_staged_events[ASYNC_PRIORITY_NORMAL], arg, NULL);
+  _fifo_extract(&_staged_events[ASYNC_PRIORITY_HIGH], arg, NULL);
+
   lwip_event_packet_t* first_packet = NULL;
   lwip_event_packet_t* packet = NULL;
 
@@ -228,7 +394,7 @@ static bool _remove_events_with_arg(void* arg) {
       return false;
     }
     // discard packet if matching
-    if ((int)first_packet->arg == (int)arg) {
+    if (first_packet->arg == arg) {
       free(first_packet);
       first_packet = NULL;
     } else if (xQueueSend(_async_queue, &first_packet, 0) != pdPASS) {
@@ -245,7 +411,7 @@ static bool _remove_events_with_arg(void* arg) {
     if (xQueueReceive(_async_queue, &packet, 0) != pdPASS) {
       return false;
     }
-    if ((int)packet->arg == (int)arg) {
+    if (packet->arg == arg) {
       // remove matching event
       free(packet);
       packet = NULL;
@@ -269,7 +435,7 @@ static void _handle_async_event(lwip_event_packet_t* e) {
     _remove_events_with_arg(e->arg);
   } else if (e->event == LWIP_TCP_RECV) {
     // ets_printf("-R: 0x%08x\n", e->recv.pcb);
-    AsyncClient::_s_recv(e->arg, e->recv.pcb, e->recv.pb, e->recv.err);
+    AsyncClient::_s_recv(e->arg, e->recv.pcb, e->recv.pb, e->recv.err, e->recv.stamp);
   } else if (e->event == LWIP_TCP_FIN) {
     // ets_printf("-F: 0x%08x\n", e->fin.pcb);
     AsyncClient::_s_fin(e->arg, e->fin.pcb, e->fin.err);
@@ -291,6 +457,12 @@ static void _handle_async_event(lwip_event_packet_t* e) {
   } else if (e->event == LWIP_TCP_DNS) {
     // ets_printf("D: 0x%08x %s = %s\n", e->arg, e->dns.name, ipaddr_ntoa(&e->dns.addr));
     AsyncClient::_s_dns_found(e->dns.name, &e->dns.addr, e->arg);
+#ifndef LIBRETINY
+  } else if (e->event == LWIP_UDP_RECV) {
+    AsyncUDPSocket::_s_packet(e->arg, e->udp.pb, &e->udp.addr, e->udp.port);
+  } else if (e->event == LWIP_UDP_TIMER) {
+    AsyncUDPSocket::_s_timeout(e->arg);
+#endif
   }
   free((void*)(e));
 }
@@ -362,10 +534,20 @@ static bool _start_async_task() {
  * */
 
 static int8_t _tcp_clear_events(void* arg) {
+  // From a callback, nothing staged or queued for arg may be handled once this returns
+  if (xTaskGetCurrentTaskHandle() == _async_service_task_handle) {
+    _remove_events_with_arg(arg);
+    return ERR_OK;
+  }
+  // From another task, the service task drops them before it hands out its next event
+  if (!_async_clear_queue || xQueueSend(_async_clear_queue, &arg, portMAX_DELAY) != pdPASS) {
+    return ERR_OK;
+  }
+  // and is woken up in case it waits on an empty queue, a full one wakes it anyway
   lwip_event_packet_t* e = (lwip_event_packet_t*)malloc(sizeof(lwip_event_packet_t));
   e->event = LWIP_TCP_CLEAR;
-  e->arg = arg;
-  if (!_prepend_async_event(&e)) {
+  e->arg = NULL;
+  if (!_prepend_async_event(&e, 0)) {
     free((void*)(e));
   }
   return ERR_OK;
@@ -378,7 +560,7 @@ static int8_t _tcp_connected(void* arg, tcp_pcb* pcb, int8_t err) {
   e->arg = arg;
   e->connected.pcb = pcb;
   e->connected.err = err;
-  if (!_prepend_async_event(&e)) {
+  if (!_prepend_async_event(&e, portMAX_DELAY, _client_priority(arg))) {
     free((void*)(e));
   }
   return ERR_OK;
@@ -387,7 +569,7 @@ static int8_t _tcp_connected(void* arg, tcp_pcb* pcb, int8_t err) {
 static int8_t _tcp_poll(void* arg, struct tcp_pcb* pcb) {
   // throttle polling events queing when event queue is getting filled up, let it handle _onack's
   // log_d("qs:%u", uxQueueMessagesWaiting(_async_queue));
-  if (uxQueueMessagesWaiting(_async_queue) > (rand() % CONFIG_ASYNC_TCP_QUEUE_SIZE / 2 + CONFIG_ASYNC_TCP_QUEUE_SIZE / 4)) {
+  if (_async_events_waiting() > (rand() % CONFIG_ASYNC_TCP_QUEUE_SIZE / 2 + CONFIG_ASYNC_TCP_QUEUE_SIZE / 4)) {
     log_d("throttling");
     return ERR_OK;
   }
@@ -398,7 +580,7 @@ static int8_t _tcp_poll(void* arg, struct tcp_pcb* pcb) {
   e->arg = arg;
   e->poll.pcb = pcb;
   // poll events are not critical 'cause those are repetitive, so we may not wait the queue in any case
-  if (!_send_async_event(&e, 0)) {
+  if (!_send_async_event(&e, 0, _client_priority(arg))) {
     free((void*)(e));
   }
   return ERR_OK;
@@ -413,6 +595,7 @@ static int8_t _tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* pb, int8_t
     e->recv.pcb = pcb;
     e->recv.pb = pb;
     e->recv.err = err;
+    e->recv.stamp = micros();
   } else {
     // ets_printf("+F: 0x%08x\n", pcb);
     e->event = LWIP_TCP_FIN;
@@ -421,7 +604,7 @@ static int8_t _tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* pb, int8_t
     // close the PCB in LwIP thread
     AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
   }
-  if (!_send_async_event(&e)) {
+  if (!_send_async_event(&e, portMAX_DELAY, _client_priority(arg))) {
     free((void*)(e));
   }
   return ERR_OK;
@@ -434,7 +617,7 @@ static int8_t _tcp_sent(void* arg, struct tcp_pcb* pcb, uint16_t len) {
   e->arg = arg;
   e->sent.pcb = pcb;
   e->sent.len = len;
-  if (!_send_async_event(&e)) {
+  if (!_send_async_event(&e, portMAX_DELAY, _client_priority(arg))) {
     free((void*)(e));
   }
   return ERR_OK;
@@ -446,12 +629,108 @@ static void _tcp_error(void* arg, int8_t err) {
   e->event = LWIP_TCP_ERROR;
   e->arg = arg;
   e->error.err = err;
-  if (!_send_async_event(&e)) {
+  if (!_send_async_event(&e, portMAX_DELAY, _client_priority(arg))) {
     free((void*)(e));
   }
 }
 
+#ifndef LIBRETINY
+/*
+  DNS cache, filled from the lwIP resolver callbacks (tcpip thread) and read by
+  connect(host) and AsyncDNSCache::resolve() from any task
+ */
+
+#if CONFIG_ASYNC_TCP_DNS_CACHE_SIZE < 1
+  #error "CONFIG_ASYNC_TCP_DNS_CACHE_SIZE must be at least 1"
+#endif
+
+typedef struct {
+    char name[CONFIG_ASYNC_TCP_DNS_NAME_LENGTH + 1];
+    ip_addr_t addr;
+    bool found;
+    uint32_t stored;
+    uint32_t ttl;
+} dns_cache_entry_t;
+
+static dns_cache_entry_t _dns_cache[CONFIG_ASYNC_TCP_DNS_CACHE_SIZE];
+static AsyncDNSCacheStats _dns_stats;
+static portMUX_TYPE _dns_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 1: address in addr, -1: cached failure, 0: unknown or expired
+static int8_t _dns_cache_find(const char* name, ip_addr_t* addr, bool count) {
+  int8_t result = 0;
+  uint32_t now = millis();
+  portENTER_CRITICAL(&_dns_lock);
+  for (int i = 0; i < CONFIG_ASYNC_TCP_DNS_CACHE_SIZE; i++) {
+    dns_cache_entry_t* entry = &_dns_cache[i];
+    if (!entry->name[0] || now - entry->stored >= entry->ttl || strcasecmp(entry->name, name) != 0) {
+      continue;
+    }
+    if (entry->found) {
+      *addr = entry->addr;
+      result = 1;
+    } else {
+      result = -1;
+    }
+    break;
+  }
+  if (count) {
+    if (result > 0) {
+      _dns_stats.hits++;
+    } else if (result < 0) {
+      _dns_stats.negativeHits++;
+    } else {
+      _dns_stats.misses++;
+    }
+  }
+  portEXIT_CRITICAL(&_dns_lock);
+  return result;
+}
+
+// ipaddr NULL stores a failure. A full table drops the entry closest to expiring
+static void _dns_cache_store(const char* name, const ip_addr_t* ipaddr) {
+  if (!name || strlen(name) > CONFIG_ASYNC_TCP_DNS_NAME_LENGTH) {
+    return;
+  }
+  uint32_t now = millis();
+  portENTER_CRITICAL(&_dns_lock);
+  int slot = 0;
+  int32_t shortest = INT32_MAX;
+  for (int i = 0; i < CONFIG_ASYNC_TCP_DNS_CACHE_SIZE; i++) {
+    dns_cache_entry_t* entry = &_dns_cache[i];
+    if (entry->name[0] && strcasecmp(entry->name, name) == 0) {
+      slot = i;
+      break;
+    }
+    int32_t left = entry->name[0] ? (int32_t)(entry->ttl - (now - entry->stored)) : INT32_MIN;
+    if (left < shortest) {
+      shortest = left;
+      slot = i;
+    }
+  }
+  dns_cache_entry_t* entry = &_dns_cache[slot];
+  strlcpy(entry->name, name, sizeof(entry->name));
+  entry->found = ipaddr != NULL;
+  if (ipaddr) {
+    entry->addr = *ipaddr;
+  } else {
+    _dns_stats.failures++;
+  }
+  entry->stored = now;
+  entry->ttl = ipaddr ? CONFIG_ASYNC_TCP_DNS_TTL : CONFIG_ASYNC_TCP_DNS_NEGATIVE_TTL;
+  portEXIT_CRITICAL(&_dns_lock);
+}
+
+// resolve() only waits for the cache to be filled
+static void _tcp_dns_cached(const char* name, struct ip_addr* ipaddr, void* arg) {
+  _dns_cache_store(name, ipaddr);
+}
+#endif
+
 static void _tcp_dns_found(const char* name, struct ip_addr* ipaddr, void* arg) {
+#ifndef LIBRETINY
+  _dns_cache_store(name, ipaddr);
+#endif
   lwip_event_packet_t* e = (lwip_event_packet_t*)malloc(sizeof(lwip_event_packet_t));
   // ets_printf("+DNS: name=%s ipaddr=0x%08x arg=%x\n", name, ipaddr, arg);
   e->event = LWIP_TCP_DNS;
@@ -484,6 +763,7 @@ static int8_t _tcp_accept(void* arg, AsyncClient* client) {
  * */
 
 #include "lwip/priv/tcpip_priv.h"
+#include "lwip/priv/tcp_priv.h"
 
 typedef struct {
     struct tcpip_api_call_data call;
@@ -496,6 +776,14 @@ typedef struct {
             size_t size;
             uint8_t apiflags;
         } write;
+        struct {
+            const char* head;
+            size_t head_size;
+            const char* body;
+            size_t body_size;
+            uint8_t apiflags;
+            uint16_t segments;
+        } gather;
         size_t received;
         struct {
             ip_addr_t* addr;
@@ -553,6 +841,78 @@ static esp_err_t _tcp_write(tcp_pcb* pcb, int8_t closed_slot, const char* data,
   return msg.err;
 }
 
+// Unsent segments of a pcb, and the last one
+static uint16_t _tcp_unsent_segments(tcp_pcb* pcb, struct tcp_seg** last) {
+  uint16_t count = 0;
+  *last = NULL;
+  for (struct tcp_seg* seg = pcb->unsent; seg != NULL; seg = seg->next) {
+    *last = seg;
+    count++;
+  }
+  return count;
+}
+
+// Worst case pbufs tcp_write() chains for size bytes: one per segment when
+// copying, a header pbuf plus a reference pbuf per segment otherwise
+static uint16_t _tcp_write_pbufs(tcp_pcb* pcb, size_t size, uint8_t apiflags) {
+  uint16_t mss = tcp_mss(pcb) ? tcp_mss(pcb) : TCP_MSS;
+  uint16_t segments = size / mss + 1;
+  return (apiflags & TCP_WRITE_FLAG_COPY) ? segments : 2 * segments;
+}
+
+// head + body + output in a single call into the lwIP thread. Both parts
+// are checked against the send buffer and the segment queue before anything
+// is written, so a response is never left half queued.
+static err_t _tcp_write_gather_api(struct tcpip_api_call_data* api_call_msg) {
+  tcp_api_call_t* msg = (tcp_api_call_t*)api_call_msg;
+  msg->err = ERR_CONN;
+  msg->gather.segments = 0;
+  if (msg->closed_slot == INVALID_CLOSED_SLOT || !_closed_slots[msg->closed_slot]) {
+    size_t pbufs = _tcp_write_pbufs(msg->pcb, msg->gather.head_size, TCP_WRITE_FLAG_COPY);
+    if (msg->gather.body_size) {
+      pbufs += _tcp_write_pbufs(msg->pcb, msg->gather.body_size, msg->gather.apiflags);
+    }
+    if (tcp_sndbuf(msg->pcb) < msg->gather.head_size + msg->gather.body_size || tcp_sndqueuelen(msg->pcb) + pbufs > TCP_SND_QUEUELEN) {
+      msg->err = ERR_MEM;
+      return msg->err;
+    }
+
+    struct tcp_seg* last;
+    uint16_t before = _tcp_unsent_segments(msg->pcb, &last);
+    uint16_t last_len = last ? last->len : 0;
+
+    msg->err = tcp_write(msg->pcb, msg->gather.head, msg->gather.head_size, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+    if (msg->err == ERR_OK && msg->gather.body_size) {
+      msg->err = tcp_write(msg->pcb, msg->gather.body, msg->gather.body_size, msg->gather.apiflags);
+    }
+    if (msg->err == ERR_OK) {
+      // New segments, plus the queued one the data was appended to, if any
+      struct tcp_seg* grown = last;
+      msg->gather.segments = _tcp_unsent_segments(msg->pcb, &last) - before + ((grown && grown->len != last_len) ? 1 : 0);
+      msg->err = tcp_output(msg->pcb);
+    }
+  }
+  return msg->err;
+}
+
+static esp_err_t _tcp_write_gather(tcp_pcb* pcb, int8_t closed_slot, const char* head, size_t head_size, const char* body, size_t body_size, uint8_t apiflags, uint16_t* segments) {
+  *segments = 0;
+  if (!pcb) {
+    return ERR_CONN;
+  }
+  tcp_api_call_t msg;
+  msg.pcb = pcb;
+  msg.closed_slot = closed_slot;
+  msg.gather.head = head;
+  msg.gather.head_size = head_size;
+  msg.gather.body = body;
+  msg.gather.body_size = body_size;
+  msg.gather.apiflags = apiflags;
+  tcpip_api_call(_tcp_write_gather_api, (struct tcpip_api_call_data*)&msg);
+  *segments = msg.gather.segments;
+  return msg.err;
+}
+
 static err_t _tcp_recved_api(struct tcpip_api_call_data* api_call_msg) {
   tcp_api_call_t* msg = (tcp_api_call_t*)api_call_msg;
   msg->err = ERR_CONN;
@@ -680,7 +1040,7 @@ static tcp_pcb* _tcp_listen_with_backlog(tcp_pcb* pcb, uint8_t backlog) {
  */
 
 AsyncClient::AsyncClient(tcp_pcb* pcb)
-    : _connect_cb(0), _connect_cb_arg(0), _discard_cb(0), _discard_cb_arg(0), _sent_cb(0), _sent_cb_arg(0), _error_cb(0), _error_cb_arg(0), _recv_cb(0), _recv_cb_arg(0), _pb_cb(0), _pb_cb_arg(0), _timeout_cb(0), _timeout_cb_arg(0), _ack_pcb(true), _tx_last_packet(0), _rx_timeout(0), _rx_last_ack(0), _ack_timeout(CONFIG_ASYNC_TCP_MAX_ACK_TIME), _connect_port(0), prev(NULL), next(NULL) {
+    : _connect_cb(0), _connect_cb_arg(0), _discard_cb(0), _discard_cb_arg(0), _sent_cb(0), _sent_cb_arg(0), _error_cb(0), _error_cb_arg(0), _recv_cb(0), _recv_cb_arg(0), _pb_cb(0), _pb_cb_arg(0), _timeout_cb(0), _timeout_cb_arg(0), _ack_pcb(true), _tx_last_packet(0), _rx_stamp(0), _tx_segments(0), _rx_timeout(0), _rx_last_ack(0), _ack_timeout(CONFIG_ASYNC_TCP_MAX_ACK_TIME), _connect_port(0), _priority(ASYNC_PRIORITY_NORMAL), prev(NULL), next(NULL) {
   _pcb = pcb;
   _closed_slot = INVALID_CLOSED_SLOT;
   if (_pcb) {
@@ -854,9 +1214,28 @@ bool AsyncClient::connect(const char* host, uint16_t port) {
     return false;
   }
 
-  TCP_MUTEX_LOCK();
-  err_t err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_found, this);
-  TCP_MUTEX_UNLOCK();
+  err_t err;
+#ifndef LIBRETINY
+  // literal addresses and fresh cache entries skip the resolver
+  int8_t cached = ipaddr_aton(host, &addr) ? 1 : _dns_cache_find(host, &addr, true);
+  if (cached < 0) {
+    log_d("cached DNS failure: %s", host);
+    return false;
+  }
+  if (cached > 0) {
+    err = ERR_OK;
+  } else
+#endif
+  {
+    TCP_MUTEX_LOCK();
+    err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_found, this);
+    TCP_MUTEX_UNLOCK();
+#ifndef LIBRETINY
+    if (err == ERR_OK) {
+      _dns_cache_store(host, &addr);
+    }
+#endif
+  }
   if (err == ERR_OK) {
 #if ESP_IDF_VERSION_MAJOR < 5
   #if LWIP_IPV6
@@ -1078,7 +1457,8 @@ int8_t AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
   return ERR_OK;
 }
 
-int8_t AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err) {
+int8_t AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err, uint32_t stamp) {
+  _rx_stamp = stamp;
   while (pb != NULL) {
     _rx_last_packet = millis();
     // we should not ack before we assimilate the data
@@ -1185,6 +1565,23 @@ size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
   return will_send;
 }
 
+size_t AsyncClient::write(const char* head, size_t head_size, const char* body, size_t body_size, uint8_t apiflags) {
+  _tx_segments = 0;
+  if (!_pcb || head == NULL || head_size == 0 || (body_size && body == NULL)) {
+    return 0;
+  }
+  if (space() < head_size + body_size) {
+    return 0;
+  }
+  auto backup = _tx_last_packet;
+  _tx_last_packet = millis();
+  if (_tcp_write_gather(_pcb, _closed_slot, head, head_size, body, body_size, apiflags & ~ASYNC_WRITE_FLAG_MORE, &_tx_segments) != ERR_OK) {
+    _tx_last_packet = backup;
+    return 0;
+  }
+  return head_size + body_size;
+}
+
 void AsyncClient::setRxTimeout(uint32_t timeout) {
   _rx_timeout = timeout;
 }
@@ -1219,6 +1616,30 @@ bool AsyncClient::getNoDelay() {
   return tcp_nagle_disabled(_pcb);
 }
 
+AsyncQueueStats AsyncClient::getQueueStats() {
+  AsyncQueueStats stats;
+  for (int i = 0; i < 2; i++) {
+    stats.events[i] = _queue_events[i];
+    stats.waitAvg[i] = _queue_events[i] ? _queue_wait_total[i] / _queue_events[i] : 0;
+    stats.waitMax[i] = _queue_wait_max[i];
+  }
+  stats.forced = _queue_forced;
+  return stats;
+}
+
+void AsyncClient::setPriority(uint8_t priority) {
+  priority = priority ? ASYNC_PRIORITY_HIGH : ASYNC_PRIORITY_NORMAL;
+  if (priority == _priority) {
+    return;
+  }
+  // staged events belong to the service task, from elsewhere only new events change class
+  // (staging still keeps them behind the older ones)
+  if (xTaskGetCurrentTaskHandle() == _async_service_task_handle) {
+    _fifo_extract(&_staged_events[_priority], this, &_staged_events[priority]);
+  }
+  _priority = priority;
+}
+
 void AsyncClient::setKeepAlive(uint32_t ms, uint8_t cnt) {
   if (ms != 0) {
     _pcb->so_options |= SOF_KEEPALIVE; // Turn on TCP Keepalive for the given pcb
@@ -1483,8 +1904,8 @@ int8_t AsyncClient::_s_poll(void* arg, struct tcp_pcb* pcb) {
   return reinterpret_cast<AsyncClient*>(arg)->_poll(pcb);
 }
 
-int8_t AsyncClient::_s_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* pb, int8_t err) {
-  return reinterpret_cast<AsyncClient*>(arg)->_recv(pcb, pb, err);
+int8_t AsyncClient::_s_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* pb, int8_t err, uint32_t stamp) {
+  return reinterpret_cast<AsyncClient*>(arg)->_recv(pcb, pb, err, stamp);
 }
 
 int8_t AsyncClient::_s_fin(void* arg, struct tcp_pcb* pcb, int8_t err) {
@@ -1659,3 +2080,291 @@ int8_t AsyncServer::_s_accept(void* arg, tcp_pcb* pcb, int8_t err) {
 int8_t AsyncServer::_s_accepted(void* arg, AsyncClient* client) {
   return reinterpret_cast<AsyncServer*>(arg)->_accepted(client);
 }
+
+
+#ifndef LIBRETINY
+/*
+  Async UDP Socket
+ */
+
+typedef struct {
+    struct tcpip_api_call_data call;
+    udp_pcb* pcb;
+    int8_t err;
+    void* arg;
+    const ip_addr_t* addr;
+    uint16_t port;
+    pbuf* pb;
+} udp_api_call_t;
+
+static err_t _udp_listen_api(struct tcpip_api_call_data* api_call_msg) {
+  udp_api_call_t* msg = (udp_api_call_t*)api_call_msg;
+  msg->err = ERR_MEM;
+  msg->pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+  if (!msg->pcb) {
+    return msg->err;
+  }
+  ip_set_option(msg->pcb, SOF_REUSEADDR);
+  msg->err = udp_bind(msg->pcb, IP4_ADDR_ANY, msg->port);
+  if (msg->err == ERR_OK) {
+    msg->err = igmp_joingroup(IP4_ADDR_ANY4, ip_2_ip4(msg->addr));
+  }
+  if (msg->err != ERR_OK) {
+    udp_remove(msg->pcb);
+    msg->pcb = NULL;
+    return msg->err;
+  }
+  udp_recv(msg->pcb, &AsyncUDPSocket::_s_recv, msg->arg);
+  return msg->err;
+}
+
+static err_t _udp_close_api(struct tcpip_api_call_data* api_call_msg) {
+  udp_api_call_t* msg = (udp_api_call_t*)api_call_msg;
+  udp_recv(msg->pcb, NULL, NULL);
+  igmp_leavegroup(IP4_ADDR_ANY4, ip_2_ip4(msg->addr));
+  udp_remove(msg->pcb);
+  msg->err = ERR_OK;
+  return msg->err;
+}
+
+static err_t _udp_sendto_api(struct tcpip_api_call_data* api_call_msg) {
+  udp_api_call_t* msg = (udp_api_call_t*)api_call_msg;
+  msg->err = udp_sendto(msg->pcb, msg->pb, msg->addr, msg->port);
+  return msg->err;
+}
+
+// esp_timer task, hop over to the async task
+void AsyncUDPSocket::_s_timer(void* arg) {
+  lwip_event_packet_t* e = (lwip_event_packet_t*)malloc(sizeof(lwip_event_packet_t));
+  if (e) {
+    e->event = LWIP_UDP_TIMER;
+    e->arg = arg;
+    if (_send_async_event(&e, 0)) {
+      return;
+    }
+    free((void*)(e));
+  }
+  // queue full, try again shortly rather than lose the timeout. A setTimer()
+  // that got in first keeps its own deadline, starting an armed timer fails.
+  esp_timer_start_once((esp_timer_handle_t)reinterpret_cast<AsyncUDPSocket*>(arg)->_timer, (uint64_t)CONFIG_ASYNC_UDP_TIMER_RETRY * 1000);
+}
+
+AsyncUDPSocket::AsyncUDPSocket() : _pcb(NULL), _timer(NULL), _packet_cb(0), _packet_cb_arg(0), _timer_cb(0), _timer_cb_arg(0) {}
+
+AsyncUDPSocket::~AsyncUDPSocket() {
+  close();
+  if (_timer) {
+    esp_timer_delete((esp_timer_handle_t)_timer);
+  }
+}
+
+bool AsyncUDPSocket::listenMulticast(const IPAddress& group, uint16_t port) {
+  if (_pcb) {
+    return true;
+  }
+  if (!_start_async_task()) {
+    log_e("failed to start task");
+    return false;
+  }
+#if ESP_IDF_VERSION_MAJOR < 5
+  _group.u_addr.ip4.addr = group;
+  _group.type = IPADDR_TYPE_V4;
+#else
+  group.to_ip_addr_t(&_group);
+#endif
+  udp_api_call_t msg;
+  msg.arg = this;
+  msg.addr = &_group;
+  msg.port = port;
+  tcpip_api_call(_udp_listen_api, (struct tcpip_api_call_data*)&msg);
+  if (msg.err != ERR_OK) {
+    log_e("multicast listen error: %d", msg.err);
+    return false;
+  }
+  _pcb = msg.pcb;
+  return true;
+}
+
+void AsyncUDPSocket::close() {
+  setTimer(0);
+  if (_pcb) {
+    udp_api_call_t msg;
+    msg.pcb = _pcb;
+    msg.addr = &_group;
+    _pcb = NULL;
+    tcpip_api_call(_udp_close_api, (struct tcpip_api_call_data*)&msg);
+  }
+}
+
+size_t AsyncUDPSocket::writeTo(const uint8_t* data, size_t len, const IPAddress& ip, uint16_t port) {
+  if (!_pcb) {
+    return 0;
+  }
+  pbuf* pb = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+  if (!pb) {
+    return 0;
+  }
+  memcpy(pb->payload, data, len);
+  ip_addr_t addr;
+#if ESP_IDF_VERSION_MAJOR < 5
+  addr.u_addr.ip4.addr = ip;
+  addr.type = IPADDR_TYPE_V4;
+#else
+  ip.to_ip_addr_t(&addr);
+#endif
+  udp_api_call_t msg;
+  msg.pcb = _pcb;
+  msg.pb = pb;
+  msg.addr = &addr;
+  msg.port = port;
+  tcpip_api_call(_udp_sendto_api, (struct tcpip_api_call_data*)&msg);
+  pbuf_free(pb);
+  return msg.err == ERR_OK ? len : 0;
+}
+
+void AsyncUDPSocket::onPacket(AcUdpPacketHandler cb, void* arg) {
+  _packet_cb = cb;
+  _packet_cb_arg = arg;
+}
+
+void AsyncUDPSocket::onTimer(AcUdpTimerHandler cb, void* arg) {
+  _timer_cb = cb;
+  _timer_cb_arg = arg;
+}
+
+bool AsyncUDPSocket::setTimer(uint32_t ms) {
+  if (!_timer) {
+    if (!ms) {
+      return true;
+    }
+    esp_timer_create_args_t args = {};
+    args.callback = &AsyncUDPSocket::_s_timer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "async_udp";
+    esp_timer_handle_t timer;
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+      return false;
+    }
+    _timer = timer;
+  }
+  esp_timer_stop((esp_timer_handle_t)_timer);
+  if (!ms) {
+    return true;
+  }
+  return esp_timer_start_once((esp_timer_handle_t)_timer, (uint64_t)ms * 1000) == ESP_OK;
+}
+
+// runs on LwIP thread
+void AsyncUDPSocket::_s_recv(void* arg, udp_pcb* pcb, struct pbuf* pb, const ip_addr_t* addr, uint16_t port) {
+  lwip_event_packet_t* e = (lwip_event_packet_t*)malloc(sizeof(lwip_event_packet_t));
+  if (!e) {
+    pbuf_free(pb);
+    return;
+  }
+  e->event = LWIP_UDP_RECV;
+  e->arg = arg;
+  e->udp.pb = pb;
+  memcpy(&e->udp.addr, addr, sizeof(ip_addr_t));
+  e->udp.port = port;
+  // datagrams may be dropped, never stall the LwIP thread
+  if (!_send_async_event(&e, 0)) {
+    pbuf_free(pb);
+    free((void*)(e));
+  }
+}
+
+void AsyncUDPSocket::_s_packet(void* arg, struct pbuf* pb, const ip_addr_t* addr, uint16_t port) {
+  reinterpret_cast<AsyncUDPSocket*>(arg)->_packet(pb, addr, port);
+}
+
+void AsyncUDPSocket::_s_timeout(void* arg) {
+  AsyncUDPSocket* socket = reinterpret_cast<AsyncUDPSocket*>(arg);
+  if (socket->_pcb && socket->_timer_cb) {
+    socket->_timer_cb(socket->_timer_cb_arg, socket);
+  }
+}
+
+void AsyncUDPSocket::_packet(struct pbuf* pb, const ip_addr_t* addr, uint16_t port) {
+  if (_pcb && _packet_cb) {
+    IPAddress ip;
+#if ESP_IDF_VERSION_MAJOR < 5
+    ip = IPAddress(addr->u_addr.ip4.addr);
+#else
+    ip.from_ip_addr_t(addr);
+#endif
+    if (!pb->next) {
+      _packet_cb(_packet_cb_arg, this, ip, port, (const uint8_t*)pb->payload, pb->len);
+    } else {
+      // chained pbuf, hand out one contiguous copy
+      uint8_t* data = (uint8_t*)malloc(pb->tot_len);
+      if (data) {
+        pbuf_copy_partial(pb, data, pb->tot_len, 0);
+        _packet_cb(_packet_cb_arg, this, ip, port, data, pb->tot_len);
+        free(data);
+      }
+    }
+  }
+  pbuf_free(pb);
+}
+
+/*
+  Async DNS Cache
+ */
+
+bool AsyncDNSCache::resolve(const char* host, IPAddress& ip, uint32_t timeout) {
+  ip_addr_t addr;
+  int8_t cached = ipaddr_aton(host, &addr) ? 1 : _dns_cache_find(host, &addr, true);
+  if (cached == 0) {
+    TCP_MUTEX_LOCK();
+    err_t err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_cached, NULL);
+    TCP_MUTEX_UNLOCK();
+    if (err == ERR_OK) {
+      _dns_cache_store(host, &addr);
+      cached = 1;
+    } else if (err == ERR_INPROGRESS) {
+      // the callback stores the answer, failures too
+      uint32_t start = millis();
+      while (cached == 0 && millis() - start < timeout) {
+        delay(10);
+        cached = _dns_cache_find(host, &addr, false);
+      }
+    }
+  }
+  if (cached <= 0) {
+    return false;
+  }
+
+#if ESP_IDF_VERSION_MAJOR < 5
+  if (!IP_IS_V4(&addr)) {
+    return false;
+  }
+  ip = IPAddress(ip_addr_get_ip4_u32(&addr));
+#else
+  ip.from_ip_addr_t(&addr);
+#endif
+  return true;
+}
+
+AsyncDNSCacheStats AsyncDNSCache::stats() {
+  uint32_t now = millis();
+  portENTER_CRITICAL(&_dns_lock);
+  AsyncDNSCacheStats stats = _dns_stats;
+  stats.entries = 0;
+  for (int i = 0; i < CONFIG_ASYNC_TCP_DNS_CACHE_SIZE; i++) {
+    if (_dns_cache[i].name[0] && now - _dns_cache[i].stored < _dns_cache[i].ttl) {
+      stats.entries++;
+    }
+  }
+  portEXIT_CRITICAL(&_dns_lock);
+  return stats;
+}
+
+void AsyncDNSCache::clear() {
+  portENTER_CRITICAL(&_dns_lock);
+  for (int i = 0; i < CONFIG_ASYNC_TCP_DNS_CACHE_SIZE; i++) {
+    _dns_cache[i].name[0] = 0;
+  }
+  portEXIT_CRITICAL(&_dns_lock);
+}
+#endif
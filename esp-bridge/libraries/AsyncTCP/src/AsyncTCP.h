@@ -76,11 +76,49 @@ extern "C" {
   #define CONFIG_ASYNC_TCP_MAX_ACK_TIME 5000
 #endif
 
+// high priority events handled in a row before a waiting normal one, see AsyncClient::setPriority
+#ifndef CONFIG_ASYNC_TCP_PRIORITY_BURST
+  #define CONFIG_ASYNC_TCP_PRIORITY_BURST 8
+#endif
+
+// retry delay of a UDP timer whose event did not fit the queue
+#ifndef CONFIG_ASYNC_UDP_TIMER_RETRY
+  #define CONFIG_ASYNC_UDP_TIMER_RETRY 10 // ms
+#endif
+
+// resolver cache shared by outbound clients, see AsyncDNSCache
+#ifndef CONFIG_ASYNC_TCP_DNS_CACHE_SIZE
+  #define CONFIG_ASYNC_TCP_DNS_CACHE_SIZE 8
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_DNS_NAME_LENGTH
+  #define CONFIG_ASYNC_TCP_DNS_NAME_LENGTH 63 // longer names bypass the cache
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_DNS_TTL
+  #define CONFIG_ASYNC_TCP_DNS_TTL 300000 // ms
+#endif
+
+#ifndef CONFIG_ASYNC_TCP_DNS_NEGATIVE_TTL
+  #define CONFIG_ASYNC_TCP_DNS_NEGATIVE_TTL 10000 // ms
+#endif
+
 class AsyncClient;
 
 #define ASYNC_WRITE_FLAG_COPY 0x01 // will allocate new buffer to hold the data while sending (else will hold reference to the data given)
 #define ASYNC_WRITE_FLAG_MORE 0x02 // will not send PSH flag, meaning that there should be more data to be sent before the application should react.
 
+#define ASYNC_PRIORITY_NORMAL 0
+#define ASYNC_PRIORITY_HIGH   1 // events of these connections are handled before normal ones
+
+// Time events spend between the lwIP callback and their handler, per priority class
+typedef struct {
+    uint32_t events[2];  // handed out since boot
+    uint32_t waitAvg[2]; // us
+    uint32_t waitMax[2]; // us
+    uint32_t forced;     // normal events let through after a full high burst
+} AsyncQueueStats;
+
 typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
 typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
 typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
@@ -90,6 +128,7 @@ typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler
 
 struct tcp_pcb;
 struct ip_addr;
+struct udp_pcb;
 
 class AsyncClient {
   public:
@@ -171,6 +210,23 @@ class AsyncClient {
      */
     size_t write(const char* data) { return data == NULL ? 0 : write(data, strlen(data)); };
 
+    /**
+     * @brief queue a header and a body and send them, all in one call into the lwIP thread
+     * @note the header is always copied, the body follows apiflags: without ASYNC_WRITE_FLAG_COPY
+        it is passed by reference and must stay valid until acked (constant strings), lwIP builds
+        with LWIP_NETIF_TX_SINGLE_PBUF still copy it when the segment is built
+     * @note all or nothing: if header and body do not both fit in the send buffer and the
+        segment queue nothing is queued
+     *
+     * @param head
+     * @param head_size
+     * @param body
+     * @param body_size
+     * @param apiflags flags for the body, ASYNC_WRITE_FLAG_MORE is ignored
+     * @return size_t head_size + body_size, 0 on error
+     */
+    size_t write(const char* head, size_t head_size, const char* body, size_t body_size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
     uint8_t state();
     bool connecting();
     bool connected();
@@ -183,6 +239,10 @@ class AsyncClient {
     uint16_t getMss();
 
     uint32_t getRxTimeout();
+    // micros() when lwIP handed over the data being delivered to onData, before it queued for the async task
+    uint32_t getRxStamp() { return _rx_stamp; }
+    // TCP segments the last write(head, head_size, body, body_size) queued, 0 if it failed
+    uint16_t getTxSegments() { return _tx_segments; }
     // no RX data timeout for the connection in seconds
     void setRxTimeout(uint32_t timeout);
 
@@ -193,6 +253,14 @@ class AsyncClient {
     void setNoDelay(bool nodelay);
     bool getNoDelay();
 
+    // event priority class, ASYNC_PRIORITY_NORMAL or ASYNC_PRIORITY_HIGH. Events already waiting
+    // move along when called from the connection's callbacks (async_tcp task), otherwise
+    // the change applies from the next event lwIP queues. Order per connection is kept either way
+    void setPriority(uint8_t priority);
+    uint8_t getPriority() const { return _priority; }
+    // queue wait per class, shared by all clients. Read without locking, may be one event off
+    static AsyncQueueStats getQueueStats();
+
     void setKeepAlive(uint32_t ms, uint8_t cnt);
 
     uint32_t getRemoteAddress();
@@ -246,7 +314,7 @@ class AsyncClient {
 
     // internal callbacks - Do NOT call any of the functions below in user code!
     static int8_t _s_poll(void* arg, struct tcp_pcb* tpcb);
-    static int8_t _s_recv(void* arg, struct tcp_pcb* tpcb, struct pbuf* pb, int8_t err);
+    static int8_t _s_recv(void* arg, struct tcp_pcb* tpcb, struct pbuf* pb, int8_t err, uint32_t stamp);
     static int8_t _s_fin(void* arg, struct tcp_pcb* tpcb, int8_t err);
     static int8_t _s_lwip_fin(void* arg, struct tcp_pcb* tpcb, int8_t err);
     static void _s_error(void* arg, int8_t err);
@@ -254,7 +322,7 @@ class AsyncClient {
     static int8_t _s_connected(void* arg, struct tcp_pcb* tpcb, int8_t err);
     static void _s_dns_found(const char* name, struct ip_addr* ipaddr, void* arg);
 
-    int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err);
+    int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err, uint32_t stamp);
     tcp_pcb* pcb() { return _pcb; }
 
   protected:
@@ -284,10 +352,13 @@ class AsyncClient {
     uint32_t _tx_last_packet;
     uint32_t _rx_ack_len;
     uint32_t _rx_last_packet;
+    uint32_t _rx_stamp;
+    uint16_t _tx_segments;
     uint32_t _rx_timeout;
     uint32_t _rx_last_ack;
     uint32_t _ack_timeout;
     uint16_t _connect_port;
+    uint8_t _priority;
 
     int8_t _close();
     void _free_closed_slot();
@@ -341,4 +412,73 @@ class AsyncServer {
     int8_t _accepted(AsyncClient* client);
 };
 
+#ifndef LIBRETINY
+class AsyncUDPSocket;
+
+typedef std::function<void(void*, AsyncUDPSocket*, const IPAddress& ip, uint16_t port, const uint8_t* data, size_t len)> AcUdpPacketHandler;
+typedef std::function<void(void*, AsyncUDPSocket*)> AcUdpTimerHandler;
+
+/*
+  UDP socket whose packets and timer are delivered on the async_tcp task,
+  so UDP protocols (e.g. SSDP) share the TCP event loop instead of polling.
+  Like AsyncServer, it must outlive any traffic it receives.
+*/
+class AsyncUDPSocket {
+  public:
+    AsyncUDPSocket();
+    ~AsyncUDPSocket();
+
+    bool listenMulticast(const IPAddress& group, uint16_t port);
+    void close();
+    bool listening() {
+      return _pcb != NULL;
+    }
+    size_t writeTo(const uint8_t* data, size_t len, const IPAddress& ip, uint16_t port);
+
+    void onPacket(AcUdpPacketHandler cb, void* arg = 0);
+    void onTimer(AcUdpTimerHandler cb, void* arg = 0);
+    // one shot, calls onTimer on the async_tcp task after ms, 0 cancels
+    bool setTimer(uint32_t ms);
+
+    // Do not use any of the functions below!
+    static void _s_recv(void* arg, udp_pcb* pcb, struct pbuf* pb, const ip_addr_t* addr, uint16_t port);
+    static void _s_packet(void* arg, struct pbuf* pb, const ip_addr_t* addr, uint16_t port);
+    static void _s_timeout(void* arg);
+    static void _s_timer(void* arg);
+
+  protected:
+    udp_pcb* _pcb;
+    ip_addr_t _group;
+    void* _timer;
+    AcUdpPacketHandler _packet_cb;
+    void* _packet_cb_arg;
+    AcUdpTimerHandler _timer_cb;
+    void* _timer_cb_arg;
+
+    void _packet(struct pbuf* pb, const ip_addr_t* addr, uint16_t port);
+};
+
+typedef struct {
+    uint32_t hits;          // answered from the cache
+    uint32_t negativeHits;  // cached failures, answered without asking lwIP
+    uint32_t misses;        // sent to the lwIP resolver
+    uint32_t failures;      // resolver answers with no address
+    uint8_t entries;        // entries not yet expired
+} AsyncDNSCacheStats;
+
+/*
+  Resolved names shared by every outbound client: AsyncClient::connect(host)
+  and resolve() skip the resolver while an entry is fresh, failures included.
+  lwIP does not pass the record TTL to its callback, so addresses are kept
+  CONFIG_ASYNC_TCP_DNS_TTL ms and failures CONFIG_ASYNC_TCP_DNS_NEGATIVE_TTL ms.
+*/
+class AsyncDNSCache {
+  public:
+    // blocking lookup for synchronous clients (e.g. WiFiClient), waits up to timeout ms on a miss
+    static bool resolve(const char* host, IPAddress& ip, uint32_t timeout = 5000);
+    static AsyncDNSCacheStats stats();
+    static void clear();
+};
+#endif
+
 #endif /* ASYNCTCP_H_ */
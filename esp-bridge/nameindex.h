@@ -0,0 +1,162 @@
+/*
+
+FAUXMO ESP
+
+Copyright (C) 2018-2020 by Xose Pérez <xose dot perez at gmail dot com>
+
+The MIT License (MIT)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------
+// Device name index
+// Open addressing hash over the normalized name, so lookups are case, accent
+// and whitespace insensitive ("Luce Città" == "luce citta"). Names are not
+// stored, the owner resolves a slot value back to its name through nameOf()
+// to confirm a match. There is no single entry delete: owners clear() and
+// re-insert on remove or rename (at most CAPACITY entries).
+// -----------------------------------------------------------------------------
+
+template <int CAPACITY>
+class NameIndex {
+
+	public:
+
+		typedef const char * (*NameOf)(void * context, int value);
+
+		NameIndex(NameOf nameOf, void * context) : _count(0), _nameOf(nameOf), _context(context) {
+			clear();
+		}
+
+		static uint32_t hash(const char * name) {
+			// FNV-1a over the normalized name
+			uint32_t h = 2166136261u;
+			const char * p = name;
+			while (*p == ' ' || *p == '\t') p++;
+			for (char c = _next(p); c != 0; c = _next(p)) {
+				h = (h ^ (unsigned char) c) * 16777619u;
+			}
+			return h;
+		}
+
+		static bool equals(const char * a, const char * b) {
+			while (*a == ' ' || *a == '\t') a++;
+			while (*b == ' ' || *b == '\t') b++;
+			char ca, cb;
+			do {
+				ca = _next(a);
+				cb = _next(b);
+				if (ca != cb) return false;
+			} while (ca != 0);
+			return true;
+		}
+
+		void clear() {
+			for (int i = 0; i < SIZE; i++) {
+				_entries[i].value = -1;
+			}
+			_count = 0;
+		}
+
+		bool insert(const char * name, int value) {
+			if (_count >= CAPACITY || value < 0) return false;
+			uint32_t h = hash(name);
+			int i = h & (SIZE - 1);
+			while (_entries[i].value >= 0) {
+				i = (i + 1) & (SIZE - 1);
+			}
+			_entries[i].hash = h;
+			_entries[i].value = value;
+			_count++;
+			return true;
+		}
+
+		int find(const char * name) const {
+			if (NULL == name) return -1;
+			uint32_t h = hash(name);
+			int i = h & (SIZE - 1);
+			while (_entries[i].value >= 0) {
+				if (_entries[i].hash == h && equals(name, _nameOf(_context, _entries[i].value))) {
+					return _entries[i].value;
+				}
+				i = (i + 1) & (SIZE - 1);
+			}
+			return -1;
+		}
+
+		int size() const { return _count; }
+
+	private:
+
+		// Power of two, at least twice the capacity so probe runs stay short
+		static constexpr int _tableSize(int n, int size = 1) {
+			return size >= 2 * n ? size : _tableSize(n, size * 2);
+		}
+		static const int SIZE = _tableSize(CAPACITY);
+
+		typedef struct {
+			uint32_t hash;
+			int16_t value;          // -1 = empty
+		} entry_t;
+
+		entry_t _entries[SIZE];
+		int _count;
+		NameOf _nameOf;
+		void * _context;
+
+		// Next normalized character: lower case, Latin-1 accents (UTF-8) folded,
+		// leading/trailing blanks skipped and runs of blanks reduced to one.
+		// 0 at the end of the string.
+		static char _next(const char *& p) {
+			bool space = false;
+			while (*p == ' ' || *p == '\t') {
+				space = true;
+				p++;
+			}
+			if (*p == 0) return 0;
+			if (space) return ' ';
+
+			unsigned char c = *p++;
+			if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
+			if (c == 0xC3 && (unsigned char) *p >= 0x80 && (unsigned char) *p <= 0xBF) {
+				// U+00C0..U+00FF, upper case is lower case minus 0x20.
+				// U+00DF (sharp s) has no upper case form in this block
+				// and would alias U+00FF, so it is handled on its own.
+				// U+00D7/U+00F7 (multiply, divide) are not letters and
+				// are passed through unchanged, one byte at a time.
+				unsigned char d = (unsigned char) *p;
+				if ((d | 0x20) == 0xB7) return c;
+				p++;
+				if (d == 0x9F) return 's';
+				// U+00E0..U+00FF: à á â ã ä å æ ç è é ê ë ì í î ï
+				//                 ð ñ ò ó ô õ ö   ø ù ú û ü ý þ ÿ
+				static const char fold[] = "aaaaaaaceeeeiiiidnooooo-ouuuuyty";
+				return fold[(d | 0x20) - 0xA0];
+			}
+			return c;
+		}
+
+};
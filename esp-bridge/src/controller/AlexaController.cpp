@@ -1,11 +1,17 @@
 #include "AlexaController.h"
 
+// Ogni dispositivo deve trovare posto nella tabella fauxmo, nome compreso
+static_assert(SystemConfig::MAX_DEVICES <= FAUXMO_MAX_DEVICES, "tabella fauxmo più piccola di MAX_DEVICES");
+static_assert(SystemConfig::MAX_DEVICES * (SystemConfig::MAX_DEVICE_NAME_LENGTH + 1) <= FAUXMO_NAME_ARENA_SIZE,
+              "arena dei nomi fauxmo più piccola di MAX_DEVICES nomi lunghi MAX_DEVICE_NAME_LENGTH");
+
 // Static variables initialization
 volatile bool AlexaController::callbackSafe = false;
 AlexaController* AlexaController::safeInstance = nullptr;
 
 AlexaController::AlexaController(fauxmoESP* fauxmoInstance, DeviceController* devController, SerialController* serial)
-    : fauxmo(fauxmoInstance), deviceController(devController), serialController(serial), isInitialized(false) {
+    : fauxmo(fauxmoInstance), deviceController(devController), serialController(serial), isInitialized(false),
+      dispatcher(executeCommands, this), mappedDevices(0), multiPinSupport(MULTI_PIN_UNKNOWN) {
     config = SystemConfig::getInstance();
     safeInstance = this;
     callbackSafe = false;
@@ -25,9 +31,21 @@ bool AlexaController::initialize() {
     }
     
     disableCallbacks();
+    multiPinSupport = MULTI_PIN_UNKNOWN;
+    
+    if (!dispatcher.begin()) {
+        serialController->println("❌ Impossibile avviare la coda comandi Alexa");
+        return false;
+    }
+    if (!fanOut.begin()) {
+        serialController->println("⚠️ Chiamate parallele non disponibili, i gruppi vanno in sequenza");
+    }
     
     fauxmo->createServer(true);
     fauxmo->setPort(config->FAUXMO_PORT);
+    fauxmo->setBridges(config->FAUXMO_BRIDGES);
+    fauxmo->setMaxClients(config->FAUXMO_MAX_CLIENTS);
+    fauxmo->setKeepAlive(config->FAUXMO_KEEP_ALIVE, config->FAUXMO_KEEP_ALIVE_TIMEOUT, config->FAUXMO_KEEP_ALIVE_MAX_REQUESTS);
     fauxmo->enable(true);
     
     addDevices();
@@ -81,10 +99,26 @@ bool AlexaController::isCallbackSafe() const {
 }
 
 void AlexaController::addDevices() {
+    // Ripartendo da zero gli id fauxmo coincidono con l'ordine di DeviceController
+    fauxmo->removeAllDevices();
+    mappedDevices = 0;
+    portENTER_CRITICAL(&healthLock);
+    memset(health, 0, sizeof(health));
+    portEXIT_CRITICAL(&healthLock);
+    
     for (int i = 0; i < deviceController->getDeviceCount(); i++) {
         const Device& device = deviceController->getDevice(i);
         
         unsigned char deviceId = fauxmo->addDevice(device.name.c_str());
+        if (deviceId == FAUXMO_INVALID_ID) {
+            serialController->printf("❌ Nessuno spazio Alexa per: %s (nomi %u/%u byte)\n", device.name.c_str(),
+                                     (unsigned int) fauxmo->getNameArenaUsed(), (unsigned int) FAUXMO_NAME_ARENA_SIZE);
+            continue;
+        }
+        if (deviceId < config->MAX_DEVICES) {
+            deviceMap[deviceId] = i;
+            if (deviceId >= mappedDevices) mappedDevices = deviceId + 1;
+        }
         serialController->printf("🎤 Aggiunto dispositivo Alexa: %s\n", device.name.c_str());
         
         if (device.uuid.length() > 0) {
@@ -98,53 +132,323 @@ void AlexaController::onDeviceStateChanged(unsigned char device_id, const char*
         return;
     }
     
-    safeInstance->handleDeviceCommand(device_name, state);
+    safeInstance->handleDeviceCommand(device_id, device_name, state, value);
 }
 
-void AlexaController::handleDeviceCommand(const char* device_name, bool state) {
+void AlexaController::handleDeviceCommand(unsigned char device_id, const char* device_name, bool state, unsigned char value) {
     if (!isCallbackSafe()) {
         serialController->println("⚠️ Callback ignorato - sistema non sicuro");
         return;
     }
     
+    // Tempi della richiesta Hue che ha generato questo callback
+    const fauxmoesp_timing_t& timing = fauxmo->getRequestTiming();
+    uint32_t now = micros();
+    latency.record(STAGE_RX_QUEUE, timing.received, timing.started);
+    latency.record(STAGE_PARSE, timing.started, timing.parsed);
+    latency.record(STAGE_ROUTE, timing.parsed, timing.routed);
+    latency.record(STAGE_REPLY, timing.routed, timing.replied);
+    latency.record(STAGE_CALLBACK, timing.replied, now);
+    latency.record(STAGE_ECHO_REPLY, timing.received, timing.replied);
+    
     serialController->printAlexaCommand(device_name, state);
     
     Device* device = nullptr;
-    for (int i = 0; i < deviceController->getDeviceCount(); i++) {
-        if (deviceController->getDevice(i).name.equalsIgnoreCase(device_name)) {
-            device = deviceController->getDevicePtr(i);
-            break;
+    if (device_id < mappedDevices && deviceMap[device_id] < deviceController->getDeviceCount()) {
+        device = deviceController->getDevicePtr(deviceMap[device_id]);
+    } else {
+        device = deviceController->findDevice(device_name);
+    }
+    
+    if (!device) {
+        serialController->printf("❌ Dispositivo '%s' non trovato!\n", device_name);
+        return;
+    }
+    
+    // Siamo nel task async_tcp: la chiamata HTTP la esegue il worker
+    Command command;
+    command.device = device - deviceController->getDevicePtr(0);
+    command.member = 0;
+    command.members = 1;
+    command.alexaId = device_id;
+    command.state = state;
+    command.value = value;
+    command.sequence = 0;
+    if (device_id < config->MAX_DEVICES) {
+        portENTER_CRITICAL(&healthLock);
+        command.sequence = ++health[device_id].sequence;
+        portEXIT_CRITICAL(&healthLock);
+    }
+    command.receivedAt = timing.received;
+    
+    if (device->isGroup) {
+        submitGroup(command, *device);
+        return;
+    }
+    
+    copyTarget(command, *device);
+    command.submittedAt = micros();
+    
+    if (!dispatcher.submit(command)) {
+        // Lo stato mostrato da Alexa torna quello confermato
+        serialController->printf("⚠️ Coda comandi piena, '%s' ignorato\n", device_name);
+        finishCommand(command, COMMAND_ERROR_QUEUE_FULL);
+    }
+}
+
+void AlexaController::submitGroup(Command& command, const Device& group) {
+    // Un comando per membro: partono nello stesso batch e il worker li esegue in parallelo
+    String members[SystemConfig::GROUP_MAX_MEMBERS];
+    int count = DeviceController::parseMembers(group.members, members, config->GROUP_MAX_MEMBERS);
+    if (count <= 0) {
+        serialController->printf("❌ Gruppo '%s' senza membri validi\n", group.name.c_str());
+        return;
+    }
+    
+    command.members = count;
+    for (int i = 0; i < count; i++) {
+        command.member = i;
+        if (members[i].startsWith("http")) {
+            Device target("", members[i]);
+            DeviceController::prepareTarget(target);
+            copyTarget(command, target);
+        } else {
+            Device* member = deviceController->findDevice(members[i]);
+            if (!member || member->isGroup) {
+                // Rimosso dopo la creazione del gruppo: conta come fallito
+                serialController->printf("⚠️ Membro '%s' del gruppo '%s' non trovato\n",
+                                         members[i].c_str(), group.name.c_str());
+                finishCommand(command, POOL_ERROR_CONNECT);
+                continue;
+            }
+            copyTarget(command, *member);
         }
+        command.submittedAt = micros();
+        
+        if (!dispatcher.submit(command)) {
+            // Come un membro non trovato: il gruppo non sarà confermato
+            serialController->printf("⚠️ Coda comandi piena, membro '%s' ignorato\n", members[i].c_str());
+            finishCommand(command, COMMAND_ERROR_QUEUE_FULL);
+        }
+    }
+}
+
+void AlexaController::copyTarget(Command& command, const Device& device) {
+    // Solo copie di byte: la richiesta è già pronta nel dispositivo
+    command.pin = device.pin;
+    command.useCustomUrl = device.useCustomUrl;
+    strlcpy(command.url, device.customUrl.c_str(), sizeof(command.url));
+    strlcpy(command.host, device.host.c_str(), sizeof(command.host));
+    command.port = device.port;
+    command.requestLength = device.request.length() <= SystemConfig::POOL_REQUEST_LENGTH ? device.request.length() : 0;
+    memcpy(command.request, device.request.c_str(), command.requestLength);
+}
+
+void AlexaController::executeCommands(void* self, const Command* commands, int count) {
+    static_cast<AlexaController*>(self)->runCommands(commands, count);
+}
+
+void AlexaController::runCommands(const Command* commands, int count) {
+    Batch batch;
+    batch.self = this;
+    batch.commands = commands;
+    batch.jobs = 0;
+    
+    uint32_t started = micros();
+    for (int i = 0; i < count; i++) {
+        latency.record(STAGE_QUEUE, commands[i].submittedAt, started);
+    }
+    
+    // Un lavoro per host: i comandi verso lo stesso host partono in pipeline sulla
+    // stessa connessione, host diversi (e URL https) vanno in parallelo
+    bool assigned[SystemConfig::COMMAND_BATCH] = {false};
+    int position = 0;
+    for (int i = 0; i < count; i++) {
+        if (assigned[i]) continue;
+        batch.jobStart[batch.jobs] = position;
+        for (int k = i; k < count; k++) {
+            if (assigned[k]) continue;
+            bool sameHost = commands[i].requestLength && commands[k].requestLength &&
+                            commands[k].port == commands[i].port && strcmp(commands[k].host, commands[i].host) == 0;
+            if (k != i && !sameHost) continue;
+            assigned[k] = true;
+            batch.order[position++] = k;
+        }
+        batch.jobSize[batch.jobs] = position - batch.jobStart[batch.jobs];
+        batch.jobs++;
+    }
+    
+    fanOut.run(runJob, &batch, batch.jobs);
+}
+
+void AlexaController::runJob(void* context, int job) {
+    Batch* batch = static_cast<Batch*>(context);
+    batch->self->runHost(*batch, job);
+}
+
+void AlexaController::runHost(const Batch& batch, int job) {
+    const int* members = &batch.order[batch.jobStart[job]];
+    int count = batch.jobSize[job];
+    const Command* commands = batch.commands;
+    int first = members[0];
+    
+    // https o URL che il pool non gestisce
+    if (!commands[first].requestLength) {
+        finishCommand(commands[first], callCustomURL(commands[first].url));
+        latency.record(STAGE_END_TO_END, commands[first].receivedAt, micros());
+        return;
+    }
+    
+    bool done[SystemConfig::COMMAND_BATCH] = {false};
+    int pinCommands = 0;
+    for (int m = 0; m < count; m++) {
+        if (!commands[members[m]].useCustomUrl) pinCommands++;
+    }
+    
+    // Gruppo o routine: tutti gli impulsi in una sola richiesta, se l'ESP originale la supporta
+    if (pinCommands > 1 && multiPinSupport != MULTI_PIN_UNSUPPORTED) {
+        runMultiPin(commands, members, count, done);
     }
     
-    if (device) {
-        if (device->useCustomUrl) {
-            callCustomURL(device->customUrl);
+    HttpRequest requests[SystemConfig::COMMAND_BATCH];
+    int group[SystemConfig::COMMAND_BATCH];
+    int n = 0;
+    for (int m = 0; m < count; m++) {
+        if (done[m]) continue;
+        const Command& command = commands[members[m]];
+        group[n] = members[m];
+        requests[n].request = command.request;
+        requests[n].length = command.requestLength;
+        n++;
+        if (command.useCustomUrl) {
+            serialController->printf("🌐 Chiamata URL: %s\n", command.url);
         } else {
-            callESP(device->pin);
+            serialController->printf("📡 Chiamata ESP: Pin %d\n", command.pin);
         }
-    } else {
-        serialController->printf("❌ Dispositivo '%s' non trovato!\n", device_name);
+    }
+    if (n == 0) return;
+    
+    pool.execute(commands[first].host, commands[first].port, requests, n);
+    
+    for (int r = 0; r < n; r++) {
+        reportCommand(commands[group[r]], requests[r], commands[first].host);
     }
 }
 
-void AlexaController::callESP(int pin) {
-    HTTPClient http;
-    String url = "http://" + String(config->ESP_ORIGINALE_IP) + "/pulsePin?pin=" + String(pin);
+void AlexaController::runMultiPin(const Command* commands, const int* members, int count, bool* done) {
+    // Formato documentato nel README: /pulsePins?pins=33,32,26
+    // Il job raccoglie comandi verso lo stesso host: la destinazione è quella già
+    // preparata nei comandi, come in runHost
+    char path[32 + SystemConfig::COMMAND_BATCH * 4];
+    size_t length = strlcpy(path, "/pulsePins?pins=", sizeof(path));
+    const Command* target = nullptr;
+    for (int m = 0; m < count; m++) {
+        const Command& command = commands[members[m]];
+        if (command.useCustomUrl) continue;
+        if (!target) target = &command;
+        length += snprintf(path + length, sizeof(path) - length, "%s%d",
+                           path[length - 1] == '=' ? "" : ",", command.pin);
+    }
     
-    serialController->printf("📡 Chiamata ESP: Pin %d\n", pin);
+    if (!target) return;
     
-    http.begin(url);
-    http.setTimeout(config->HTTP_TIMEOUT);
-    int httpCode = http.GET();
+    char buffer[SystemConfig::POOL_REQUEST_LENGTH + 1];
+    int written = ConnectionPool::formatRequest(target->host, path, buffer, sizeof(buffer));
+    if (written < 0) return;
+    
+    HttpRequest request;
+    request.request = buffer;
+    request.length = written;
+    serialController->printf("📡 Chiamata ESP: %s\n", path);
+    pool.execute(target->host, target->port, &request, 1);
+    
+    if (request.code == 404) {
+        // Firmware senza /pulsePins: da ora si chiama /pulsePin per ogni pin
+        multiPinSupport = MULTI_PIN_UNSUPPORTED;
+        serialController->println("ℹ️ ESP originale senza /pulsePins, uso /pulsePin per ogni pin");
+        return;
+    }
+    if (request.code == 200) multiPinSupport = MULTI_PIN_SUPPORTED;
+    
+    for (int m = 0; m < count; m++) {
+        const Command& command = commands[members[m]];
+        if (command.useCustomUrl) continue;
+        reportCommand(command, request, target->host);
+        done[m] = true;
+    }
+}
+
+void AlexaController::reportCommand(const Command& command, const HttpRequest& request, const char* host) {
+    if (request.code == POOL_ERROR_CIRCUIT_OPEN) {
+        serialController->printAlexaCircuitOpen(host);
+        finishCommand(command, request.code);
+        return;
+    }
+    
+    bool success = (request.code == 200);
+    if (request.code > 0) {
+        if (request.connectTime) latency.record(STAGE_CONNECT, request.connectTime);
+        latency.record(STAGE_FIRST_BYTE, request.firstByteTime);
+        latency.record(STAGE_COMPLETE, request.completeTime);
+        latency.record(STAGE_END_TO_END, command.receivedAt, request.completedAt);
+    }
+    if (command.useCustomUrl) {
+        serialController->printAlexaCustomResponse(command.url, success, request.code, success ? request.body : "");
+    } else {
+        serialController->printAlexaResponse(command.pin, success, request.code);
+    }
+    finishCommand(command, request.code);
+}
+
+void AlexaController::finishCommand(const Command& command, int httpCode) {
+    if (command.alexaId < 0 || command.alexaId >= config->MAX_DEVICES) return;
     
     bool success = (httpCode == 200);
-    serialController->printAlexaResponse(pin, success, httpCode);
+    bool revert = false;
+    bool state;
+    unsigned char value;
     
-    http.end();
+    portENTER_CRITICAL(&healthLock);
+    DeviceHealth& h = health[command.alexaId];
+    h.lastCode = httpCode;
+    if (success) {
+        h.successes++;
+    } else {
+        h.failures++;
+    }
+    
+    // Un gruppo è confermato solo quando tutti i membri sono riusciti
+    if (h.resultSequence != command.sequence) {
+        h.resultSequence = command.sequence;
+        h.results = 0;
+        h.resultFailed = false;
+    }
+    h.results++;
+    if (!success) h.resultFailed = true;
+    
+    if (h.results == command.members) {
+        if (!h.resultFailed) {
+            h.confirmedState = command.state;
+            h.confirmedValue = command.value;
+        } else if (config->COMMAND_ROLLBACK && h.sequence == command.sequence) {
+            // Se nel frattempo è arrivato un altro comando lo stato giusto è il suo
+            revert = true;
+            state = h.confirmedState;
+            value = h.confirmedValue;
+            h.rollbacks++;
+        }
+    }
+    portEXIT_CRITICAL(&healthLock);
+    
+    if (revert) {
+        fauxmo->revertState(command.alexaId, command.state, command.value, state, value);
+        if (command.device < deviceController->getDeviceCount()) {
+            serialController->printAlexaRollback(deviceController->getDevice(command.device).name, state);
+        }
+    }
 }
 
-void AlexaController::callCustomURL(const String& url) {
+int AlexaController::callCustomURL(const String& url) {
     HTTPClient http;
     
     serialController->printf("🌐 Chiamata URL: %s\n", url.c_str());
@@ -162,6 +466,7 @@ void AlexaController::callCustomURL(const String& url) {
     serialController->printAlexaCustomResponse(url, success, httpCode, response);
     
     http.end();
+    return httpCode;
 }
 
 void AlexaController::printStatus() {
@@ -171,6 +476,54 @@ void AlexaController::printStatus() {
     }
 }
 
+void AlexaController::printStats() {
+    if (!isInitialized) return;
+    serialController->printAlexaBridges(fauxmo->getBridges(), config->FAUXMO_PORT);
+    serialController->printAlexaStats(fauxmo->getTCPConnections(), fauxmo->getTCPRequests(),
+                                      fauxmo->getTCPReusedRequests());
+    serialController->printAlexaClients(fauxmo->getTCPClients(), fauxmo->getMaxClients(),
+                                        fauxmo->getTCPRejected(), fauxmo->getTCPEvicted());
+    serialController->printAlexaResponses(fauxmo->getTCPResponses(), fauxmo->getTCPResponseSegments(),
+                                          fauxmo->getTCPResponsesFailed());
+    DispatchStats queue = dispatcher.getStats();
+    serialController->printAlexaQueue(queue.depth, queue.peakDepth, queue.capacity, queue.held,
+                                      queue.executed, queue.dropped, queue.merged);
+    serialController->printAlexaTimings(queue.avgWait, queue.maxWait, queue.avgExec, queue.maxExec);
+    PoolStats connections = pool.getStats();
+    serialController->printAlexaPool(connections.opened, connections.reused, connections.retried, connections.pipelined,
+                                     connections.busy);
+    // Attesa degli eventi TCP: comandi luce (prioritari) contro discovery e liste
+    AsyncQueueStats events = AsyncClient::getQueueStats();
+    serialController->printAlexaEvents(events.events[ASYNC_PRIORITY_HIGH], events.waitAvg[ASYNC_PRIORITY_HIGH],
+                                       events.waitMax[ASYNC_PRIORITY_HIGH], events.events[ASYNC_PRIORITY_NORMAL],
+                                       events.waitAvg[ASYNC_PRIORITY_NORMAL], events.waitMax[ASYNC_PRIORITY_NORMAL],
+                                       events.forced);
+    AsyncDNSCacheStats dns = AsyncDNSCache::stats();
+    serialController->printAlexaDns(dns.hits, dns.negativeHits, dns.misses, dns.failures, dns.entries);
+    TargetStatus target;
+    for (int t = 0; t < config->POOL_TARGETS; t++) {
+        if (!pool.getTarget(t, &target)) continue;
+        serialController->printAlexaTarget(target.host, target.port, target.state == BREAKER_OPEN,
+                                           target.state == BREAKER_HALF_OPEN, target.retryIn, target.timeout,
+                                           target.latency, target.successes, target.failures, target.fastFailed);
+    }
+    const fauxmoesp_udp_requester_t* requester;
+    for (unsigned char i = 0; (requester = fauxmo->getUDPRequester(i)) != nullptr; i++) {
+        serialController->printAlexaRequester(requester->ip.toString() + ":" + requester->port, requester->searches,
+                                              requester->responses, requester->coalesced);
+    }
+    for (int id = 0; id < mappedDevices; id++) {
+        portENTER_CRITICAL(&healthLock);
+        DeviceHealth h = health[id];
+        portEXIT_CRITICAL(&healthLock);
+        if (h.successes + h.failures == 0 || deviceMap[id] >= deviceController->getDeviceCount()) continue;
+        serialController->printAlexaDeviceHealth(deviceController->getDevice(deviceMap[id]).name, h.successes,
+                                                 h.failures, h.rollbacks, h.lastCode);
+    }
+    serialController->printAlexaMemory(fauxmo->getDeviceTableMemory(), fauxmo->getNameArenaUsed(),
+                                       FAUXMO_NAME_ARENA_SIZE, fauxmo->getJsonCacheMemory());
+}
+
 void AlexaController::printAlexaCommands() {
     int deviceCount = deviceController->getDeviceCount();
     if (deviceCount > 0) {
@@ -184,4 +537,16 @@ void AlexaController::printAlexaCommands() {
             serialController->println("   - ... e altri dispositivi");
         }
     }
+}
+
+void AlexaController::printLatency() {
+    serialController->printLatencyHeader();
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        LatencySummary s = latency.summary((LatencyStage)stage);
+        serialController->printLatencyStage(s.name, s.count, s.p50, s.p95, s.p99, s.max);
+    }
+}
+
+void AlexaController::exportLatency() {
+    serialController->printLatencyExport(latency.exportText());
 }
\ No newline at end of file
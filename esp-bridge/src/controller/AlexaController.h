@@ -7,6 +7,24 @@
 #include "../model/SystemConfig.h"
 #include "../view/SerialController.h"
 #include "DeviceController.h"
+#include "CommandDispatcher.h"
+#include "ConnectionPool.h"
+#include "LatencyTracker.h"
+#include "FanOut.h"
+
+// Esiti dei comandi per dispositivo Alexa e ultimo stato confermato dal target
+struct DeviceHealth {
+    unsigned long successes;
+    unsigned long failures;
+    unsigned long rollbacks;
+    int lastCode;
+    bool confirmedState;
+    unsigned char confirmedValue;
+    uint32_t sequence;          // ultimo comando ricevuto
+    uint32_t resultSequence;    // comando di cui si stanno raccogliendo gli esiti (gruppi)
+    int results;
+    bool resultFailed;
+};
 
 class AlexaController {
 private:
@@ -15,6 +33,31 @@ private:
     SerialController* serialController;
     SystemConfig* config;
     bool isInitialized;
+    CommandDispatcher dispatcher;
+    ConnectionPool pool;
+    LatencyTracker latency;
+    FanOut fanOut;
+    
+    // Comandi di un batch divisi per host, ogni host è un lavoro di FanOut
+    struct Batch {
+        AlexaController* self;
+        const Command* commands;
+        int order[SystemConfig::COMMAND_BATCH];        // indici dei comandi raggruppati per lavoro
+        int jobStart[SystemConfig::COMMAND_BATCH];
+        int jobSize[SystemConfig::COMMAND_BATCH];
+        int jobs;
+    };
+    
+    // fauxmo device_id -> indice in DeviceController, riempita da addDevices()
+    int deviceMap[SystemConfig::MAX_DEVICES];
+    int mappedDevices;
+    
+    // /pulsePins sull'ESP originale, scoperto alla prima chiamata con più pin
+    enum { MULTI_PIN_UNKNOWN, MULTI_PIN_SUPPORTED, MULTI_PIN_UNSUPPORTED } multiPinSupport;
+    
+    // Indicizzata per id fauxmo, scritta dal task async_tcp e dal worker
+    DeviceHealth health[SystemConfig::MAX_DEVICES];
+    portMUX_TYPE healthLock = portMUX_INITIALIZER_UNLOCKED;
     
     // Variabili per protezione callback
     static volatile bool callbackSafe;
@@ -22,12 +65,20 @@ private:
     
     // Callback methods
     static void onDeviceStateChanged(unsigned char device_id, const char* device_name, bool state, unsigned char value);
-    void handleDeviceCommand(const char* device_name, bool state);
+    void handleDeviceCommand(unsigned char device_id, const char* device_name, bool state, unsigned char value);
+    static void executeCommands(void* self, const Command* commands, int count);
+    void runCommands(const Command* commands, int count);
+    void submitGroup(Command& command, const Device& group);
+    static void copyTarget(Command& command, const Device& device);
+    static void runJob(void* context, int job);
+    void runHost(const Batch& batch, int job);
+    void runMultiPin(const Command* commands, const int* members, int count, bool* done);
+    void reportCommand(const Command& command, const HttpRequest& request, const char* host);
+    void finishCommand(const Command& command, int httpCode);
     
     // Internal methods
     void addDevices();
-    void callESP(int pin);
-    void callCustomURL(const String& url);
+    int callCustomURL(const String& url);
     void enableCallbacks();
     void disableCallbacks();
     bool isCallbackSafe() const;
@@ -45,7 +96,10 @@ public:
     // Status methods
     bool isAlexaInitialized() const { return isInitialized; }
     void printStatus();
+    void printStats();
     void printAlexaCommands();
+    void printLatency();
+    void exportLatency();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "CommandDispatcher.h"
+
+CommandDispatcher::CommandDispatcher(Executor executor, void* context)
+    : queue(nullptr), executor(executor), context(context), totalWait(0), totalExec(0), heldCount(0) {
+    memset(&stats, 0, sizeof(stats));
+    stats.capacity = SystemConfig::COMMAND_QUEUE_LENGTH;
+    for (int i = 0; i < SystemConfig::COMMAND_WORKERS; i++) {
+        workers[i] = nullptr;
+    }
+}
+
+bool CommandDispatcher::begin() {
+    if (queue) return true;
+    
+    queue = xQueueCreate(SystemConfig::COMMAND_QUEUE_LENGTH, sizeof(Command));
+    if (!queue) return false;
+    
+    // Con un solo worker i comandi vengono eseguiti nell'ordine di arrivo
+    for (int i = 0; i < SystemConfig::COMMAND_WORKERS; i++) {
+        if (xTaskCreate(workerTask, "alexa_cmd", SystemConfig::COMMAND_WORKER_STACK, this,
+                        SystemConfig::COMMAND_WORKER_PRIORITY, &workers[i]) != pdPASS) {
+            return i > 0;
+        }
+    }
+    return true;
+}
+
+bool CommandDispatcher::submit(Command& command) {
+    if (!queue) return false;
+    
+    command.enqueuedAt = millis();
+    bool queued = xQueueSend(queue, &command, 0) == pdTRUE;
+    int depth = uxQueueMessagesWaiting(queue);
+    
+    portENTER_CRITICAL(&statsLock);
+    if (queued) {
+        stats.submitted++;
+        if (depth > stats.peakDepth) stats.peakDepth = depth;
+    } else {
+        stats.dropped++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    
+    return queued;
+}
+
+void CommandDispatcher::workerTask(void* self) {
+    static_cast<CommandDispatcher*>(self)->run();
+}
+
+void CommandDispatcher::run() {
+    Command incoming;
+    Command batch[SystemConfig::COMMAND_BATCH];
+    
+    while (true) {
+        // Si dorme fino al prossimo comando o alla fine del debounce più vicino
+        if (xQueueReceive(queue, &incoming, holdTimeout()) == pdTRUE) {
+            do {
+                if (!hold(incoming)) {
+                    execute(batch, release(batch, true));
+                    hold(incoming);
+                }
+            } while (xQueueReceive(queue, &incoming, 0) == pdTRUE);
+        }
+        
+        // Un burst scaduto parte insieme, così può condividere la connessione
+        int count;
+        while ((count = release(batch, false)) > 0) {
+            execute(batch, count);
+        }
+    }
+}
+
+bool CommandDispatcher::hold(const Command& command) {
+    bool accepted = true;
+    bool merged = false;
+    
+    portENTER_CRITICAL(&holdLock);
+    for (int i = 0; i < heldCount; i++) {
+        if (held[i].device == command.device && held[i].member == command.member) {
+            // Vince l'ultimo stato, ma attesa e scadenza restano quelle del primo
+            unsigned long enqueuedAt = held[i].enqueuedAt;
+            held[i] = command;
+            held[i].enqueuedAt = enqueuedAt;
+            merged = true;
+            break;
+        }
+    }
+    if (!merged) {
+        if (heldCount < SystemConfig::COMMAND_QUEUE_LENGTH) {
+            held[heldCount++] = command;
+        } else {
+            accepted = false;
+        }
+    }
+    portEXIT_CRITICAL(&holdLock);
+    
+    if (merged) {
+        portENTER_CRITICAL(&statsLock);
+        stats.merged++;
+        portEXIT_CRITICAL(&statsLock);
+    }
+    return accepted;
+}
+
+int CommandDispatcher::release(Command* batch, bool force) {
+    unsigned long now = millis();
+    int count = 0;
+    
+    portENTER_CRITICAL(&holdLock);
+    // Scaduto il più vecchio parte tutto il burst: i PUT di un gruppo Alexa arrivano
+    // a pochi ms l'uno dall'altro e così finiscono nella stessa chiamata verso il target
+    bool due = heldCount > 0 && now - held[0].enqueuedAt >= (unsigned long)SystemConfig::COMMAND_DEBOUNCE;
+    int kept = 0;
+    for (int i = 0; i < heldCount; i++) {
+        if ((due || (force && count == 0)) && count < SystemConfig::COMMAND_BATCH) {
+            batch[count++] = held[i];
+        } else {
+            if (kept != i) held[kept] = held[i];
+            kept++;
+        }
+    }
+    heldCount = kept;
+    portEXIT_CRITICAL(&holdLock);
+    
+    return count;
+}
+
+TickType_t CommandDispatcher::holdTimeout() {
+    unsigned long now = millis();
+    TickType_t timeout = portMAX_DELAY;
+    
+    portENTER_CRITICAL(&holdLock);
+    if (heldCount > 0) {
+        // Il primo in ordine di arrivo è anche quello che scade prima
+        unsigned long elapsed = now - held[0].enqueuedAt;
+        unsigned long left = elapsed < (unsigned long)SystemConfig::COMMAND_DEBOUNCE ? SystemConfig::COMMAND_DEBOUNCE - elapsed : 0;
+        timeout = pdMS_TO_TICKS(left);
+    }
+    portEXIT_CRITICAL(&holdLock);
+    
+    return timeout;
+}
+
+void CommandDispatcher::execute(Command* batch, int count) {
+    if (count == 0) return;
+    
+    unsigned long started = millis();
+    executor(context, batch, count);
+    unsigned long exec = millis() - started;
+    
+    portENTER_CRITICAL(&statsLock);
+    for (int i = 0; i < count; i++) {
+        unsigned long wait = started - batch[i].enqueuedAt;
+        totalWait += wait;
+        if (wait > stats.maxWait) stats.maxWait = wait;
+    }
+    stats.executed += count;
+    totalExec += exec * count;
+    if (exec > stats.maxExec) stats.maxExec = exec;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+DispatchStats CommandDispatcher::getStats() {
+    portENTER_CRITICAL(&statsLock);
+    DispatchStats result = stats;
+    if (stats.executed > 0) {
+        result.avgWait = totalWait / stats.executed;
+        result.avgExec = totalExec / stats.executed;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    
+    result.depth = queue ? uxQueueMessagesWaiting(queue) : 0;
+    portENTER_CRITICAL(&holdLock);
+    result.held = heldCount;
+    portEXIT_CRITICAL(&holdLock);
+    return result;
+}
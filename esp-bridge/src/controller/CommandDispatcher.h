@@ -0,0 +1,96 @@
+#ifndef COMMAND_DISPATCHER_H
+#define COMMAND_DISPATCHER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "../model/SystemConfig.h"
+
+// Esito di un comando mai eseguito, dopo i codici POOL_ERROR_* di ConnectionPool
+#define COMMAND_ERROR_QUEUE_FULL    -8      // coda piena, il comando è stato scartato
+
+// Comando Alexa in attesa di esecuzione. Contiene una copia del target, così
+// il worker non legge DeviceController mentre il menu seriale lo modifica.
+struct Command {
+    int device;                                     // indice in DeviceController, per i log
+    int member;                                     // posizione nel gruppo, 0 per un dispositivo singolo
+    int members;                                    // comandi generati dallo stesso PUT
+    int alexaId;                                    // id fauxmo, per riallineare lo stato
+    uint32_t sequence;                              // per scartare i rollback superati da comandi nuovi
+    bool state;
+    unsigned char value;
+    int pin;
+    bool useCustomUrl;
+    char url[SystemConfig::MAX_URL_LENGTH + 1];
+    // Destinazione preparata in DeviceController: requestLength 0 = niente pool, va con HTTPClient
+    char host[SystemConfig::POOL_HOST_LENGTH + 1];
+    uint16_t port;
+    uint16_t requestLength;
+    char request[SystemConfig::POOL_REQUEST_LENGTH + 1];
+    unsigned long enqueuedAt;                       // millis() all'inserimento
+    uint32_t receivedAt;                            // micros() all'arrivo della richiesta Hue
+    uint32_t submittedAt;                           // micros() alla consegna al dispatcher
+};
+
+// Tempi in ms
+struct DispatchStats {
+    int depth;
+    int peakDepth;
+    int capacity;
+    int held;                   // in attesa della fine della finestra di debounce
+    unsigned long submitted;
+    unsigned long dropped;
+    unsigned long merged;       // comandi assorbiti da uno successivo sullo stesso dispositivo
+    unsigned long executed;
+    unsigned long avgWait;
+    unsigned long maxWait;
+    unsigned long avgExec;
+    unsigned long maxExec;
+};
+
+// Coda limitata e worker FreeRTOS che eseguono le chiamate HTTP dei comandi
+// Alexa fuori dal task async_tcp: la risposta Hue parte subito e le altre
+// connessioni non restano ferme mentre l'ESP di destinazione risponde.
+// Prima di partire un comando resta COMMAND_DEBOUNCE ms in attesa: se nel
+// frattempo ne arriva un altro per lo stesso dispositivo (on + bri di un
+// "imposta al 50%", slider dell'app) viene eseguito solo l'ultimo. Quelli
+// arrivati durante l'attesa del primo partono insieme a lui.
+class CommandDispatcher {
+public:
+    // Riceve i comandi presenti in coda insieme (al massimo COMMAND_BATCH), in ordine di arrivo
+    typedef void (*Executor)(void* context, const Command* commands, int count);
+
+private:
+    QueueHandle_t queue;
+    TaskHandle_t workers[SystemConfig::COMMAND_WORKERS];
+    Executor executor;
+    void* context;
+
+    portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+    DispatchStats stats;
+    unsigned long totalWait;
+    unsigned long totalExec;
+
+    // Comandi in debounce, in ordine di arrivo
+    portMUX_TYPE holdLock = portMUX_INITIALIZER_UNLOCKED;
+    Command held[SystemConfig::COMMAND_QUEUE_LENGTH];
+    int heldCount;
+
+    static void workerTask(void* self);
+    void run();
+    bool hold(const Command& command);
+    int release(Command* batch, bool force);
+    TickType_t holdTimeout();
+    void execute(Command* batch, int count);
+
+public:
+    CommandDispatcher(Executor executor, void* context);
+
+    bool begin();                       // crea coda e worker, chiamate successive non fanno nulla
+    bool submit(Command& command);      // non blocca, false se la coda è piena
+    bool isRunning() const { return queue != nullptr; }
+    DispatchStats getStats();
+};
+
+#endif
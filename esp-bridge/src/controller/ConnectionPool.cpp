@@ -0,0 +1,485 @@
+#include "ConnectionPool.h"
+#include <AsyncTCP.h>
+
+ConnectionPool::ConnectionPool() {
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < SystemConfig::POOL_CONNECTIONS; i++) {
+        slots[i].host[0] = 0;
+        slots[i].port = 0;
+        slots[i].busy = false;
+        slots[i].lastUsed = 0;
+    }
+    memset(targets, 0, sizeof(targets));
+}
+
+bool ConnectionPool::parseUrl(const char* url, char* host, size_t hostLength, uint16_t* port, const char** path) {
+    if (strncmp(url, "http://", 7) != 0) return false;
+    const char* start = url + 7;
+    const char* end = start;
+    while (*end && *end != ':' && *end != '/' && *end != '?') end++;
+    
+    size_t length = end - start;
+    if (length == 0 || length >= hostLength) return false;
+    memcpy(host, start, length);
+    host[length] = 0;
+    
+    *port = 80;
+    if (*end == ':') {
+        long value = strtol(end + 1, (char**)&end, 10);
+        if (value <= 0 || value > 65535) return false;
+        *port = value;
+    }
+    
+    // "http://host" ha path implicito "/", query senza path non supportata
+    *path = (*end == '/') ? end : "/";
+    return *end == 0 || *end == '/';
+}
+
+// Da chiamare con il lock preso. A tabella piena si ricicla il target usato meno di recente
+int ConnectionPool::findTarget(const char* host, uint16_t port) {
+    int oldest = 0;
+    unsigned long now = millis();
+    for (int i = 0; i < SystemConfig::POOL_TARGETS; i++) {
+        Target& target = targets[i];
+        if (target.used && target.port == port && strcmp(target.host, host) == 0) return i;
+        if (!target.used) {
+            if (targets[oldest].used) oldest = i;
+        } else if (targets[oldest].used && now - target.lastUsed > now - targets[oldest].lastUsed) {
+            oldest = i;
+        }
+    }
+    
+    Target& target = targets[oldest];
+    memset(&target, 0, sizeof(target));
+    strlcpy(target.host, host, sizeof(target.host));
+    target.port = port;
+    target.used = true;
+    target.cooldown = SystemConfig::BREAKER_COOLDOWN;
+    return oldest;
+}
+
+unsigned long ConnectionPool::timeoutOf(const Target& target) {
+    if (!target.measured) return SystemConfig::HTTP_TIMEOUT;
+    long timeout = target.srtt + 4 * target.rttvar;
+    if (timeout < SystemConfig::POOL_MIN_TIMEOUT) return SystemConfig::POOL_MIN_TIMEOUT;
+    if (timeout > SystemConfig::HTTP_TIMEOUT) return SystemConfig::HTTP_TIMEOUT;
+    return timeout;
+}
+
+bool ConnectionPool::admit(int index, int count, unsigned long* timeout) {
+    unsigned long now = millis();
+    bool allowed = true;
+    
+    portENTER_CRITICAL(&lock);
+    Target& target = targets[index];
+    target.lastUsed = now;
+    if (target.state == BREAKER_OPEN && now - target.openedAt >= target.cooldown) {
+        // Cooldown finito: passa una sola richiesta di prova
+        target.state = BREAKER_HALF_OPEN;
+    } else if (target.state != BREAKER_CLOSED) {
+        target.fastFailed += count;
+        allowed = false;
+    }
+    *timeout = timeoutOf(target);
+    portEXIT_CRITICAL(&lock);
+    
+    return allowed;
+}
+
+void ConnectionPool::sample(int index, unsigned long ms) {
+    portENTER_CRITICAL(&lock);
+    Target& target = targets[index];
+    if (!target.measured) {
+        target.srtt = ms;
+        target.rttvar = ms / 2;
+        target.measured = true;
+    } else {
+        long delta = (long)ms - target.srtt;
+        target.srtt += delta / 8;
+        target.rttvar += ((delta < 0 ? -delta : delta) - target.rttvar) / 4;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void ConnectionPool::report(int index, bool success) {
+    portENTER_CRITICAL(&lock);
+    Target& target = targets[index];
+    if (success) {
+        target.successes++;
+        target.consecutiveFailures = 0;
+        target.state = BREAKER_CLOSED;
+        target.cooldown = SystemConfig::BREAKER_COOLDOWN;
+    } else {
+        target.failures++;
+        target.consecutiveFailures++;
+        if (target.state == BREAKER_HALF_OPEN) {
+            // Prova fallita: si riapre con cooldown doppio
+            target.cooldown = min(target.cooldown * 2, (unsigned long)SystemConfig::BREAKER_MAX_COOLDOWN);
+            target.state = BREAKER_OPEN;
+            target.openedAt = millis();
+        } else if (target.consecutiveFailures >= SystemConfig::BREAKER_FAILURES) {
+            target.state = BREAKER_OPEN;
+            target.openedAt = millis();
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void ConnectionPool::withdraw(int index) {
+    // Nessuna richiesta è partita: il target non ha sbagliato niente. Una prova
+    // ammessa da admit torna ad aspettare, la prossima richiesta ritenta subito
+    portENTER_CRITICAL(&lock);
+    Target& target = targets[index];
+    if (target.state == BREAKER_HALF_OPEN) target.state = BREAKER_OPEN;
+    portEXIT_CRITICAL(&lock);
+}
+
+ConnectionPool::Slot* ConnectionPool::acquire(const char* host, uint16_t port, unsigned long timeout, bool* reused, bool* resolved, bool* exhausted) {
+    Slot* match = nullptr;
+    Slot* oldest = nullptr;
+    unsigned long now = millis();
+    
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < SystemConfig::POOL_CONNECTIONS; i++) {
+        Slot* slot = &slots[i];
+        if (slot->busy) continue;
+        if (slot->port == port && strcmp(slot->host, host) == 0) {
+            match = slot;
+            break;
+        }
+        if (!oldest || now - slot->lastUsed > now - oldest->lastUsed) oldest = slot;
+    }
+    Slot* slot = match ? match : oldest;
+    if (slot) slot->busy = true;
+    portEXIT_CRITICAL(&lock);
+    
+    *exhausted = !slot;
+    if (!slot) return nullptr;
+    
+    // Connessione troppo a lungo inattiva: il server l'avrà già chiusa
+    if (match && now - slot->lastUsed > (unsigned long)SystemConfig::POOL_IDLE_TIMEOUT) {
+        slot->client.stop();
+    }
+    
+    *reused = match && slot->client.connected();
+    *resolved = true;
+    if (!*reused) {
+        slot->client.stop();
+        strlcpy(slot->host, host, sizeof(slot->host));
+        slot->port = port;
+        IPAddress ip;
+        *resolved = AsyncDNSCache::resolve(host, ip, timeout);
+        if (!*resolved || !slot->client.connect(ip, port, timeout)) {
+            slot->host[0] = 0;
+            release(slot);
+            return nullptr;
+        }
+        slot->client.setNoDelay(true);
+        portENTER_CRITICAL(&lock);
+        stats.opened++;
+        portEXIT_CRITICAL(&lock);
+    }
+    return slot;
+}
+
+void ConnectionPool::release(Slot* slot) {
+    slot->lastUsed = millis();
+    portENTER_CRITICAL(&lock);
+    slot->busy = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+int ConnectionPool::formatRequest(const char* host, const char* path, char* buffer, size_t length) {
+    int written = snprintf(buffer, length,
+                           "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                           path, host);
+    return (written < 0 || (size_t)written >= length) ? -1 : written;
+}
+
+bool ConnectionPool::writeAll(WiFiClient& client, const char* data, size_t length, bool* written) {
+    size_t n = client.write((const uint8_t*)data, length);
+    if (n > 0) *written = true;
+    return n == length;
+}
+
+bool ConnectionPool::sendRequests(Slot* slot, HttpRequest* requests, int count, bool* written) {
+    *written = false;
+    
+    // Una richiesta sola parte così com'è
+    if (count == 1) {
+        return writeAll(slot->client, requests[0].request, requests[0].length, written);
+    }
+    
+    // In pipeline vanno in un'unica scrittura finché entrano nel buffer
+    char buffer[SystemConfig::POOL_WRITE_BUFFER];
+    size_t used = 0;
+    
+    for (int i = 0; i < count; i++) {
+        size_t length = requests[i].length;
+        if (used + length > sizeof(buffer) && used > 0) {
+            if (!writeAll(slot->client, buffer, used, written)) return false;
+            used = 0;
+        }
+        if (length > sizeof(buffer)) {
+            if (!writeAll(slot->client, requests[i].request, length, written)) return false;
+            continue;
+        }
+        memcpy(buffer + used, requests[i].request, length);
+        used += length;
+    }
+    return used == 0 || writeAll(slot->client, buffer, used, written);
+}
+
+int ConnectionPool::readLine(WiFiClient& client, char* buffer, size_t length, unsigned long deadline) {
+    size_t n = 0;
+    while (true) {
+        if (client.available()) {
+            int c = client.read();
+            if (c < 0) continue;
+            if (c == '\n') {
+                if (n > 0 && buffer[n - 1] == '\r') n--;
+                buffer[n] = 0;
+                return n;
+            }
+            if (n < length - 1) buffer[n++] = c;     // righe troppo lunghe vengono troncate
+            continue;
+        }
+        if (!client.connected() || (long)(millis() - deadline) > 0) return -1;
+        delay(1);
+    }
+}
+
+bool ConnectionPool::readBody(WiFiClient& client, HttpRequest& request, size_t length, unsigned long deadline) {
+    while (length > 0) {
+        if (client.available()) {
+            int c = client.read();
+            if (c < 0) continue;
+            if (request.bodyLength < sizeof(request.body) - 1) {
+                request.body[request.bodyLength++] = c;
+                request.body[request.bodyLength] = 0;
+            }
+            length--;
+            continue;
+        }
+        if (!client.connected() || (long)(millis() - deadline) > 0) return false;
+        delay(1);
+    }
+    return true;
+}
+
+int ConnectionPool::readResponse(WiFiClient& client, HttpRequest& request, unsigned long timeout,
+                                 bool* keepAlive, uint32_t* firstByte) {
+    unsigned long deadline = millis() + timeout;
+    char line[SystemConfig::POOL_LINE_LENGTH];
+    
+    request.bodyLength = 0;
+    request.body[0] = 0;
+    
+    // Status line, le risposte 1xx non hanno body e precedono quella vera
+    int code;
+    *firstByte = 0;
+    do {
+        if (readLine(client, line, sizeof(line), deadline) < 0) return POOL_ERROR_TIMEOUT;
+        if (*firstByte == 0) *firstByte = micros();
+        if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12) return POOL_ERROR_RESPONSE;
+        code = atoi(line + 9);
+        *keepAlive = (line[7] == '1');
+        if (code >= 100 && code < 200) {
+            while (readLine(client, line, sizeof(line), deadline) > 0);
+        }
+    } while (code >= 100 && code < 200);
+    
+    long contentLength = -1;
+    bool chunked = false;
+    while (true) {
+        int length = readLine(client, line, sizeof(line), deadline);
+        if (length < 0) return POOL_ERROR_TIMEOUT;
+        if (length == 0) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = strtol(line + 15, nullptr, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            chunked = strstr(line + 18, "chunked") != nullptr;
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            if (strcasestr(line + 11, "close")) *keepAlive = false;
+            if (strcasestr(line + 11, "keep-alive")) *keepAlive = true;
+        }
+    }
+    
+    if (code == 204 || code == 304) return code;
+    
+    if (chunked) {
+        while (true) {
+            if (readLine(client, line, sizeof(line), deadline) < 0) return POOL_ERROR_TIMEOUT;
+            size_t size = strtoul(line, nullptr, 16);
+            if (size == 0) break;
+            if (!readBody(client, request, size, deadline)) return POOL_ERROR_TIMEOUT;
+            if (readLine(client, line, sizeof(line), deadline) < 0) return POOL_ERROR_TIMEOUT;
+        }
+        while (readLine(client, line, sizeof(line), deadline) > 0);     // trailer
+    } else if (contentLength >= 0) {
+        if (!readBody(client, request, contentLength, deadline)) return POOL_ERROR_TIMEOUT;
+    } else {
+        // Senza lunghezza il body finisce con la chiusura della connessione
+        *keepAlive = false;
+        readBody(client, request, (size_t)-1, deadline);
+    }
+    return code;
+}
+
+void ConnectionPool::execute(const char* host, uint16_t port, HttpRequest* requests, int count) {
+    portENTER_CRITICAL(&lock);
+    int target = findTarget(host, port);
+    portEXIT_CRITICAL(&lock);
+    
+    unsigned long timeout;
+    if (!admit(target, count, &timeout)) {
+        for (int i = 0; i < count; i++) requests[i].code = POOL_ERROR_CIRCUIT_OPEN;
+        return;
+    }
+    
+    int done = 0;
+    bool retried = false;
+    int connectAttempts = 0;
+    int busyAttempts = 0;
+    
+    while (done < count) {
+        bool reused = false;
+        bool resolved = true;
+        bool exhausted = false;
+        uint32_t connecting = micros();
+        Slot* slot = acquire(host, port, timeout, &reused, &resolved, &exhausted);
+        uint32_t connected = micros();
+        if (exhausted) {
+            // Pool locale pieno (fan-out di un gruppo, altri comandi in corso): il
+            // target non c'entra, si aspetta una connessione libera senza toccare il breaker
+            if (busyAttempts < SystemConfig::POOL_BUSY_RETRIES) {
+                delay(SystemConfig::POOL_BUSY_WAIT);
+                busyAttempts++;
+                continue;
+            }
+            for (int i = done; i < count; i++) requests[i].code = POOL_ERROR_BUSY;
+            portENTER_CRITICAL(&lock);
+            stats.busy += count - done;
+            portEXIT_CRITICAL(&lock);
+            if (done > 0) {
+                report(target, true);
+            } else {
+                withdraw(target);
+            }
+            return;
+        }
+        if (!slot && !resolved) {
+            // Un nome che non si risolve non si risolverà ritentando subito
+            for (int i = done; i < count; i++) requests[i].code = POOL_ERROR_DNS;
+            report(target, done > 0);
+            return;
+        }
+        if (!slot) {
+            // Nessun byte è arrivato al target, si può ritentare senza rischi. Solo se
+            // rifiutata subito (target che si sta riavviando): dopo un timeout sarebbe tempo perso
+            bool refused = (connected - connecting) / 1000 < timeout / 2;
+            if (refused && connectAttempts < SystemConfig::POOL_CONNECT_RETRIES) {
+                delay(SystemConfig::POOL_RETRY_BACKOFF << connectAttempts);
+                connectAttempts++;
+                continue;
+            }
+            for (int i = done; i < count; i++) requests[i].code = POOL_ERROR_CONNECT;
+            report(target, done > 0);
+            return;
+        }
+        
+        int pending = count - done;
+        for (int i = done; i < count; i++) {
+            requests[i].connectTime = requests[i].firstByteTime = requests[i].completeTime = 0;
+        }
+        requests[done].connectTime = reused ? 0 : connected - connecting;
+        bool written;
+        bool sent = sendRequests(slot, requests + done, pending, &written);
+        uint32_t mark = micros();
+        portENTER_CRITICAL(&lock);
+        if (reused) stats.reused += pending;
+        stats.pipelined += pending - 1;
+        portEXIT_CRITICAL(&lock);
+        
+        bool keepAlive = false;
+        bool stale = false;
+        while (sent && done < count) {
+            uint32_t firstByte;
+            int code = readResponse(slot->client, requests[done], timeout, &keepAlive, &firstByte);
+            uint32_t end = micros();
+            
+            // Una volta scritta la richiesta non si ripete: il target potrebbe averla
+            // già eseguita (toggle, impulsi). L'errore va a rollback e circuit breaker
+            requests[done].code = code;
+            requests[done].completedAt = end;
+            if (firstByte) {
+                // In pipeline la risposta inizia quando finisce la precedente
+                requests[done].firstByteTime = firstByte - mark;
+                requests[done].completeTime = end - firstByte;
+                sample(target, (end - mark) / 1000);
+            }
+            mark = end;
+            done++;
+            if (code < 0 || !keepAlive) break;
+        }
+        
+        // Connessione riusata chiusa dal server: si riapre una volta, ma solo se
+        // nessun byte è partito
+        if (!sent && !written && reused && !retried) stale = true;
+        if (!sent || stale || !keepAlive || done < count) slot->client.stop();
+        release(slot);
+        
+        if (stale) {
+            retried = true;
+            portENTER_CRITICAL(&lock);
+            stats.retried++;
+            portEXIT_CRITICAL(&lock);
+            continue;
+        }
+        if (!sent) {
+            for (int i = done; i < count; i++) requests[i].code = POOL_ERROR_SEND;
+            report(target, false);
+            return;
+        }
+        if (done < count && requests[done - 1].code < 0) {
+            // Timeout o risposta non valida: le richieste rimaste falliscono con lo stesso errore
+            for (int i = done; i < count; i++) requests[i].code = requests[done - 1].code;
+            report(target, false);
+            return;
+        }
+    }
+    
+    // Anche un 404 o un 500 vuol dire che il target è vivo
+    report(target, requests[count - 1].code > 0);
+}
+
+PoolStats ConnectionPool::getStats() {
+    portENTER_CRITICAL(&lock);
+    PoolStats result = stats;
+    portEXIT_CRITICAL(&lock);
+    return result;
+}
+
+bool ConnectionPool::getTarget(int index, TargetStatus* status) {
+    if (index < 0 || index >= SystemConfig::POOL_TARGETS) return false;
+    unsigned long now = millis();
+    
+    portENTER_CRITICAL(&lock);
+    const Target& target = targets[index];
+    bool used = target.used;
+    if (used) {
+        strlcpy(status->host, target.host, sizeof(status->host));
+        status->port = target.port;
+        status->state = target.state;
+        status->timeout = timeoutOf(target);
+        status->latency = target.measured ? target.srtt : 0;
+        status->successes = target.successes;
+        status->failures = target.failures;
+        status->fastFailed = target.fastFailed;
+        unsigned long elapsed = now - target.openedAt;
+        status->retryIn = (target.state == BREAKER_OPEN && elapsed < target.cooldown) ? target.cooldown - elapsed : 0;
+    }
+    portEXIT_CRITICAL(&lock);
+    
+    return used;
+}
@@ -0,0 +1,129 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include "../model/SystemConfig.h"
+
+// Codici d'errore, negativi come quelli di HTTPClient
+#define POOL_ERROR_CONNECT      -1
+#define POOL_ERROR_SEND         -2
+#define POOL_ERROR_TIMEOUT      -3
+#define POOL_ERROR_RESPONSE     -4
+#define POOL_ERROR_CIRCUIT_OPEN -5      // target spento, richiesta non tentata
+#define POOL_ERROR_DNS          -6      // nome host non risolto (anche dalla cache)
+#define POOL_ERROR_BUSY         -7      // connessioni del pool tutte occupate, target non contattato
+
+enum BreakerState {
+    BREAKER_CLOSED,             // target sano
+    BREAKER_OPEN,               // fallisce subito fino alla fine del cooldown
+    BREAKER_HALF_OPEN           // una richiesta di prova in corso
+};
+
+// Una GET da eseguire: richiesta già scritta in ingresso (vedi formatRequest),
+// esito e (inizio del) body in uscita
+struct HttpRequest {
+    const char* request;
+    size_t length;
+    int code;
+    char body[SystemConfig::HTTP_RESPONSE_MAX_LENGTH + 1];
+    size_t bodyLength;
+    // Tempi in us: apertura connessione (0 se riusata o non la prima del burst),
+    // invio o risposta precedente -> primo byte, primo byte -> fine
+    uint32_t connectTime;
+    uint32_t firstByteTime;
+    uint32_t completeTime;
+    uint32_t completedAt;       // micros() a risposta completa
+};
+
+struct TargetStatus {
+    char host[SystemConfig::POOL_HOST_LENGTH + 1];
+    uint16_t port;
+    BreakerState state;
+    unsigned long timeout;      // ms, timeout adattivo attuale
+    unsigned long latency;      // ms, media mobile delle risposte
+    unsigned long successes;
+    unsigned long failures;
+    unsigned long fastFailed;   // richieste rifiutate a breaker aperto
+    unsigned long retryIn;      // ms alla prossima prova, se aperto
+};
+
+struct PoolStats {
+    unsigned long opened;       // connessioni TCP aperte
+    unsigned long reused;       // richieste partite su una connessione già aperta
+    unsigned long retried;      // connessioni riusate trovate chiuse prima di scrivere e riaperte
+    unsigned long pipelined;    // richieste inviate prima della risposta alla precedente
+    unsigned long busy;         // richieste fallite senza una connessione libera (non contano per il breaker)
+};
+
+// Connessioni keep-alive verso l'ESP originale e gli host degli URL custom.
+// Le richieste di un burst verso lo stesso host partono tutte sulla stessa
+// connessione (pipelining HTTP/1.1) e le risposte si leggono in ordine.
+// Solo http://, per https si usa ancora HTTPClient. I nomi host passano dalla
+// cache DNS di AsyncTCP, condivisa con gli altri client.
+class ConnectionPool {
+private:
+    struct Slot {
+        char host[SystemConfig::POOL_HOST_LENGTH + 1];
+        uint16_t port;
+        WiFiClient client;
+        bool busy;
+        unsigned long lastUsed;
+    };
+
+    // Salute per host:porta, latenza in stile RTO TCP (media e scarto mobili)
+    struct Target {
+        char host[SystemConfig::POOL_HOST_LENGTH + 1];
+        uint16_t port;
+        bool used;
+        unsigned long lastUsed;
+        long srtt;
+        long rttvar;
+        bool measured;
+        BreakerState state;
+        int consecutiveFailures;
+        unsigned long openedAt;
+        unsigned long cooldown;
+        unsigned long successes;
+        unsigned long failures;
+        unsigned long fastFailed;
+    };
+
+    Slot slots[SystemConfig::POOL_CONNECTIONS];
+    Target targets[SystemConfig::POOL_TARGETS];
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    PoolStats stats;
+
+    int findTarget(const char* host, uint16_t port);
+    bool admit(int target, int count, unsigned long* timeout);
+    void sample(int target, unsigned long ms);
+    void report(int target, bool success);
+    void withdraw(int target);
+    static unsigned long timeoutOf(const Target& target);
+
+    Slot* acquire(const char* host, uint16_t port, unsigned long timeout, bool* reused, bool* resolved, bool* exhausted);
+    void release(Slot* slot);
+    bool writeAll(WiFiClient& client, const char* data, size_t length, bool* written);
+    bool sendRequests(Slot* slot, HttpRequest* requests, int count, bool* written);
+    int readResponse(WiFiClient& client, HttpRequest& request, unsigned long timeout,
+                     bool* keepAlive, uint32_t* firstByte);
+    int readLine(WiFiClient& client, char* buffer, size_t length, unsigned long deadline);
+    bool readBody(WiFiClient& client, HttpRequest& request, size_t length, unsigned long deadline);
+
+public:
+    ConnectionPool();
+
+    // "http://host[:porta]/path" -> host, porta e puntatore al path dentro url
+    static bool parseUrl(const char* url, char* host, size_t hostLength, uint16_t* port, const char** path);
+    // GET keep-alive con i suoi header, -1 se non entra in buffer
+    static int formatRequest(const char* host, const char* path, char* buffer, size_t length);
+
+    // Esegue in ordine richieste verso lo stesso host, riaprendo la connessione se serve.
+    // Con il breaker aperto tutte le richieste falliscono subito con POOL_ERROR_CIRCUIT_OPEN
+    void execute(const char* host, uint16_t port, HttpRequest* requests, int count);
+    PoolStats getStats();
+    bool getTarget(int index, TargetStatus* status);    // false se lo slot è vuoto o fuori range
+};
+
+#endif
@@ -1,7 +1,8 @@
 #include "DeviceController.h"
+#include "ConnectionPool.h"
 
 DeviceController::DeviceController(Preferences* prefs, SerialController* serial) 
-    : deviceCount(0), preferences(prefs), serialController(serial) {
+    : deviceCount(0), nameIndex(indexName, this), preferences(prefs), serialController(serial) {
     config = SystemConfig::getInstance();
 }
 
@@ -15,8 +16,11 @@ bool DeviceController::addDevice(const String& name, int pin) {
     
     Device newDevice(name, pin);
     newDevice.uuid = generateUUID(name);
+    prepareTarget(newDevice);
     
-    devices[deviceCount++] = newDevice;
+    devices[deviceCount] = newDevice;
+    nameIndex.insert(devices[deviceCount].name.c_str(), deviceCount);
+    deviceCount++;
     saveDevices();
     serialController->printDeviceAction("✅ Dispositivo aggiunto", name);
     return true;
@@ -27,54 +31,154 @@ bool DeviceController::addDevice(const String& name, const String& customUrl) {
     
     Device newDevice(name, customUrl);
     newDevice.uuid = generateUUID(name);
+    prepareTarget(newDevice);
     
-    devices[deviceCount++] = newDevice;
+    devices[deviceCount] = newDevice;
+    nameIndex.insert(devices[deviceCount].name.c_str(), deviceCount);
+    deviceCount++;
     saveDevices();
     serialController->printDeviceAction("✅ Dispositivo aggiunto", name);
     return true;
 }
 
-bool DeviceController::removeDevice(const String& name) {
-    for (int i = 0; i < deviceCount; i++) {
-        if (devices[i].name.equalsIgnoreCase(name)) {
-            // Sposta elementi indietro
-            for (int j = i; j < deviceCount - 1; j++) {
-                devices[j] = devices[j + 1];
+bool DeviceController::addGroup(const String& name, const String& members) {
+    if (isFull() || deviceExists(name)) return false;
+    
+    String list[SystemConfig::GROUP_MAX_MEMBERS];
+    int count = parseMembers(members, list, config->GROUP_MAX_MEMBERS);
+    if (count <= 0) {
+        serialController->printf("❌ Servono da 1 a %d membri\n", config->GROUP_MAX_MEMBERS);
+        return false;
+    }
+    
+    // Ogni membro è un URL o un dispositivo esistente; niente gruppi dentro gruppi
+    String normalized = "";
+    for (int i = 0; i < count; i++) {
+        if (!list[i].startsWith("http")) {
+            Device* member = findDevice(list[i]);
+            if (!member) {
+                serialController->printf("❌ Membro '%s' non trovato\n", list[i].c_str());
+                return false;
+            }
+            if (member->isGroup) {
+                serialController->printf("❌ '%s' è un gruppo, non può essere membro\n", list[i].c_str());
+                return false;
             }
-            deviceCount--;
-            saveDevices();
-            serialController->printDeviceAction("✅ Dispositivo rimosso", name);
-            return true;
         }
+        if (i > 0) normalized += ";";
+        normalized += list[i];
     }
-    serialController->printf("❌ Dispositivo '%s' non trovato\n", name.c_str());
-    return false;
+    
+    Device newDevice;
+    newDevice.name = name;
+    newDevice.isGroup = true;
+    newDevice.members = normalized;
+    newDevice.uuid = generateUUID(name);
+    
+    devices[deviceCount] = newDevice;
+    nameIndex.insert(devices[deviceCount].name.c_str(), deviceCount);
+    deviceCount++;
+    saveDevices();
+    serialController->printDeviceAction("✅ Gruppo aggiunto", name);
+    return true;
 }
 
-bool DeviceController::deviceExists(const String& name) {
-    for (int i = 0; i < deviceCount; i++) {
-        if (devices[i].name.equalsIgnoreCase(name)) {
-            return true;
+int DeviceController::parseMembers(const String& members, String* out, int max) {
+    int count = 0;
+    int start = 0;
+    while (start <= (int)members.length()) {
+        int end = members.indexOf(';', start);
+        if (end < 0) end = members.length();
+        String member = members.substring(start, end);
+        member.trim();
+        if (member.length() > 0) {
+            if (count >= max) return -1;
+            out[count++] = member;
         }
+        start = end + 1;
+    }
+    return count;
+}
+
+bool DeviceController::prepareTarget(Device& device) {
+    device.host = "";
+    device.port = 0;
+    device.request = "";
+    if (device.isGroup) return false;
+    
+    char host[SystemConfig::POOL_HOST_LENGTH + 1];
+    uint16_t port;
+    const char* path;
+    char pinPath[24];
+    if (device.useCustomUrl) {
+        if (!ConnectionPool::parseUrl(device.customUrl.c_str(), host, sizeof(host), &port, &path)) return false;
+    } else {
+        strlcpy(host, SystemConfig::ESP_ORIGINALE_IP, sizeof(host));
+        port = 80;
+        snprintf(pinPath, sizeof(pinPath), "/pulsePin?pin=%d", device.pin);
+        path = pinPath;
     }
-    return false;
+    
+    char request[SystemConfig::POOL_REQUEST_LENGTH + 1];
+    if (ConnectionPool::formatRequest(host, path, request, sizeof(request)) < 0) return false;
+    device.host = host;
+    device.port = port;
+    device.request = request;
+    return true;
+}
+
+bool DeviceController::removeDevice(const String& name) {
+    int i = findDeviceIndex(name);
+    if (i < 0) {
+        serialController->printf("❌ Dispositivo '%s' non trovato\n", name.c_str());
+        return false;
+    }
+    
+    // Sposta elementi indietro
+    for (int j = i; j < deviceCount - 1; j++) {
+        devices[j] = devices[j + 1];
+    }
+    deviceCount--;
+    rebuildIndex();
+    saveDevices();
+    serialController->printDeviceAction("✅ Dispositivo rimosso", name);
+    return true;
+}
+
+bool DeviceController::deviceExists(const String& name) {
+    return findDeviceIndex(name) >= 0;
+}
+
+int DeviceController::findDeviceIndex(const String& name) {
+    return nameIndex.find(name.c_str());
 }
 
 Device* DeviceController::findDevice(const String& name) {
+    int i = findDeviceIndex(name);
+    return i >= 0 ? &devices[i] : nullptr;
+}
+
+void DeviceController::rebuildIndex() {
+    nameIndex.clear();
     for (int i = 0; i < deviceCount; i++) {
-        if (devices[i].name.equalsIgnoreCase(name)) {
-            return &devices[i];
-        }
+        nameIndex.insert(devices[i].name.c_str(), i);
     }
-    return nullptr;
+}
+
+const char* DeviceController::indexName(void* self, int index) {
+    return ((DeviceController*)self)->devices[index].name.c_str();
 }
 
 void DeviceController::printDevices() {
     serialController->printDeviceList(deviceCount);
     
     for (int i = 0; i < deviceCount; i++) {
-        serialController->printDevice(i, devices[i].name, devices[i].useCustomUrl, 
-                                    devices[i].pin, devices[i].customUrl);
+        if (devices[i].isGroup) {
+            serialController->printGroupDevice(i, devices[i].name, devices[i].members);
+        } else {
+            serialController->printDevice(i, devices[i].name, devices[i].useCustomUrl, 
+                                        devices[i].pin, devices[i].customUrl);
+        }
     }
     
     if (deviceCount > 0) {
@@ -93,6 +197,8 @@ void DeviceController::saveDevices() {
         preferences->putBool((prefix + "custom").c_str(), devices[i].useCustomUrl);
         preferences->putString((prefix + "url").c_str(), devices[i].customUrl);
         preferences->putString((prefix + "uuid").c_str(), devices[i].uuid);
+        preferences->putBool((prefix + "group").c_str(), devices[i].isGroup);
+        preferences->putString((prefix + "members").c_str(), devices[i].members);
     }
 }
 
@@ -107,11 +213,16 @@ void DeviceController::loadDevices() {
         devices[i].useCustomUrl = preferences->getBool((prefix + "custom").c_str(), false);
         devices[i].customUrl = preferences->getString((prefix + "url").c_str(), "");
         devices[i].uuid = preferences->getString((prefix + "uuid").c_str(), "");
+        devices[i].isGroup = preferences->getBool((prefix + "group").c_str(), false);
+        devices[i].members = preferences->getString((prefix + "members").c_str(), "");
+        prepareTarget(devices[i]);
         
         if (devices[i].uuid.length() == 0) {
             devices[i].uuid = generateUUID(devices[i].name);
         }
     }
+    if (deviceCount > config->MAX_DEVICES) deviceCount = config->MAX_DEVICES;
+    rebuildIndex();
 }
 
 String DeviceController::generateUUID(const String& deviceName) {
@@ -126,6 +237,7 @@ String DeviceController::generateUUID(const String& deviceName) {
 
 void DeviceController::clear() {
     deviceCount = 0;
+    nameIndex.clear();
     saveDevices();
     serialController->println("✅ Tutti i dispositivi rimossi");
 }
@@ -6,6 +6,7 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include "../model/SystemConfig.h"
+#include "../../nameindex.h"
 #include "../view/SerialController.h"
 
 // Struttura Device integrata nel controller
@@ -15,16 +16,23 @@ struct Device {
     bool useCustomUrl;
     String customUrl;
     String uuid;
+    bool isGroup;
+    String members;     // gruppo: nomi di dispositivi o URL separati da ';'
+    // Destinazione preparata da DeviceController::prepareTarget, vuota per gruppi e https
+    String host;
+    uint16_t port;
+    String request;     // GET con header, si scrive così com'è sulla connessione
     
-    Device() : pin(-1), useCustomUrl(false) {}
-    Device(const String& n, int p) : name(n), pin(p), useCustomUrl(false) {}
-    Device(const String& n, const String& url) : name(n), pin(-1), useCustomUrl(true), customUrl(url) {}
+    Device() : pin(-1), useCustomUrl(false), isGroup(false), port(0) {}
+    Device(const String& n, int p) : name(n), pin(p), useCustomUrl(false), isGroup(false), port(0) {}
+    Device(const String& n, const String& url) : name(n), pin(-1), useCustomUrl(true), customUrl(url), isGroup(false), port(0) {}
 };
 
 class DeviceController {
 private:
     Device devices[100]; // MAX_DEVICES from SystemConfig
     int deviceCount;
+    NameIndex<SystemConfig::MAX_DEVICES> nameIndex; // nome normalizzato -> indice in devices[]
     Preferences* preferences;
     SerialController* serialController;
     SystemConfig* config;
@@ -32,8 +40,9 @@ private:
     // Internal methods
     void saveDevices();
     void loadDevices();
-    Device* findDevice(const String& name);
     String generateUUID(const String& deviceName);
+    void rebuildIndex();
+    static const char* indexName(void* self, int index);
     
 public:
     DeviceController(Preferences* prefs, SerialController* serial);
@@ -41,8 +50,15 @@ public:
     // Device Management
     bool addDevice(const String& name, int pin);
     bool addDevice(const String& name, const String& customUrl);
+    bool addGroup(const String& name, const String& members);
+    // Divide la lista membri di un gruppo, -1 se sono più di max
+    static int parseMembers(const String& members, String* out, int max);
+    // Host, porta e richiesta per il pool; false se serve HTTPClient (https, URL troppo lungo)
+    static bool prepareTarget(Device& device);
     bool removeDevice(const String& name);
     bool deviceExists(const String& name);
+    int findDeviceIndex(const String& name);
+    Device* findDevice(const String& name);
     
     // Device access
     int getDeviceCount() const { return deviceCount; }
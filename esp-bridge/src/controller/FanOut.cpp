@@ -0,0 +1,73 @@
+#include "FanOut.h"
+
+FanOut::FanOut() : queue(nullptr) {
+    for (int i = 0; i < SystemConfig::FANOUT_TASKS; i++) {
+        helpers[i] = nullptr;
+    }
+}
+
+bool FanOut::begin() {
+    if (queue) return true;
+    
+    queue = xQueueCreate(SystemConfig::COMMAND_BATCH, sizeof(Item));
+    if (!queue) return false;
+    
+    for (int i = 0; i < SystemConfig::FANOUT_TASKS; i++) {
+        if (xTaskCreate(helperTask, "alexa_fanout", SystemConfig::FANOUT_STACK, this,
+                        SystemConfig::COMMAND_WORKER_PRIORITY, &helpers[i]) != pdPASS) {
+            // Con meno task si va comunque, il chiamante esegue quello che resta in coda
+            return true;
+        }
+    }
+    return true;
+}
+
+void FanOut::helperTask(void* self) {
+    FanOut* fanOut = static_cast<FanOut*>(self);
+    Item item;
+    
+    while (true) {
+        if (xQueueReceive(fanOut->queue, &item, portMAX_DELAY) == pdTRUE) {
+            item.job(item.context, item.index);
+            xTaskNotifyGive(item.caller);
+        }
+    }
+}
+
+void FanOut::run(Job job, void* context, int count) {
+    if (count <= 0) return;
+    
+    // Senza coda o con un solo lavoro non c'è niente da parallelizzare
+    if (!queue || count == 1) {
+        for (int i = 0; i < count; i++) job(context, i);
+        return;
+    }
+    
+    Item item = {job, context, 0, xTaskGetCurrentTaskHandle()};
+    int queued = 0;
+    for (int i = 1; i < count; i++) {
+        item.index = i;
+        if (xQueueSend(queue, &item, 0) == pdTRUE) {
+            queued++;
+        } else {
+            job(context, i);        // coda piena: lo esegue il chiamante
+        }
+    }
+    
+    job(context, 0);
+    
+    // Quelli non ancora presi da un task li esegue il chiamante invece di aspettare
+    while (queued > 0 && xQueueReceive(queue, &item, 0) == pdTRUE) {
+        if (item.caller == xTaskGetCurrentTaskHandle() && item.context == context) {
+            item.job(item.context, item.index);
+            queued--;
+        } else {
+            xQueueSendToFront(queue, &item, 0);
+            break;
+        }
+    }
+    
+    while (queued > 0) {
+        queued -= ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef FAN_OUT_H
+#define FAN_OUT_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "../model/SystemConfig.h"
+
+// Esegue in parallelo lavori indipendenti (chiamate verso host diversi) su un
+// gruppo di task FreeRTOS creati una volta sola. Chi chiama run() esegue anche
+// lui dei lavori e torna quando sono finiti tutti, quindi il tempo totale è
+// quello del più lento invece della somma.
+class FanOut {
+public:
+    typedef void (*Job)(void* context, int index);
+
+private:
+    struct Item {
+        Job job;
+        void* context;
+        int index;
+        TaskHandle_t caller;        // notificato a lavoro finito
+    };
+
+    QueueHandle_t queue;
+    TaskHandle_t helpers[SystemConfig::FANOUT_TASKS];
+
+    static void helperTask(void* self);
+
+public:
+    FanOut();
+
+    bool begin();                   // crea coda e task, chiamate successive non fanno nulla
+    void run(Job job, void* context, int count);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "LatencyTracker.h"
+
+const char* LatencyTracker::stageName(int stage) {
+    static const char* const names[STAGE_COUNT] = {
+        "rx_queue", "parse", "route", "reply", "callback", "queue",
+        "connect", "first_byte", "complete", "echo_reply", "end_to_end"
+    };
+    return (stage >= 0 && stage < STAGE_COUNT) ? names[stage] : "?";
+}
+
+void LatencyTracker::record(LatencyStage stage, uint32_t us) {
+    // Differenza negativa: timestamp di una richiesta precedente o mai impostato
+    if (us & 0x80000000u) return;
+    portENTER_CRITICAL(&lock);
+    histograms[stage].record(us);
+    portEXIT_CRITICAL(&lock);
+}
+
+LatencySummary LatencyTracker::summary(LatencyStage stage) {
+    LatencySummary result;
+    result.name = stageName(stage);
+    
+    portENTER_CRITICAL(&lock);
+    const LatencyHistogram& histogram = histograms[stage];
+    result.count = histogram.count();
+    result.p50 = histogram.percentile(50);
+    result.p95 = histogram.percentile(95);
+    result.p99 = histogram.percentile(99);
+    result.max = histogram.max();
+    portEXIT_CRITICAL(&lock);
+    
+    return result;
+}
+
+void LatencyTracker::clear() {
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        histograms[i].clear();
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+String LatencyTracker::exportText() {
+    String text = "# stage count p50_us p95_us p99_us max_us buckets(limit_us:count)\n";
+    
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        // Copia locale per non tenere il lock mentre si formatta
+        LatencyHistogram histogram;
+        portENTER_CRITICAL(&lock);
+        histogram = histograms[stage];
+        portEXIT_CRITICAL(&lock);
+        
+        char line[96];
+        snprintf(line, sizeof(line), "%s %u %u %u %u %u", stageName(stage),
+                 (unsigned)histogram.count(), (unsigned)histogram.percentile(50), (unsigned)histogram.percentile(95),
+                 (unsigned)histogram.percentile(99), (unsigned)histogram.max());
+        text += line;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            if (histogram.bucket(i) == 0) continue;
+            snprintf(line, sizeof(line), " %u:%u", (unsigned)LatencyHistogram::bucketLimit(i), (unsigned)histogram.bucket(i));
+            text += line;
+        }
+        text += "\n";
+    }
+    return text;
+}
@@ -0,0 +1,53 @@
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include "../model/LatencyHistogram.h"
+
+// Tratte misurate lungo il percorso di un comando, dal segmento TCP
+// dell'Echo al relè dell'ESP originale
+enum LatencyStage {
+    STAGE_RX_QUEUE,         // lwIP -> AsyncTCP _recv (coda eventi async_tcp)
+    STAGE_PARSE,            // _recv -> richiesta completa
+    STAGE_ROUTE,            // richiesta completa -> _onTCPControl
+    STAGE_REPLY,            // _onTCPControl -> risposta Hue accodata
+    STAGE_CALLBACK,         // risposta -> AlexaController::handleDeviceCommand
+    STAGE_QUEUE,            // handleDeviceCommand -> worker (coda + debounce)
+    STAGE_CONNECT,          // apertura connessione verso il target (0 se riusata)
+    STAGE_FIRST_BYTE,       // richiesta inviata -> primo byte di risposta
+    STAGE_COMPLETE,         // primo byte -> risposta completa
+    STAGE_ECHO_REPLY,       // lwIP -> risposta Hue accodata (quello che vede l'Echo)
+    STAGE_END_TO_END,       // lwIP -> risposta del target completa
+    STAGE_COUNT
+};
+
+struct LatencySummary {
+    const char* name;
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+};
+
+// Istogrammi per tratta, scritti dal task async_tcp e dai worker
+class LatencyTracker {
+private:
+    LatencyHistogram histograms[STAGE_COUNT];
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+public:
+    static const char* stageName(int stage);
+
+    void record(LatencyStage stage, uint32_t us);
+    void record(LatencyStage stage, uint32_t from, uint32_t to) { record(stage, to - from); }
+    LatencySummary summary(LatencyStage stage);
+    void clear();
+
+    // Una riga per tratta: nome, campioni, percentili e bucket non vuoti
+    // come "limite:conteggio", tutto in microsecondi
+    String exportText();
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Istogramma di latenze in microsecondi a bucket fissi, senza allocazioni.
+// Quattro bucket per ogni potenza di due (errore massimo ~25%) da 1 us a
+// ~29 s; i valori oltre finiscono nell'ultimo bucket.
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 96;
+
+private:
+    uint32_t counts[BUCKETS];
+    uint32_t total;
+    uint32_t maximum;
+    uint64_t sum;
+
+    static int bucketOf(uint32_t us) {
+        if (us < 4) return us;
+        int exponent = 31 - __builtin_clz(us);
+        int bucket = (exponent - 1) * 4 + ((us >> (exponent - 2)) & 3);
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+
+public:
+    LatencyHistogram() { clear(); }
+
+    // Limite superiore (escluso) del bucket, l'ultimo raccoglie tutto il resto
+    static uint32_t bucketLimit(int bucket) {
+        if (bucket < 4) return bucket + 1;
+        if (bucket >= BUCKETS - 1) return 0xFFFFFFFFu;
+        int exponent = bucket / 4 + 1;
+        uint64_t limit = (uint64_t)(4 + bucket % 4 + 1) << (exponent - 2);
+        return limit > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)limit;
+    }
+
+    void clear() {
+        for (int i = 0; i < BUCKETS; i++) counts[i] = 0;
+        total = 0;
+        maximum = 0;
+        sum = 0;
+    }
+
+    void record(uint32_t us) {
+        counts[bucketOf(us)]++;
+        total++;
+        sum += us;
+        if (us > maximum) maximum = us;
+    }
+
+    // Percentile (0-100) come limite superiore del bucket che lo contiene
+    uint32_t percentile(int p) const {
+        if (total == 0) return 0;
+        uint32_t rank = ((uint64_t)total * p + 99) / 100;
+        if (rank == 0) rank = 1;
+        uint32_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint32_t limit = bucketLimit(i);
+                return limit < maximum ? limit : maximum;
+            }
+        }
+        return maximum;
+    }
+
+    uint32_t count() const { return total; }
+    uint32_t max() const { return maximum; }
+    uint32_t mean() const { return total ? sum / total : 0; }
+    uint32_t bucket(int i) const { return counts[i]; }
+};
+
+#endif
@@ -41,6 +41,53 @@ public:
     static const int FAUXMO_PORT = 80;
     static const int ALEXA_RESTART_DELAY = 500;
     static const int FAUXMO_DISABLE_DELAY = 200;
+    static const bool FAUXMO_KEEP_ALIVE = true;
+    static const int FAUXMO_KEEP_ALIVE_TIMEOUT = 15;
+    static const int FAUXMO_KEEP_ALIVE_MAX_REQUESTS = 100;
+    // Bridge Hue virtuali su porte consecutive da FAUXMO_PORT, i dispositivi sono
+    // distribuiti a turno. Gli Echo di 3a gen. usano solo la porta 80: lasciare 1
+    // se presenti. Cambiarlo rinumera le luci, serve una nuova ricerca dispositivi.
+    static const int FAUXMO_BRIDGES = 1;
+    // Connessioni TCP contemporanee (max 32). A pieno si chiude quella inattiva da più tempo
+    static const int FAUXMO_MAX_CLIENTS = 10;
+    
+    // Coda comandi Alexa: le chiamate HTTP girano su worker dedicati, non sul task async_tcp.
+    // Con più worker i comandi sullo stesso dispositivo possono arrivare fuori ordine
+    static const int COMMAND_QUEUE_LENGTH = 16;
+    static const int COMMAND_WORKERS = 1;
+    static const int COMMAND_WORKER_STACK = 12288;  // un batch di Command con le richieste già pronte
+    static const int COMMAND_WORKER_PRIORITY = 1;
+    static const int COMMAND_BATCH = 8;             // comandi presi dalla coda in un colpo solo
+    static const int FANOUT_TASKS = 3;              // task che chiamano host diversi in parallelo
+    static const int FANOUT_STACK = 10240;          // come il worker: i membri https passano da HTTPClient e TLS
+    static const int GROUP_MAX_MEMBERS = 8;         // membri di un gruppo, non oltre COMMAND_BATCH
+    static const int COMMAND_DEBOUNCE = 150;        // ms, comandi ravvicinati sullo stesso dispositivo si fondono
+                                                    // e quelli di un gruppo partono insieme (0 = off)
+    // Alexa riceve subito lo stato richiesto; se il comando poi fallisce lo stato
+    // torna all'ultimo confermato, così il GET successivo dell'Echo mostra quello vero
+    static const bool COMMAND_ROLLBACK = true;
+    
+    // Connessioni keep-alive verso l'ESP originale e gli host degli URL custom
+    // Una per ogni task che può usare il pool insieme agli altri (ogni worker e i
+    // suoi helper di fan-out) più una di scorta: un gruppo non lascia gli altri senza
+    static const int POOL_CONNECTIONS = COMMAND_WORKERS * (FANOUT_TASKS + 1) + 1;
+    static const int POOL_IDLE_TIMEOUT = 30000;     // ms, oltre si riapre invece di riusare
+    static const int POOL_HOST_LENGTH = 63;
+    static const int POOL_WRITE_BUFFER = 512;
+    static const int POOL_REQUEST_LENGTH = 320;     // GET con header di un comando: path e host massimi entrano
+    static const int POOL_LINE_LENGTH = 128;
+    // Salute dei target: il timeout segue la latenza osservata (media + 4 scarti, tra
+    // POOL_MIN_TIMEOUT e HTTP_TIMEOUT). Dopo BREAKER_FAILURES errori di fila il target
+    // viene considerato spento e i comandi falliscono subito fino alla prova successiva
+    static const int POOL_TARGETS = 8;
+    static const int POOL_MIN_TIMEOUT = 1000;
+    static const int POOL_CONNECT_RETRIES = 2;      // solo se la connessione non si apre, la richiesta non è partita
+    static const int POOL_RETRY_BACKOFF = 100;      // ms, raddoppia a ogni tentativo
+    static const int POOL_BUSY_RETRIES = 5;         // attese di una connessione libera con il pool tutto occupato
+    static const int POOL_BUSY_WAIT = 20;           // ms tra un'attesa e l'altra
+    static const int BREAKER_FAILURES = 3;
+    static const int BREAKER_COOLDOWN = 5000;       // ms, raddoppia a ogni prova fallita
+    static const int BREAKER_MAX_COOLDOWN = 60000;
     
     // System Timing
     static const int SETUP_DELAY = 1000;
@@ -28,6 +28,8 @@ void SerialController::printMainMenu(bool wifiConnected, int deviceCount, bool a
     Serial.println("║  5. 📊 Status sistema                 ║");
     Serial.println("║  6. 🔄 Reset configurazione           ║");
     Serial.println("║  7. 🎤 Riavvia Alexa                  ║");
+    Serial.println("║  8. ⏱️ Latenze comandi                 ║");
+    Serial.println("║  9. 📤 Esporta latenze                ║");
     Serial.println("║  0. 👋 Modalità silenziosa            ║");
     Serial.println("╚═══════════════════════════════════════╝");
 }
@@ -67,6 +69,114 @@ void SerialController::printAlexaCustomResponse(const String& url, bool success,
     }
 }
 
+void SerialController::printAlexaStats(unsigned long connections, unsigned long requests, unsigned long reused) {
+    Serial.println("🔌 Server Alexa:");
+    Serial.printf("   Connessioni: %lu\n", connections);
+    Serial.printf("   Richieste: %lu (riuso connessione: %lu)\n", requests, reused);
+}
+
+void SerialController::printAlexaClients(int active, int capacity, unsigned long rejected, unsigned long evicted) {
+    Serial.printf("   Client attivi: %d/%d (rifiutati: %lu, chiusi per inattività: %lu)\n",
+                  active, capacity, rejected, evicted);
+}
+
+void SerialController::printAlexaResponses(unsigned long responses, unsigned long segments, unsigned long failed) {
+    if (responses == 0 && failed == 0) return;
+    Serial.printf("   Risposte: %lu in %lu segmenti TCP (%.2f per risposta, non inviate: %lu)\n",
+                  responses, segments, (float)segments / (responses ? responses : 1), failed);
+}
+
+void SerialController::printAlexaQueue(int depth, int peakDepth, int capacity, int held,
+                                       unsigned long executed, unsigned long dropped, unsigned long merged) {
+    Serial.printf("   Coda comandi: %d/%d (picco %d), in debounce: %d\n", depth, capacity, peakDepth, held);
+    Serial.printf("   Comandi eseguiti: %lu, accorpati: %lu, scartati: %lu\n", executed, merged, dropped);
+}
+
+void SerialController::printAlexaTimings(unsigned long avgWait, unsigned long maxWait, unsigned long avgExec, unsigned long maxExec) {
+    Serial.printf("   Attesa in coda: media %lu ms, max %lu ms | Esecuzione: media %lu ms, max %lu ms\n",
+                  avgWait, maxWait, avgExec, maxExec);
+}
+
+void SerialController::printAlexaPool(unsigned long opened, unsigned long reused, unsigned long retried, unsigned long pipelined,
+                                      unsigned long busy) {
+    Serial.printf("   Connessioni verso i dispositivi: %lu aperte, %lu richieste riusate, %lu riaperte, %lu in pipeline, %lu senza connessione libera\n",
+                  opened, reused, retried, pipelined, busy);
+}
+
+void SerialController::printAlexaEvents(unsigned long high, unsigned long highAvgWait, unsigned long highMaxWait,
+                                        unsigned long normal, unsigned long normalAvgWait, unsigned long normalMaxWait, unsigned long forced) {
+    Serial.printf("   Eventi TCP prioritari: %lu, attesa media %lu µs, max %lu µs\n", high, highAvgWait, highMaxWait);
+    Serial.printf("   Eventi TCP normali: %lu, attesa media %lu µs, max %lu µs (passati dopo un burst: %lu)\n",
+                  normal, normalAvgWait, normalMaxWait, forced);
+}
+
+void SerialController::printAlexaDns(unsigned long hits, unsigned long negativeHits, unsigned long misses,
+                                     unsigned long failures, int entries) {
+    Serial.printf("   Cache DNS: %lu risolti dalla cache, %lu errori dalla cache, %lu richieste al DNS (%lu fallite), %d nomi\n",
+                  hits, negativeHits, misses, failures, entries);
+}
+
+void SerialController::printAlexaTarget(const char* host, uint16_t port, bool open, bool probing, unsigned long retryIn,
+                                        unsigned long timeout, unsigned long latency, unsigned long successes,
+                                        unsigned long failures, unsigned long fastFailed) {
+    if (open) {
+        Serial.printf("   🔴 %s:%u non raggiungibile, nuova prova tra %lu s\n", host, port, (retryIn + 999) / 1000);
+    } else if (probing) {
+        Serial.printf("   🟡 %s:%u in prova\n", host, port);
+    } else {
+        Serial.printf("   🟢 %s:%u attivo\n", host, port);
+    }
+    Serial.printf("      Latenza media %lu ms, timeout %lu ms | %lu ok, %lu errori, %lu rifiutati subito\n",
+                  latency, timeout, successes, failures, fastFailed);
+}
+
+void SerialController::printAlexaCircuitOpen(const char* host) {
+    Serial.printf("⛔ %s non raggiungibile, comando non inviato\n", host);
+}
+
+void SerialController::printAlexaBridges(int bridges, int firstPort) {
+    if (bridges > 1) {
+        Serial.printf("🌉 Bridge virtuali: %d (porte %d-%d)\n", bridges, firstPort, firstPort + bridges - 1);
+    }
+}
+
+void SerialController::printAlexaRequester(const String& ip, unsigned long searches, unsigned long responses, unsigned long coalesced) {
+    Serial.printf("   Discovery %s: %lu ricerche, %lu risposte, %lu accorpate\n",
+                  ip.c_str(), searches, responses, coalesced);
+}
+
+void SerialController::printAlexaRollback(const String& deviceName, bool state) {
+    Serial.printf("↩️ Comando fallito, Alexa: '%s' torna %s\n", deviceName.c_str(), state ? "ON" : "OFF");
+}
+
+void SerialController::printAlexaDeviceHealth(const String& deviceName, unsigned long successes, unsigned long failures,
+                                              unsigned long rollbacks, int lastCode) {
+    Serial.printf("   💡 %s: %lu ok, %lu falliti, %lu ripristinati (ultimo codice %d)\n",
+                  deviceName.c_str(), successes, failures, rollbacks, lastCode);
+}
+
+void SerialController::printAlexaMemory(size_t tableBytes, size_t namesUsed, size_t namesSize, size_t cacheBytes) {
+    Serial.printf("   Memoria dispositivi: %u B tabella, %u/%u B nomi, %u B cache JSON\n",
+                  (unsigned)tableBytes, (unsigned)namesUsed, (unsigned)namesSize, (unsigned)cacheBytes);
+}
+
+void SerialController::printLatencyHeader() {
+    Serial.println("\n⏱️ Latenze comandi Alexa (us):");
+    Serial.println("==========================");
+    Serial.printf("   %-11s %8s %9s %9s %9s %9s\n", "tratta", "campioni", "p50", "p95", "p99", "max");
+}
+
+void SerialController::printLatencyStage(const char* name, uint32_t count, uint32_t p50, uint32_t p95, uint32_t p99, uint32_t max) {
+    Serial.printf("   %-11s %8u %9u %9u %9u %9u\n", name,
+                  (unsigned)count, (unsigned)p50, (unsigned)p95, (unsigned)p99, (unsigned)max);
+}
+
+void SerialController::printLatencyExport(const String& text) {
+    Serial.println("\n📤 --- INIZIO LATENZE ---");
+    Serial.print(text);
+    Serial.println("📤 --- FINE LATENZE ---");
+}
+
 void SerialController::printWiFiNetworks(int networkCount) {
     Serial.println("\n📋 Reti WiFi disponibili:");
     Serial.println("==========================");
@@ -101,6 +211,10 @@ void SerialController::printDevice(int index, const String& name, bool isCustomU
     }
 }
 
+void SerialController::printGroupDevice(int index, const String& name, const String& members) {
+    Serial.printf("%2d. %-20s -> 👥 %s\n", index + 1, name.c_str(), members.c_str());
+}
+
 void SerialController::promptWiFiSelection(int maxOption) {
     Serial.printf("\n🔢 Scegli rete (1-%d) o 0 per annullare:\n", maxOption);
     Serial.print("👉 ");
@@ -111,7 +225,7 @@ void SerialController::promptPassword() {
 }
 
 void SerialController::promptMenuOption() {
-    Serial.print("👉 Scegli opzione (0-7): ");
+    Serial.print("👉 Scegli opzione (0-9): ");
 }
 
 void SerialController::promptDeviceName() {
@@ -122,8 +236,9 @@ void SerialController::promptDeviceType() {
     Serial.println("🔧 Tipo controllo:");
     Serial.println("   1. Standard (Pin ESP)");
     Serial.println("   2. Custom (URL)");
+    Serial.println("   3. Gruppo / scena (più dispositivi o URL)");
     Serial.println("   0. Annulla");
-    Serial.print("👉 Scegli (1/2/0): ");
+    Serial.print("👉 Scegli (1/2/3/0): ");
 }
 
 void SerialController::promptDevicePin(int minPin, int maxPin) {
@@ -134,6 +249,11 @@ void SerialController::promptDeviceURL() {
     Serial.print("🌐 URL completo o 0 per annullare: ");
 }
 
+void SerialController::promptGroupMembers(int maxMembers) {
+    Serial.printf("👥 Membri separati da ';' (nomi dispositivi o URL, max %d) o 0 per annullare:\n", maxMembers);
+    Serial.print("👉 ");
+}
+
 void SerialController::promptRemoveDevice() {
     Serial.print("👉 Nome dispositivo da rimuovere (0=annulla): ");
 }
@@ -26,6 +26,7 @@ public:
     // Device Messages
     void printDeviceList(int deviceCount);
     void printDevice(int index, const String& name, bool isCustomUrl, int pin, const String& url);
+    void printGroupDevice(int index, const String& name, const String& members);
     void printDeviceAction(const String& action, const String& name);
     
     // Alexa Messages
@@ -36,6 +37,32 @@ public:
     void printAlexaCommand(const String& deviceName, bool state);
     void printAlexaResponse(int pin, bool success, int httpCode);
     void printAlexaCustomResponse(const String& url, bool success, int httpCode, const String& response = "");
+    void printAlexaStats(unsigned long connections, unsigned long requests, unsigned long reused);
+    void printAlexaClients(int active, int capacity, unsigned long rejected, unsigned long evicted);
+    void printAlexaResponses(unsigned long responses, unsigned long segments, unsigned long failed);
+    void printAlexaBridges(int bridges, int firstPort);
+    void printAlexaQueue(int depth, int peakDepth, int capacity, int held,
+                         unsigned long executed, unsigned long dropped, unsigned long merged);
+    void printAlexaPool(unsigned long opened, unsigned long reused, unsigned long retried, unsigned long pipelined,
+                        unsigned long busy);
+    void printAlexaEvents(unsigned long high, unsigned long highAvgWait, unsigned long highMaxWait,
+                          unsigned long normal, unsigned long normalAvgWait, unsigned long normalMaxWait, unsigned long forced);
+    void printAlexaDns(unsigned long hits, unsigned long negativeHits, unsigned long misses, unsigned long failures, int entries);
+    void printAlexaTarget(const char* host, uint16_t port, bool open, bool probing, unsigned long retryIn,
+                          unsigned long timeout, unsigned long latency, unsigned long successes,
+                          unsigned long failures, unsigned long fastFailed);
+    void printAlexaCircuitOpen(const char* host);
+    void printAlexaTimings(unsigned long avgWait, unsigned long maxWait, unsigned long avgExec, unsigned long maxExec);
+    void printAlexaRequester(const String& ip, unsigned long searches, unsigned long responses, unsigned long coalesced);
+    void printAlexaRollback(const String& deviceName, bool state);
+    void printAlexaDeviceHealth(const String& deviceName, unsigned long successes, unsigned long failures,
+                                unsigned long rollbacks, int lastCode);
+    void printAlexaMemory(size_t tableBytes, size_t namesUsed, size_t namesSize, size_t cacheBytes);
+    
+    // Latency Messages
+    void printLatencyHeader();
+    void printLatencyStage(const char* name, uint32_t count, uint32_t p50, uint32_t p95, uint32_t p99, uint32_t max);
+    void printLatencyExport(const String& text);
     
     // Input Prompts - usando il formato del sistema funzionante
     void promptWiFiSelection(int maxOption);
@@ -44,6 +71,7 @@ public:
     void promptDeviceType();
     void promptDevicePin(int minPin, int maxPin);
     void promptDeviceURL();
+    void promptGroupMembers(int maxMembers);
     void promptRemoveDevice();
     void promptResetConfirm();
     void promptMenuOption();
@@ -32,7 +32,7 @@ PROGMEM const char FAUXMO_TCP_HEADERS[] =
     "HTTP/1.1 %s\r\n"
     "Content-Type: %s\r\n"
     "Content-Length: %d\r\n"
-    "Connection: close\r\n\r\n";
+    "Connection: %s\r\n\r\n";
 
 PROGMEM const char FAUXMO_TCP_STATE_RESPONSE[] = "["
     "{\"success\":{\"/lights/%d/state/on\":%s}}"
@@ -0,0 +1,77 @@
+// Host benchmarks: wall time per operation and heap allocations per operation.
+// Include from exactly one file per benchmark, it replaces the allocator hooks.
+// Figures are for the host CPU; use them to compare builds, not as ESP32 timings.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <new>
+
+namespace bench {
+
+    static uint64_t allocations = 0;
+    static uint64_t allocatedBytes = 0;
+
+    // Keeps the optimizer from dropping work whose result is unused
+    template <typename T> inline void keep(T const & value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Calls body() iterations times and prints ns/op, ops/s and allocations/op
+    template <typename Body> void run(const char * name, unsigned long iterations, Body body) {
+        for (unsigned long i = 0; i < iterations / 10 + 1; i++) body(); // warm up
+        uint64_t allocationsBefore = allocations;
+        uint64_t bytesBefore = allocatedBytes;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++) body();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("%-36s %10.1f ns/op %12.0f op/s %8.2f allocs/op %8.1f B/op\n",
+            name, ns / iterations, iterations * 1e9 / ns,
+            (double) (allocations - allocationsBefore) / iterations,
+            (double) (allocatedBytes - bytesBefore) / iterations);
+    }
+
+}
+
+// The bench build links with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// so C allocations in the code under test are counted too
+extern "C" {
+    void * __real_malloc(size_t size);
+    void * __real_calloc(size_t count, size_t size);
+    void * __real_realloc(void * pointer, size_t size);
+
+    void * __wrap_malloc(size_t size) {
+        bench::allocations++;
+        bench::allocatedBytes += size;
+        return __real_malloc(size);
+    }
+
+    void * __wrap_calloc(size_t count, size_t size) {
+        bench::allocations++;
+        bench::allocatedBytes += count * size;
+        return __real_calloc(count, size);
+    }
+
+    void * __wrap_realloc(void * pointer, size_t size) {
+        bench::allocations++;
+        bench::allocatedBytes += size;
+        return __real_realloc(pointer, size);
+    }
+}
+
+void * operator new(size_t size) {
+    void * pointer = __wrap_malloc(size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void * pointer) noexcept { free(pointer); }
+void operator delete[](void * pointer) noexcept { free(pointer); }
+void operator delete(void * pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void * pointer, size_t) noexcept { free(pointer); }
@@ -0,0 +1,83 @@
+// Conversions per second of colors.h, next to the float functions it
+// replaced (which returned a new byte[3] per call that was never freed)
+#include <Arduino.h>
+#include "colors.h"
+#include "bench.h"
+
+static byte * legacyHs2rgb(uint16_t hue, uint8_t sat) {
+    byte * rgb = new byte[3]{0, 0, 0};
+    float h = ((float) hue) / 65535.0;
+    float s = ((float) sat) / 255.0;
+    byte i = floor(h * 6);
+    float f = h * 6 - i;
+    float p = 255 * (1 - s);
+    float q = 255 * (1 - f * s);
+    float t = 255 * (1 - (1 - f) * s);
+    switch (i % 6) {
+        case 0: rgb[0] = 255, rgb[1] = t, rgb[2] = p; break;
+        case 1: rgb[0] = q, rgb[1] = 255, rgb[2] = p; break;
+        case 2: rgb[0] = p, rgb[1] = 255, rgb[2] = t; break;
+        case 3: rgb[0] = p, rgb[1] = q, rgb[2] = 255; break;
+        case 4: rgb[0] = t, rgb[1] = p, rgb[2] = 255; break;
+        case 5: rgb[0] = 255, rgb[1] = p, rgb[2] = q;
+    }
+    return rgb;
+}
+
+static byte * legacyCt2rgb(uint16_t ct) {
+    byte * rgb = new byte[3]{0, 0, 0};
+    float temp = 10000 / ct;
+    float r, g, b;
+    if (temp <= 66) {
+        r = 255;
+        g = 99.470802 * log(temp) - 161.119568;
+        b = (temp <= 19) ? 0 : 138.517731 * log(temp - 10) - 305.044793;
+    } else {
+        r = 329.698727 * pow(temp - 60, -0.13320476);
+        g = 288.12217 * pow(temp - 60, -0.07551485);
+        b = 255;
+    }
+    rgb[0] = (byte) constrain(r, 0.1, 255.1);
+    rgb[1] = (byte) constrain(g, 0.1, 255.1);
+    rgb[2] = (byte) constrain(b, 0.1, 255.1);
+    return rgb;
+}
+
+int main() {
+    const unsigned long iterations = 20000000;
+    byte rgb[3];
+    uint32_t i = 0;
+
+    printf("host build (not ESP32 timings)\n");
+
+    bench::run("fauxmoesp_hs2rgb", iterations, [&] {
+        i++;
+        fauxmoesp_hs2rgb(i * 7919, i, rgb);
+        bench::keep(rgb);
+    });
+    bench::run("fauxmoesp_ct2rgb", iterations, [&] {
+        i++;
+        fauxmoesp_ct2rgb(FAUXMO_CT_MIN + i % 348, rgb);
+        bench::keep(rgb);
+    });
+    bench::run("fauxmoesp_xy2rgb", iterations, [&] {
+        i++;
+        fauxmoesp_xy2rgb(i & 8191, 500 + ((i >> 3) & 4095), rgb);
+        bench::keep(rgb);
+    });
+
+    // Freed here so the run does not exhaust the host; on the board they leaked
+    bench::run("float hs2rgb (previous)", iterations / 10, [&] {
+        i++;
+        byte * legacy = legacyHs2rgb(i * 7919, i);
+        bench::keep(legacy[0]);
+        delete[] legacy;
+    });
+    bench::run("float ct2rgb (previous)", iterations / 10, [&] {
+        i++;
+        byte * legacy = legacyCt2rgb(FAUXMO_CT_MIN + i % 348);
+        bench::keep(legacy[0]);
+        delete[] legacy;
+    });
+    return 0;
+}
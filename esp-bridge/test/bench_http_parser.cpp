@@ -0,0 +1,89 @@
+// Throughput and heap use of the Hue request path, from the first byte of a
+// request to the response handed to the client, on requests captured from an Echo
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#define private public
+#include "fauxmoESP.h"
+#undef private
+#include "bench.h"
+#include "host.h"
+
+static const char * STATE_PUT =
+    "PUT /api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights/7/state HTTP/1.1\r\n"
+    "Host: 192.168.1.10\r\n"
+    "Accept: */*\r\n"
+    "Content-type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 22\r\n"
+    "\r\n"
+    "{\"on\": true,\"bri\":179}";
+
+static const char * LIGHT_GET =
+    "GET /api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights/7 HTTP/1.1\r\n"
+    "Host: 192.168.1.10\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char * LIST_GET =
+    "GET /api/2WLEDHardQrI3WHYTHoMcXHgEspsM8ZZRpSKtBQr/lights HTTP/1.1\r\n"
+    "Host: 192.168.1.10\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char * DESCRIPTION_GET =
+    "GET /description.xml HTTP/1.1\r\n"
+    "Host: 192.168.1.10:80\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static fauxmoESP fauxmo;
+static AsyncClient client;
+
+// One request on a connection that stays open, acking until a listing is out
+static void serve(const char * request, size_t length) {
+    fauxmoesp_tcp_slot_t * slot = &fauxmo._tcpSlots[0];
+    host::reset(1 << 20);
+    slot->requestCount = 0;
+    slot->closeOnAck = false;
+    fauxmo._onTCPData(&client, 0, request, length);
+    while (slot->listCursor >= 0) fauxmo._onTCPAck(&client, 0);
+}
+
+static void run(const char * name, const char * request, unsigned long iterations) {
+    size_t length = strlen(request);
+    bench::run(name, iterations, [&] { serve(request, length); });
+    if (host::output.compare(0, 12, "HTTP/1.1 200") != 0) {
+        fprintf(stderr, "%s: unexpected response\n%s\n", name, host::output.c_str());
+        exit(1);
+    }
+}
+
+int main() {
+    char name[FAUXMO_DEVICE_NAME_LENGTH];
+    fauxmo._enabled = true;
+    for (int i = 0; i < 20; i++) {
+        snprintf(name, sizeof(name), "luce soggiorno %d", i);
+        fauxmo.addDevice(name);
+    }
+    fauxmo.onSetState([](unsigned char id, const char * name, bool state, unsigned char value) {});
+    fauxmo._onTCPClient(&client);
+    host::output.reserve(1 << 20);
+
+    printf("%d devices, host build (not ESP32 timings)\n", 20);
+    run("PUT /lights/7/state", STATE_PUT, 200000);
+    run("GET /lights/7", LIGHT_GET, 200000);
+    run("GET /lights (20 devices)", LIST_GET, 20000);
+    run("GET /description.xml", DESCRIPTION_GET, 200000);
+
+    // The same PUT split the way lwIP hands over a small MSS
+    size_t length = strlen(STATE_PUT);
+    bench::run("PUT /lights/7/state in 64 B pieces", 200000, [&] {
+        fauxmoesp_tcp_slot_t * slot = &fauxmo._tcpSlots[0];
+        host::reset(1 << 20);
+        slot->requestCount = 0;
+        slot->closeOnAck = false;
+        for (size_t offset = 0; offset < length; offset += 64) {
+            fauxmo._onTCPData(&client, 0, STATE_PUT + offset, min((size_t) 64, length - offset));
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,73 @@
+// _parseState against the indexOf chain _onTCPControl used before it, on the
+// state bodies an Echo sends. Only the extraction is timed, not the response.
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#define private public
+#include "fauxmoESP.h"
+#undef private
+#include "bench.h"
+
+struct legacy_state_t {
+    bool state;
+    unsigned char value;
+    uint16_t hue;
+    uint8_t sat;
+    uint16_t ct;
+};
+
+// The previous code, colour conversion left out: the body arrived as a
+// String, one attribute was honoured and each value went through substring()
+static void legacyParse(String body, legacy_state_t * out) {
+    int pos;
+    if ((pos = body.indexOf("bri")) > 0) {
+        out->value = body.substring(pos + 5).toInt();
+        out->state = (out->value > 0);
+    } else if ((pos = body.indexOf("hue")) > 0) {
+        out->state = true;
+        unsigned int comma = body.indexOf(",", pos);
+        out->hue = body.substring(pos + 5, comma).toInt();
+        pos = body.indexOf("sat", comma);
+        out->sat = body.substring(pos + 5).toInt();
+    } else if ((pos = body.indexOf("ct")) > 0) {
+        out->state = true;
+        out->ct = body.substring(pos + 4).toInt();
+    } else if (body.indexOf("false") > 0) {
+        out->state = false;
+    } else {
+        out->state = true;
+    }
+}
+
+static fauxmoESP fauxmo;
+
+int main() {
+    const char * bodies[][2] = {
+        {"on",          "{\"on\": true}"},
+        {"on+bri",      "{\"on\": true, \"bri\": 179}"},
+        {"hue+sat",     "{\"hue\": 21845, \"sat\": 254}"},
+        {"ct",          "{\"ct\": 366}"},
+        {"xy+bri+tt",   "{\"on\": true, \"bri\": 254, \"xy\": [0.3227, 0.329], \"transitiontime\": 4}"},
+    };
+    char name[64];
+
+    printf("host build (not ESP32 timings)\n");
+    for (auto & body : bodies) {
+        const char * text = body[1];
+        size_t length = strlen(text);
+
+        snprintf(name, sizeof(name), "_parseState %s", body[0]);
+        fauxmoesp_state_t state;
+        bench::run(name, 2000000, [&] {
+            fauxmo._parseState(text, length, &state);
+            bench::keep(state);
+        });
+
+        snprintf(name, sizeof(name), "indexOf chain %s", body[0]);
+        legacy_state_t legacy;
+        bench::run(name, 2000000, [&] {
+            legacyParse(String(text), &legacy);
+            bench::keep(legacy);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+// Minimal assertions for the host tests: first failure prints where and exits
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        long long _a = (long long) (actual), _e = (long long) (expected); \
+        if (_a != _e) { \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define CHECK_STR(actual, expected) do { \
+        const char * _a = (actual), * _e = (expected); \
+        if (!_a || strcmp(_a, _e) != 0) { \
+            fprintf(stderr, "%s:%d: %s == \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, _a ? _a : "(null)", _e); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define RUN(test) do { test(); printf("ok   %s\n", #test); } while (0)
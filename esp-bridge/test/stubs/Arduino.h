@@ -0,0 +1,162 @@
+// Host stand-in for the parts of the Arduino core the sketch uses.
+// Only what the code under test needs, with the ESP32 signatures.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+typedef const char * PGM_P;
+#define strlen_P strlen
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define snprintf_P snprintf
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+
+#define HEX 16
+#define DEC 10
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+long random(long max);
+long random(long min, long max);
+size_t strlcpy(char * dst, const char * src, size_t size);
+
+class String {
+    public:
+        String(const char * s = "") : _s(s ? s : "") {}
+        String(const std::string & s) : _s(s) {}
+        String(int value, unsigned char base = DEC) : _s(_format(base == HEX ? "%x" : "%d", value)) {}
+        String(unsigned int value, unsigned char base = DEC) : _s(_format(base == HEX ? "%x" : "%u", value)) {}
+        String(long value) : _s(_format("%ld", value)) {}
+        String(unsigned long value) : _s(_format("%lu", value)) {}
+        String(unsigned char value) : _s(_format("%u", value)) {}
+        String(float value, unsigned int decimals = 2) : _s(_format("%.*f", decimals, value)) {}
+
+        const char * c_str() const { return _s.c_str(); }
+        unsigned int length() const { return _s.size(); }
+        bool reserve(unsigned int size) { _s.reserve(size); return true; }
+        char charAt(unsigned int i) const { return _s[i]; }
+        char operator[](unsigned int i) const { return _s[i]; }
+
+        int indexOf(char c, unsigned int from = 0) const { return _pos(_s.find(c, from)); }
+        int indexOf(const char * s, unsigned int from = 0) const { return _pos(_s.find(s, from)); }
+        int indexOf(const String & s, unsigned int from = 0) const { return indexOf(s.c_str(), from); }
+        int lastIndexOf(char c) const { return _pos(_s.rfind(c)); }
+        String substring(unsigned int from) const { return String(_s.substr(std::min<size_t>(from, _s.size()))); }
+        String substring(unsigned int from, unsigned int to) const { return from < to ? String(_s.substr(from, to - from)) : String(); }
+        long toInt() const { return atol(_s.c_str()); }
+
+        bool equals(const String & s) const { return _s == s._s; }
+        bool equalsIgnoreCase(const String & s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+        bool startsWith(const String & s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+        bool endsWith(const String & s) const { return (_s.size() >= s._s.size()) && (_s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0); }
+        bool operator==(const String & s) const { return _s == s._s; }
+        bool operator==(const char * s) const { return _s == s; }
+        bool operator!=(const String & s) const { return _s != s._s; }
+
+        void replace(const char * from, const char * to);
+        void toLowerCase() { for (auto & c : _s) c = tolower(c); }
+        void toUpperCase() { for (auto & c : _s) c = toupper(c); }
+        void trim();
+        void remove(unsigned int index) { if (index < _s.size()) _s.erase(index); }
+        void remove(unsigned int index, unsigned int count) { if (index < _s.size()) _s.erase(index, count); }
+        bool concat(const char * s, unsigned int length) { _s.append(s, length); return true; }
+        String & operator+=(const String & s) { _s += s._s; return *this; }
+        String & operator+=(const char * s) { _s += s; return *this; }
+        String & operator+=(char c) { _s += c; return *this; }
+
+        friend String operator+(const String & a, const String & b) { return String(a._s + b._s); }
+        friend String operator+(const String & a, const char * b) { return String(a._s + b); }
+        friend String operator+(const char * a, const String & b) { return String(a + b._s); }
+
+    private:
+        std::string _s;
+
+        static int _pos(size_t p) { return p == std::string::npos ? -1 : (int) p; }
+        template <typename T> static std::string _format(const char * format, T value) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), format, value);
+            return buffer;
+        }
+        static std::string _format(const char * format, unsigned int decimals, float value) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), format, decimals, value);
+            return buffer;
+        }
+};
+
+// Printing goes to stdout, raw writes are collected in hostOutput (see host.h)
+class Print {
+    public:
+        size_t print(const String & s);
+        size_t print(const char * s);
+        size_t print(char c);
+        size_t print(int value);
+        size_t println(const String & s = "");
+        size_t println(const char * s);
+        size_t println(int value);
+        size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+        size_t write(uint8_t c);
+        size_t write(const char * s);
+        size_t write(const uint8_t * data, size_t length);
+};
+
+class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long baud) {}
+        int available() { return 0; }
+        int read() { return -1; }
+};
+extern HardwareSerial Serial;
+
+class IPAddress {
+    public:
+        IPAddress() {}
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _bytes{a, b, c, d} {}
+        IPAddress(uint32_t address) { memcpy(_bytes, &address, 4); }
+        operator uint32_t() const { uint32_t address; memcpy(&address, _bytes, 4); return address; }
+        uint8_t operator[](int i) const { return _bytes[i]; }
+        uint8_t & operator[](int i) { return _bytes[i]; }
+        bool operator==(const IPAddress & ip) const { return memcmp(_bytes, ip._bytes, 4) == 0; }
+        bool operator!=(const IPAddress & ip) const { return !(*this == ip); }
+        bool fromString(const char * address);
+        String toString() const;
+
+    private:
+        uint8_t _bytes[4] = {0, 0, 0, 0};
+};
+
+class EspClass {
+    public:
+        uint32_t getFreeHeap() { return 200000; }
+        uint32_t getMinFreeHeap() { return 150000; }
+        uint32_t getMaxAllocHeap() { return 100000; }
+};
+extern EspClass ESP;
+
+uint32_t esp_random();
+int64_t esp_timer_get_time();
+
+// The ESP32 core pulls FreeRTOS in with Arduino.h
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
@@ -0,0 +1,124 @@
+// Host stand-in for AsyncTCP: clients record what is sent into host::output,
+// servers and UDP sockets only keep the callbacks for the tests to drive.
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+#define ASYNC_PRIORITY_NORMAL 0
+#define ASYNC_PRIORITY_HIGH   1
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void* data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+typedef struct {
+    uint32_t events[2];
+    uint32_t waitAvg[2];
+    uint32_t waitMax[2];
+    uint32_t forced;
+} AsyncQueueStats;
+
+class AsyncClient {
+  public:
+    static AsyncQueueStats getQueueStats() { return AsyncQueueStats(); }
+    static const char* errorToString(int8_t error) { return ""; }
+
+    bool connect(const IPAddress& ip, uint16_t port) { return true; }
+    void close(bool now = false);
+    int8_t abort();
+    bool free() { return true; }
+
+    bool canSend() { return true; }
+    size_t space();
+    size_t add(const char* data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send() { return true; }
+    size_t write(const char* data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    size_t write(const char* head, size_t headSize, const char* body, size_t bodySize, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    size_t write(const char* data) { return write(data, strlen(data)); }
+
+    bool connected() { return true; }
+    uint32_t getRxStamp() { return 0; }
+    uint16_t getTxSegments() { return 1; }
+    void setRxTimeout(uint32_t timeout) {}
+    void setAckTimeout(uint32_t timeout) {}
+    void setNoDelay(bool nodelay) {}
+    void setPriority(uint8_t priority) { _priority = priority; }
+    uint8_t getPriority() const { return _priority; }
+
+    IPAddress remoteIP() { return IPAddress(192, 168, 1, 77); }
+    uint16_t remotePort() { return 4000; }
+    IPAddress localIP() { return IPAddress(192, 168, 1, 10); }
+    uint16_t localPort() { return 80; }
+
+    void onConnect(AcConnectHandler cb, void* arg = 0) {}
+    void onDisconnect(AcConnectHandler cb, void* arg = 0) {}
+    void onAck(AcAckHandler cb, void* arg = 0) {}
+    void onError(AcErrorHandler cb, void* arg = 0) {}
+    void onData(AcDataHandler cb, void* arg = 0) {}
+    void onTimeout(AcTimeoutHandler cb, void* arg = 0) {}
+    void onPoll(AcConnectHandler cb, void* arg = 0) {}
+
+  private:
+    uint8_t _priority = ASYNC_PRIORITY_NORMAL;
+};
+
+class AsyncServer {
+  public:
+    AsyncServer(uint16_t port) {}
+    void onClient(AcConnectHandler cb, void* arg) {}
+    void begin() {}
+    void end() {}
+    void setNoDelay(bool nodelay) {}
+};
+
+class AsyncUDPSocket;
+
+typedef std::function<void(void*, AsyncUDPSocket*, const IPAddress& ip, uint16_t port, const uint8_t* data, size_t len)> AcUdpPacketHandler;
+typedef std::function<void(void*, AsyncUDPSocket*)> AcUdpTimerHandler;
+
+class AsyncUDPSocket {
+  public:
+    bool listenMulticast(const IPAddress& group, uint16_t port) { return true; }
+    void close() {}
+    bool listening() { return true; }
+    size_t writeTo(const uint8_t* data, size_t len, const IPAddress& ip, uint16_t port) {
+      sent++;
+      return len;
+    }
+
+    void onPacket(AcUdpPacketHandler cb, void* arg = 0) { packet = cb; }
+    void onTimer(AcUdpTimerHandler cb, void* arg = 0) { timer = cb; }
+    bool setTimer(uint32_t ms) {
+      timerMs = ms;
+      return true;
+    }
+
+    AcUdpPacketHandler packet;
+    AcUdpTimerHandler timer;
+    uint32_t timerMs = 0; // last setTimer()
+    int sent = 0;         // writeTo() calls
+};
+
+typedef struct {
+    uint32_t hits;
+    uint32_t negativeHits;
+    uint32_t misses;
+    uint32_t failures;
+    uint8_t entries;
+} AsyncDNSCacheStats;
+
+class AsyncDNSCache {
+  public:
+    // weak in the stubs, tests that need a resolver define their own
+    static bool resolve(const char* host, IPAddress& ip, uint32_t timeout = 5000);
+    static AsyncDNSCacheStats stats() { return AsyncDNSCacheStats(); }
+    static void clear() {}
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <WiFi.h>
+
+// Weak in network.cpp, tests that go through HTTPClient define their own
+class HTTPClient {
+    public:
+        bool begin(String url);
+        bool begin(WiFiClient & client, String url);
+        void setTimeout(int timeout);
+        void setConnectTimeout(int timeout);
+        void setReuse(bool reuse);
+        int GET();
+        String getString();
+        void end();
+};
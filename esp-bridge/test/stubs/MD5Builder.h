@@ -0,0 +1,12 @@
+#pragma once
+
+#include <Arduino.h>
+
+// The bridge id only needs to be stable on the host, not a real digest
+class MD5Builder {
+    public:
+        void begin() {}
+        void add(String data) {}
+        void calculate() {}
+        void getBytes(uint8_t * bytes) { memset(bytes, 0, 16); }
+};
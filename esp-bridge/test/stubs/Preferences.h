@@ -0,0 +1,19 @@
+// Host stand-in for the NVS Preferences: one in-memory store shared by every namespace
+#pragma once
+
+#include <Arduino.h>
+
+class Preferences {
+    public:
+        bool begin(const char * name, bool readOnly = false) { return true; }
+        void end() {}
+        bool clear();
+        bool remove(const char * key);
+        bool isKey(const char * key);
+        size_t putInt(const char * key, int32_t value);
+        int32_t getInt(const char * key, int32_t defaultValue = 0);
+        size_t putBool(const char * key, bool value);
+        bool getBool(const char * key, bool defaultValue = false);
+        size_t putString(const char * key, const String & value);
+        String getString(const char * key, const String & defaultValue = String());
+};
@@ -0,0 +1,47 @@
+// Host stand-in for the ESP32 WiFi library: always connected, scans find nothing
+#pragma once
+
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+#define WIFI_STA 1
+#define WIFI_AUTH_OPEN 0
+
+class WiFiClass {
+    public:
+        IPAddress localIP() { return IPAddress(192, 168, 1, 10); }
+        String macAddress() { return "AA:BB:CC:DD:EE:FF"; }
+        String SSID() { return "test"; }
+        String SSID(int i) { return ""; }
+        int RSSI() { return -50; }
+        int RSSI(int i) { return 0; }
+        int encryptionType(int i) { return WIFI_AUTH_OPEN; }
+        int status() { return WL_CONNECTED; }
+        void mode(int mode) {}
+        void begin(const char * ssid, const char * password) {}
+        void disconnect() {}
+        int scanNetworks() { return 0; }
+        void scanDelete() {}
+};
+extern WiFiClass WiFi;
+
+// Synchronous client used by HTTPClient and the connection pool.
+// Every method is weak in network.cpp, tests script their own server.
+class WiFiClient {
+    public:
+        int connect(IPAddress ip, uint16_t port);
+        int connect(IPAddress ip, uint16_t port, int32_t timeout);
+        int connect(const char * host, uint16_t port);
+        int connect(const char * host, uint16_t port, int32_t timeout);
+        size_t write(const uint8_t * data, size_t size);
+        int available();
+        int read();
+        int read(uint8_t * buffer, size_t size);
+        bool connected();
+        void stop();
+        void setTimeout(int timeout);
+        void setNoDelay(bool nodelay);
+        operator bool();
+        String readStringUntil(char terminator);
+};
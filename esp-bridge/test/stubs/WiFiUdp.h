@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Only for the non ESP32 SSDP path, which the host build does not use
+class WiFiUDP : public Print {
+    public:
+        int parsePacket() { return 0; }
+        int read(unsigned char * buffer, size_t size) { return 0; }
+        IPAddress remoteIP() { return IPAddress(192, 168, 1, 50); }
+        uint16_t remotePort() { return 5000; }
+        int beginPacket(IPAddress ip, uint16_t port) { return 1; }
+        int endPacket() { return 1; }
+        int beginMulticast(IPAddress ip, uint16_t port) { return 1; }
+        int beginMulticast(IPAddress interface, IPAddress ip, uint16_t port) { return 1; }
+        void stop() {}
+};
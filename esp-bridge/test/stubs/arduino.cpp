@@ -0,0 +1,141 @@
+// Arduino core on the host: time from steady_clock, Serial on stdout
+#include <Arduino.h>
+#include <stdarg.h>
+#include <chrono>
+#include <thread>
+#include "host.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace host {
+
+    std::string output;
+    size_t space = 5744;
+    int gathers = 0;
+
+    void reset(size_t room) {
+        output.clear();
+        space = room;
+        gathers = 0;
+    }
+
+}
+
+unsigned long millis() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned long micros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t esp_timer_get_time() {
+    return micros();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+long random(long max) {
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+    return min + random(max - min);
+}
+
+uint32_t esp_random() {
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+size_t strlcpy(char * dst, const char * src, size_t size) {
+    size_t length = strlen(src);
+    if (size) {
+        size_t copy = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = 0;
+    }
+    return length;
+}
+
+// -----------------------------------------------------------------------------
+// String
+// -----------------------------------------------------------------------------
+
+void String::replace(const char * from, const char * to) {
+    size_t length = strlen(from);
+    if (!length) return;
+    size_t position = 0;
+    while ((position = _s.find(from, position)) != std::string::npos) {
+        _s.replace(position, length, to);
+        position += strlen(to);
+    }
+}
+
+void String::trim() {
+    size_t first = _s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        _s.clear();
+        return;
+    }
+    size_t last = _s.find_last_not_of(" \t\r\n");
+    _s = _s.substr(first, last - first + 1);
+}
+
+// -----------------------------------------------------------------------------
+// Print
+// -----------------------------------------------------------------------------
+
+size_t Print::print(const String & s) { return fputs(s.c_str(), stdout); }
+size_t Print::print(const char * s) { return fputs(s, stdout); }
+size_t Print::print(char c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+size_t Print::print(int value) { return ::printf("%d", value); }
+size_t Print::println(const String & s) { return ::printf("%s\n", s.c_str()); }
+size_t Print::println(const char * s) { return ::printf("%s\n", s); }
+size_t Print::println(int value) { return ::printf("%d\n", value); }
+
+size_t Print::printf(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n < 0 ? 0 : n;
+}
+
+size_t Print::write(uint8_t c) {
+    host::output += (char) c;
+    return 1;
+}
+
+size_t Print::write(const char * s) {
+    host::output += s;
+    return strlen(s);
+}
+
+size_t Print::write(const uint8_t * data, size_t length) {
+    host::output.append((const char *) data, length);
+    return length;
+}
+
+// -----------------------------------------------------------------------------
+// IPAddress
+// -----------------------------------------------------------------------------
+
+bool IPAddress::fromString(const char * address) {
+    unsigned int a, b, c, d;
+    char tail;
+    if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) return false;
+    if ((a | b | c | d) > 255) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+}
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+    return String(buffer);
+}
@@ -0,0 +1,24 @@
+// Host stand-in for FreeRTOS: types and constants, backed by std threads in rtos.cpp
+#pragma once
+
+#include <stdint.h>
+
+typedef void * TaskHandle_t;
+typedef void * QueueHandle_t;
+typedef void * SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdPASS 1
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffUL
+#define pdMS_TO_TICKS(ms) (ms)
+#define portTICK_PERIOD_MS 1
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void portENTER_CRITICAL(portMUX_TYPE * mux);
+void portEXIT_CRITICAL(portMUX_TYPE * mux);
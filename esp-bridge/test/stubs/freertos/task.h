@@ -0,0 +1,11 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char * name, uint32_t stack, void * arg, UBaseType_t priority, TaskHandle_t * handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char * name, uint32_t stack, void * arg, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
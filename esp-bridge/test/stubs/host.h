@@ -0,0 +1,20 @@
+// What the stubs record, for the tests to look at
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+namespace host {
+
+    // Bytes the code wrote to clients and Print objects, plus <CLOSE>/<ABORT> markers
+    extern std::string output;
+
+    // Room left in the TCP send buffer, as seen by AsyncClient::space() and add()
+    extern size_t space;
+
+    // Two part AsyncClient::write() calls (header and body in one segment)
+    extern int gathers;
+
+    void reset(size_t space = 5744);
+
+}
@@ -0,0 +1,131 @@
+// Network side of the stubs. AsyncClient writes land in host::output; the
+// synchronous clients are weak so a test can replace them with a scripted peer.
+#include <AsyncTCP.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <map>
+#include "host.h"
+
+#define WEAK __attribute__((weak))
+
+WiFiClass WiFi;
+
+// -----------------------------------------------------------------------------
+// AsyncClient
+// -----------------------------------------------------------------------------
+
+void AsyncClient::close(bool now) {
+    host::output += "<CLOSE>";
+}
+
+int8_t AsyncClient::abort() {
+    host::output += "<ABORT>";
+    return -13; // ERR_ABRT
+}
+
+size_t AsyncClient::space() {
+    return host::space;
+}
+
+size_t AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
+    if (size > host::space) size = host::space;
+    host::output.append(data, size);
+    host::space -= size;
+    return size;
+}
+
+size_t AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
+    host::output.append(data, size);
+    return size;
+}
+
+size_t AsyncClient::write(const char* head, size_t headSize, const char* body, size_t bodySize, uint8_t apiflags) {
+    if (headSize + bodySize > host::space) return 0;
+    host::gathers++;
+    host::output.append(head, headSize);
+    host::output.append(body, bodySize);
+    host::space -= headSize + bodySize;
+    return headSize + bodySize;
+}
+
+WEAK bool AsyncDNSCache::resolve(const char* host, IPAddress& ip, uint32_t timeout) {
+    return ip.fromString(host);
+}
+
+// -----------------------------------------------------------------------------
+// WiFiClient, HTTPClient: nobody answers unless the test says otherwise
+// -----------------------------------------------------------------------------
+
+WEAK int WiFiClient::connect(IPAddress ip, uint16_t port) { return 0; }
+WEAK int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) { return connect(ip, port); }
+WEAK int WiFiClient::connect(const char * host, uint16_t port) { return 0; }
+WEAK int WiFiClient::connect(const char * host, uint16_t port, int32_t timeout) { return connect(host, port); }
+WEAK size_t WiFiClient::write(const uint8_t * data, size_t size) { return 0; }
+WEAK int WiFiClient::available() { return 0; }
+WEAK int WiFiClient::read() { return -1; }
+WEAK int WiFiClient::read(uint8_t * buffer, size_t size) { return -1; }
+WEAK bool WiFiClient::connected() { return false; }
+WEAK void WiFiClient::stop() {}
+WEAK void WiFiClient::setTimeout(int timeout) {}
+WEAK void WiFiClient::setNoDelay(bool nodelay) {}
+WEAK WiFiClient::operator bool() { return connected(); }
+WEAK String WiFiClient::readStringUntil(char terminator) { return ""; }
+
+WEAK bool HTTPClient::begin(String url) { return true; }
+WEAK bool HTTPClient::begin(WiFiClient & client, String url) { return true; }
+WEAK void HTTPClient::setTimeout(int timeout) {}
+WEAK void HTTPClient::setConnectTimeout(int timeout) {}
+WEAK void HTTPClient::setReuse(bool reuse) {}
+WEAK int HTTPClient::GET() { return 200; }
+WEAK String HTTPClient::getString() { return ""; }
+WEAK void HTTPClient::end() {}
+
+// -----------------------------------------------------------------------------
+// Preferences
+// -----------------------------------------------------------------------------
+
+static std::map<std::string, std::string> & store() {
+    static std::map<std::string, std::string> values;
+    return values;
+}
+
+bool Preferences::clear() {
+    store().clear();
+    return true;
+}
+
+bool Preferences::remove(const char * key) {
+    return store().erase(key) > 0;
+}
+
+bool Preferences::isKey(const char * key) {
+    return store().count(key) > 0;
+}
+
+size_t Preferences::putInt(const char * key, int32_t value) {
+    store()[key] = std::to_string(value);
+    return sizeof(value);
+}
+
+int32_t Preferences::getInt(const char * key, int32_t defaultValue) {
+    return isKey(key) ? atoi(store()[key].c_str()) : defaultValue;
+}
+
+size_t Preferences::putBool(const char * key, bool value) {
+    store()[key] = value ? "1" : "0";
+    return 1;
+}
+
+bool Preferences::getBool(const char * key, bool defaultValue) {
+    return isKey(key) ? store()[key] == "1" : defaultValue;
+}
+
+size_t Preferences::putString(const char * key, const String & value) {
+    store()[key] = value.c_str();
+    return value.length();
+}
+
+String Preferences::getString(const char * key, const String & defaultValue) {
+    return isKey(key) ? String(store()[key]) : defaultValue;
+}
@@ -0,0 +1,156 @@
+// FreeRTOS on std threads: queues, tasks, mutexes and task notifications
+// behave like the real ones as far as the controllers can tell.
+#include <Arduino.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+
+// -----------------------------------------------------------------------------
+// Queues
+// -----------------------------------------------------------------------------
+
+struct HostQueue {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> items;
+    size_t length;
+    size_t itemSize;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    HostQueue * queue = new HostQueue;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+static BaseType_t _put(QueueHandle_t handle, const void * item, bool front) {
+    HostQueue * queue = (HostQueue *) handle;
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->items.size() >= queue->length) return pdFALSE;
+    std::vector<char> copy((const char *) item, (const char *) item + queue->itemSize);
+    if (front) {
+        queue->items.push_front(std::move(copy));
+    } else {
+        queue->items.push_back(std::move(copy));
+    }
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+static BaseType_t _get(QueueHandle_t handle, void * item, TickType_t wait, bool remove) {
+    HostQueue * queue = (HostQueue *) handle;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue] { return !queue->items.empty(); };
+    if (wait == portMAX_DELAY) {
+        queue->changed.wait(lock, ready);
+    } else {
+        queue->changed.wait_for(lock, milliseconds(wait), ready);
+    }
+    if (queue->items.empty()) return pdFALSE;
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    if (remove) queue->items.pop_front();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t wait) { return _put(queue, item, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void * item, TickType_t wait) { return _put(queue, item, true); }
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t wait) { return _get(queue, item, wait, true); }
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t wait) { return _get(queue, item, wait, false); }
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    HostQueue * queue = (HostQueue *) handle;
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t handle) {
+    HostQueue * queue = (HostQueue *) handle;
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->items.size();
+}
+
+// -----------------------------------------------------------------------------
+// Tasks and notifications
+// -----------------------------------------------------------------------------
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char * name, uint32_t stack, void * arg, UBaseType_t priority, TaskHandle_t * handle) {
+    std::thread(task, arg).detach();
+    if (handle) *handle = (TaskHandle_t) 1;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char * name, uint32_t stack, void * arg, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core) {
+    return xTaskCreate(task, name, stack, arg, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(milliseconds(ticks));
+}
+
+void vTaskDelete(TaskHandle_t task) {}
+
+struct HostNotification {
+    std::mutex mutex;
+    std::condition_variable given;
+    uint32_t count = 0;
+};
+
+static thread_local HostNotification _notification;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return &_notification;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    HostNotification * notification = (HostNotification *) task;
+    std::lock_guard<std::mutex> lock(notification->mutex);
+    notification->count++;
+    notification->given.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    HostNotification * notification = &_notification;
+    std::unique_lock<std::mutex> lock(notification->mutex);
+    auto ready = [notification] { return notification->count > 0; };
+    if (wait == portMAX_DELAY) {
+        notification->given.wait(lock, ready);
+    } else {
+        notification->given.wait_for(lock, milliseconds(wait), ready);
+    }
+    uint32_t count = notification->count;
+    if (count) notification->count = clear ? 0 : count - 1;
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// Mutexes and critical sections
+// -----------------------------------------------------------------------------
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new std::recursive_timed_mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    auto mutex = (std::recursive_timed_mutex *) semaphore;
+    if (wait == portMAX_DELAY) {
+        mutex->lock();
+        return pdTRUE;
+    }
+    return mutex->try_lock_for(milliseconds(wait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    ((std::recursive_timed_mutex *) semaphore)->unlock();
+    return pdTRUE;
+}
+
+static std::recursive_mutex _critical;
+
+void portENTER_CRITICAL(portMUX_TYPE * mux) { _critical.lock(); }
+void portEXIT_CRITICAL(portMUX_TYPE * mux) { _critical.unlock(); }
@@ -0,0 +1,137 @@
+// Integer colour conversion against floating point references, the same
+// formulas the tables were generated from
+#include <Arduino.h>
+#include "colors.h"
+#include "check.h"
+
+static int worst = 0;
+
+static void compare(const byte * actual, const double * expected) {
+    for (int i = 0; i < 3; i++) {
+        int reference = (int) lround(constrain(expected[i], 0.0, 255.0));
+        worst = max(worst, abs(actual[i] - reference));
+    }
+}
+
+static double srgb(double linear) {
+    return 255 * ((linear <= 0.0031308) ? 12.92 * linear : 1.055 * pow(linear, 1 / 2.4) - 0.055);
+}
+
+static void test_gamma_table() {
+    worst = 0;
+    for (int i = 0; i < 256; i++) {
+        worst = max(worst, abs(FAUXMO_GAMMA_TABLE[i] - (int) lround(srgb(i / 255.0))));
+    }
+    CHECK(worst <= 1);
+}
+
+static void test_hs_matches_float() {
+    worst = 0;
+    byte rgb[3];
+    for (long hue = 0; hue <= 65535; hue += 13) {
+        for (int sat = 0; sat <= 255; sat += 3) {
+            double h = hue / 65536.0 * 6, s = sat / 255.0;
+            int sector = (int) h;
+            double f = h - sector;
+            double p = 255 * (1 - s), q = 255 * (1 - f * s), t = 255 * (1 - (1 - f) * s);
+            double expected[6][3] = {{255, t, p}, {q, 255, p}, {p, 255, t}, {p, q, 255}, {t, p, 255}, {255, p, q}};
+            fauxmoesp_hs2rgb(hue, sat, rgb);
+            compare(rgb, expected[sector]);
+        }
+    }
+    CHECK(worst <= 2);
+}
+
+static void test_hs_primaries() {
+    byte rgb[3];
+    fauxmoesp_hs2rgb(0, 255, rgb);
+    CHECK(rgb[0] == 255 && rgb[1] == 0 && rgb[2] == 0);
+    fauxmoesp_hs2rgb(0, 0, rgb);
+    CHECK(rgb[0] == 255 && rgb[1] == 255 && rgb[2] == 255);
+    fauxmoesp_hs2rgb(65535, 255, rgb);
+    CHECK(rgb[0] == 255 && rgb[1] == 0 && rgb[2] <= 1);
+}
+
+static void test_ct_matches_float() {
+    worst = 0;
+    byte rgb[3];
+    for (int ct = FAUXMO_CT_MIN; ct <= FAUXMO_CT_MAX; ct++) {
+        double temp = 10000.0 / ct;
+        double expected[3] = {
+            255,
+            99.4708025861 * log(temp) - 161.1195681661,
+            (temp <= 19) ? 0 : 138.5177312231 * log(temp - 10) - 305.0447927307
+        };
+        fauxmoesp_ct2rgb(ct, rgb);
+        compare(rgb, expected);
+    }
+    CHECK(worst <= 1);
+}
+
+static void test_ct_is_clamped() {
+    byte low[3], min[3], high[3], max[3];
+    fauxmoesp_ct2rgb(0, low);
+    fauxmoesp_ct2rgb(FAUXMO_CT_MIN, min);
+    fauxmoesp_ct2rgb(65535, high);
+    fauxmoesp_ct2rgb(FAUXMO_CT_MAX, max);
+    CHECK(memcmp(low, min, 3) == 0);
+    CHECK(memcmp(high, max, 3) == 0);
+}
+
+static void test_xy_matches_float() {
+    worst = 0;
+    byte rgb[3];
+    for (int x = 0; x <= 10000; x += 50) {
+        for (int y = 50; y <= 10000 - x; y += 50) {
+            double X = x / (double) y, Z = (10000 - x - y) / (double) y;
+            double c[3] = {
+                 X * 1.6565 - 0.3549 - Z * 0.2550,
+                -X * 0.7072 + 1.6554 + Z * 0.0362,
+                 X * 0.0517 - 0.1214 + Z * 1.0115
+            };
+            double top = 0;
+            for (double & v : c) {
+                v = max(v, 0.0);
+                top = max(top, v);
+            }
+            double expected[3];
+            for (int i = 0; i < 3; i++) expected[i] = (top > 0) ? srgb(c[i] / top) : 255;
+            fauxmoesp_xy2rgb(x, y, rgb);
+            compare(rgb, expected);
+        }
+    }
+    // Channels are quantized to 8 bit before the gamma table, which
+    // stretches the steps near black to a few counts
+    CHECK(worst <= 6);
+}
+
+static void test_xy_reference_points() {
+    byte rgb[3];
+
+    // D65 white point
+    fauxmoesp_xy2rgb(3127, 3290, rgb);
+    CHECK(rgb[0] >= 240 && rgb[1] >= 240 && rgb[2] >= 240);
+
+    // Corners of the Hue gamut C
+    fauxmoesp_xy2rgb(6920, 3080, rgb);
+    CHECK(rgb[0] == 255 && rgb[1] < 60 && rgb[2] < 60);
+    fauxmoesp_xy2rgb(1700, 7000, rgb);
+    CHECK(rgb[1] == 255 && rgb[0] < 60);
+    fauxmoesp_xy2rgb(1530, 480, rgb);
+    CHECK(rgb[2] == 255 && rgb[1] < 60);
+
+    // Degenerate input stays defined
+    fauxmoesp_xy2rgb(0, 0, rgb);
+    fauxmoesp_xy2rgb(10000, 10000, rgb);
+}
+
+int main() {
+    RUN(test_gamma_table);
+    RUN(test_hs_matches_float);
+    RUN(test_hs_primaries);
+    RUN(test_ct_matches_float);
+    RUN(test_ct_is_clamped);
+    RUN(test_xy_matches_float);
+    RUN(test_xy_reference_points);
+    return 0;
+}
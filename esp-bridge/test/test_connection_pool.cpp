@@ -0,0 +1,299 @@
+// ConnectionPool contro un server scriptato: pipeline, keep-alive, retry,
+// circuit breaker e pool esaurito
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include <deque>
+#include <map>
+#include <string>
+#define private public
+#include "controller/ConnectionPool.h"
+#undef private
+#include "check.h"
+
+// -----------------------------------------------------------------------------
+// Server finto: ogni connect prende la prossima risposta preparata in scripts.
+// Senza '#' finale il server chiude appena è stata letta l'ultima risposta,
+// con il '#' la connessione resta aperta. "down" rifiuta, "nx" non si risolve.
+// -----------------------------------------------------------------------------
+
+struct Connection {
+    std::string input;
+    size_t read = 0;
+    bool open = false;
+};
+
+static std::deque<std::string> scripts;
+static std::string written;
+static Connection connections[16];
+static int opened = 0;
+static int refused = 0;
+static int lookups = 0;
+static bool dropOnWrite = false;
+static bool failWrite = false;
+static std::map<WiFiClient *, Connection *> peers;
+static std::vector<std::string> hosts;
+
+bool AsyncDNSCache::resolve(const char * host, IPAddress & ip, uint32_t timeout) {
+    lookups++;
+    if (!strcmp(host, "nx")) return false;
+    hosts.push_back(host);
+    ip = IPAddress((uint32_t) hosts.size() - 1);
+    return true;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    if (hosts[(uint32_t) ip] == "down") {
+        refused++;
+        return 0;
+    }
+    Connection * connection = &connections[opened++];
+    connection->open = true;
+    if (!scripts.empty()) {
+        connection->input = scripts.front();
+        scripts.pop_front();
+    }
+    peers[this] = connection;
+    return 1;
+}
+
+size_t WiFiClient::write(const uint8_t * data, size_t size) {
+    if (failWrite) {
+        failWrite = false;
+        return 0;
+    }
+    written.append((const char *) data, size);
+    if (dropOnWrite) {
+        dropOnWrite = false;
+        peers[this]->open = false;
+    }
+    return size;
+}
+
+static bool keptOpen(const Connection * c) {
+    return !c->input.empty() && c->input.back() == '#';
+}
+
+int WiFiClient::available() {
+    Connection * c = peers[this];
+    if (!c) return 0;
+    return c->input.size() - keptOpen(c) - c->read;
+}
+
+int WiFiClient::read() {
+    Connection * c = peers[this];
+    if (!c || c->read >= c->input.size() - keptOpen(c)) return -1;
+    return (unsigned char) c->input[c->read++];
+}
+
+bool WiFiClient::connected() {
+    Connection * c = peers[this];
+    return c && c->open && (c->read < c->input.size() || keptOpen(c));
+}
+
+void WiFiClient::stop() {
+    Connection * c = peers[this];
+    if (c) c->open = false;
+    peers[this] = nullptr;
+}
+
+// -----------------------------------------------------------------------------
+
+static ConnectionPool pool;
+static char requests[4][400];
+static HttpRequest batch[4];
+
+static void prepare(const char * host) {
+    const char * paths[] = {"/1", "/2", "/3", "/4"};
+    for (int i = 0; i < 4; i++) {
+        batch[i] = HttpRequest();
+        batch[i].length = ConnectionPool::formatRequest(host, paths[i], requests[i], sizeof(requests[i]));
+        batch[i].request = requests[i];
+    }
+}
+
+static int target(const char * host, TargetStatus * status) {
+    for (int i = 0; i < SystemConfig::POOL_TARGETS; i++) {
+        if (pool.getTarget(i, status) && !strcmp(status->host, host)) return i;
+    }
+    return -1;
+}
+
+static void test_url_e_richieste() {
+    char host[64];
+    uint16_t port;
+    const char * path;
+    CHECK(ConnectionPool::parseUrl("http://10.0.0.2:8080/a?b=1", host, sizeof(host), &port, &path));
+    CHECK_STR(host, "10.0.0.2");
+    CHECK_EQ(port, 8080);
+    CHECK_STR(path, "/a?b=1");
+    CHECK(ConnectionPool::parseUrl("http://h", host, sizeof(host), &port, &path));
+    CHECK_EQ(port, 80);
+    CHECK_STR(path, "/");
+    CHECK(!ConnectionPool::parseUrl("https://h/x", host, sizeof(host), &port, &path));
+
+    char tiny[20];
+    CHECK_EQ(ConnectionPool::formatRequest("h", "/1", tiny, sizeof(tiny)), -1);
+}
+
+// Content-Length, chunked e Connection: close in pipeline sulla stessa connessione
+static void test_pipeline() {
+    scripts.push_back(
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n"
+        "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    scripts.push_back("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nz");
+    prepare("h");
+    written.clear();
+    int before = opened;
+    pool.execute("h", 80, batch, 4);
+    CHECK(written.rfind(std::string(requests[0]) + requests[1] + requests[2] + requests[3], 0) == 0);
+    CHECK_EQ(batch[0].code, 200);
+    CHECK_EQ(batch[1].code, 200);
+    CHECK_EQ(batch[2].code, 404);
+    CHECK_EQ(batch[3].code, 200);
+    CHECK_STR(batch[1].body, "abc");
+    CHECK_STR(batch[3].body, "z");
+    CHECK_EQ(opened - before, 2);
+    CHECK_EQ(pool.getStats().pipelined, 3);
+}
+
+static void test_keep_alive_e_retry() {
+    prepare("k");
+    int before = opened;
+
+    scripts.push_back("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n#");
+    pool.execute("k", 80, batch, 1);
+    CHECK_EQ(batch[0].code, 200);
+    CHECK_EQ(opened - before, 1);
+
+    // Riusata
+    Connection * last = &connections[opened - 1];
+    last->input.pop_back();
+    last->input += "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n#";
+    pool.execute("k", 80, batch, 1);
+    CHECK_EQ(batch[0].code, 201);
+    CHECK_EQ(opened - before, 1);
+
+    // Chiusa dal server in silenzio: riaperta una volta
+    last->input.pop_back();
+    scripts.push_back("HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n#");
+    pool.execute("k", 80, batch, 1);
+    CHECK_EQ(batch[0].code, 202);
+    CHECK_EQ(opened - before, 2);
+
+    // Cade dopo che la richiesta è partita: non si rimanda, il comando fallisce
+    unsigned long retried = pool.getStats().retried;
+    written.clear();
+    dropOnWrite = true;
+    pool.execute("k", 80, batch, 1);
+    CHECK(batch[0].code < 0);
+    CHECK(written == requests[0]);
+    CHECK_EQ(opened - before, 2);
+    CHECK_EQ(pool.getStats().retried, retried);
+
+    // Rifiuta la scrittura: non è partito niente, si riapre una volta
+    scripts.push_back("HTTP/1.1 203 OK\r\nContent-Length: 0\r\n\r\n#");
+    pool.execute("k", 80, batch, 1);
+    scripts.push_back("HTTP/1.1 204 No Content\r\n\r\n#");
+    written.clear();
+    failWrite = true;
+    pool.execute("k", 80, batch, 1);
+    CHECK_EQ(batch[0].code, 204);
+    CHECK(written == requests[0]);
+    CHECK_EQ(opened - before, 4);
+    CHECK_EQ(pool.getStats().retried, retried + 1);
+
+    // Timeout adattivo su un host misurato
+    TargetStatus status;
+    CHECK(target("k", &status) >= 0);
+    CHECK_EQ(status.timeout, 1000);
+    CHECK_EQ(status.successes, 5);
+}
+
+static void test_circuit_breaker() {
+    prepare("down");
+
+    // Connessioni rifiutate: ogni esecuzione riprova, alla terza il breaker si apre
+    for (int i = 0; i < 3; i++) {
+        pool.execute("down", 80, batch, 2);
+        CHECK_EQ(batch[0].code, POOL_ERROR_CONNECT);
+        CHECK_EQ(batch[1].code, POOL_ERROR_CONNECT);
+    }
+    CHECK_EQ(refused, 9);
+    pool.execute("down", 80, batch, 1);
+    CHECK_EQ(batch[0].code, POOL_ERROR_CIRCUIT_OPEN);
+    CHECK_EQ(refused, 9);
+
+    TargetStatus status;
+    int down = target("down", &status);
+    CHECK(down >= 0);
+    CHECK(status.state == BREAKER_OPEN);
+    CHECK_EQ(status.failures, 3);
+    CHECK_EQ(status.fastFailed, 1);
+    CHECK(status.retryIn > 0);
+
+    // Prova half-open fallita: di nuovo aperto, attesa raddoppiata
+    pool.targets[down].openedAt -= 6000;
+    pool.execute("down", 80, batch, 1);
+    CHECK_EQ(batch[0].code, POOL_ERROR_CONNECT);
+    pool.getTarget(down, &status);
+    CHECK(status.state == BREAKER_OPEN);
+    CHECK_EQ(pool.targets[down].cooldown, 10000);
+}
+
+// Nessuna connessione libera è un limite locale: stato a parte, breaker intatto
+static void test_pool_esaurito() {
+    TargetStatus status;
+    int k = target("k", &status);
+    unsigned long failures = status.failures;
+    unsigned long busy = pool.getStats().busy;
+    for (int i = 0; i < SystemConfig::POOL_CONNECTIONS; i++) pool.slots[i].busy = true;
+
+    prepare("k");
+    pool.execute("k", 80, batch, 2);
+    CHECK_EQ(batch[0].code, POOL_ERROR_BUSY);
+    CHECK_EQ(batch[1].code, POOL_ERROR_BUSY);
+    pool.getTarget(k, &status);
+    CHECK(status.state == BREAKER_CLOSED);
+    CHECK_EQ(status.failures, failures);
+    CHECK_EQ(pool.getStats().busy, busy + 2);
+
+    // La prova half-open che non trova posto non conta: si ritira e si rifà dopo
+    int down = target("down", &status);
+    failures = status.failures;
+    pool.targets[down].openedAt -= 20000;
+    int before = refused;
+    prepare("down");
+    pool.execute("down", 80, batch, 1);
+    CHECK_EQ(batch[0].code, POOL_ERROR_BUSY);
+    CHECK_EQ(refused, before);
+    pool.getTarget(down, &status);
+    CHECK(status.state == BREAKER_OPEN);
+    CHECK_EQ(status.retryIn, 0);
+    CHECK_EQ(status.failures, failures);
+
+    for (int i = 0; i < SystemConfig::POOL_CONNECTIONS; i++) pool.slots[i].busy = false;
+    pool.execute("down", 80, batch, 1);
+    CHECK_EQ(batch[0].code, POOL_ERROR_CONNECT);
+    CHECK_EQ(refused, before + 3);
+}
+
+// Un nome che non si risolve si chiede una volta sola per tutto il batch
+static void test_dns() {
+    prepare("nx");
+    int before = lookups;
+    pool.execute("nx", 80, batch, 2);
+    CHECK_EQ(batch[0].code, POOL_ERROR_DNS);
+    CHECK_EQ(batch[1].code, POOL_ERROR_DNS);
+    CHECK_EQ(lookups - before, 1);
+}
+
+int main() {
+    RUN(test_url_e_richieste);
+    RUN(test_pipeline);
+    RUN(test_keep_alive_e_retry);
+    RUN(test_circuit_breaker);
+    RUN(test_pool_esaurito);
+    RUN(test_dns);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Fixed-capacity device table: stable ids, free list reuse and the name arena
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include "fauxmoESP.h"
+#include "check.h"
+
+typedef fauxmoDeviceTable<8, 32> table_t;
+
+static void test_ids_are_stable() {
+    static table_t table;
+    CHECK_EQ(table.add("a"), 0);
+    CHECK_EQ(table.add("b"), 1);
+    CHECK_EQ(table.add("c"), 2);
+    CHECK(table.remove(1));
+    CHECK(!table.remove(1));
+    CHECK(!table.used(1));
+    CHECK_STR(table[2].name, "c");
+    CHECK_EQ(table.size(), 2);
+    CHECK_EQ(table.end(), 3);
+
+    // Freed slots come back first, last freed first
+    CHECK(table.remove(0));
+    CHECK_EQ(table.add("d"), 0);
+    CHECK_EQ(table.add("e"), 1);
+    CHECK_EQ(table.add("f"), 3);
+    CHECK_EQ(table.next(0), 0);
+
+    CHECK(table.remove(3));
+    CHECK(table.remove(2));
+    CHECK_EQ(table.end(), 2);
+    CHECK_EQ(table.next(2), table.end());
+}
+
+static void test_capacity() {
+    static table_t table;
+    char name[4];
+    for (int i = 0; i < 8; i++) {
+        snprintf(name, sizeof(name), "%d", i);
+        CHECK_EQ(table.add(name), i);
+    }
+    CHECK_EQ(table.add("x"), FAUXMO_INVALID_ID);
+    CHECK(!table.used(8));
+    CHECK(!table.used(FAUXMO_INVALID_ID));
+}
+
+static void test_arena_compaction() {
+    static table_t table;
+    CHECK_EQ(table.add("0123456789"), 0);     // 11 bytes
+    CHECK_EQ(table.add("abcdefghij"), 1);     // 22
+    CHECK_EQ(table.add("ABCDEFGH"), 2);       // 31
+    CHECK_EQ(table.arenaUsed(), 31);
+    CHECK_EQ(table.add("z"), FAUXMO_INVALID_ID);
+
+    // Removing the first name moves the others down and fixes their pointers
+    CHECK(table.remove(0));
+    CHECK_EQ(table.arenaUsed(), 20);
+    CHECK_STR(table[1].name, "abcdefghij");
+    CHECK_STR(table[2].name, "ABCDEFGH");
+    CHECK_EQ(table.add("0123456789a"), 0);
+    CHECK_EQ(table.arenaUsed(), 32);
+}
+
+static void test_rename() {
+    static table_t table;
+    table.add("aaaa");
+    table.add("bbbbbbbb");
+    table.add("cc");
+    CHECK(table.rename(0, "a much longer"));
+    CHECK_STR(table[0].name, "a much longer");
+    CHECK_STR(table[1].name, "bbbbbbbb");
+    CHECK_STR(table[2].name, "cc");
+
+    // No room for the new name: refused, the old one stays
+    CHECK(!table.rename(2, "0123456789abcdefghi"));
+    CHECK_STR(table[2].name, "cc");
+    CHECK(!table.rename(5, "x"));
+}
+
+// A name read from the arena itself, e.g. renaming a device after another
+static void test_rename_from_arena() {
+    static table_t table;
+    table.add("first");
+    table.add("second");
+    table.add("third");
+    CHECK(table.rename(0, table[2].name));
+    CHECK_STR(table[0].name, "third");
+    CHECK_STR(table[1].name, "second");
+    CHECK_STR(table[2].name, "third");
+    CHECK(table.rename(1, table[1].name));
+    CHECK_STR(table[1].name, "second");
+    CHECK_EQ(table.arenaUsed(), strlen("third second third") + 1);
+
+    // No room for a copy: refused, nothing changes
+    static fauxmoDeviceTable<2, 16> full;
+    full.add("abcdefg");
+    full.add("hijklmn");
+    CHECK(!full.rename(0, full[1].name));
+    CHECK_STR(full[0].name, "abcdefg");
+    CHECK_STR(full[1].name, "hijklmn");
+}
+
+static void test_default_sizes_hold_every_name() {
+    static fauxmoDeviceTable<FAUXMO_MAX_DEVICES, FAUXMO_NAME_ARENA_SIZE> table;
+    char name[FAUXMO_DEVICE_NAME_LENGTH + 1];
+    for (int i = 0; i < FAUXMO_MAX_DEVICES; i++) {
+        memset(name, 'a' + i % 26, FAUXMO_DEVICE_NAME_LENGTH);
+        name[FAUXMO_DEVICE_NAME_LENGTH] = 0;
+        CHECK_EQ(table.add(name), i);
+    }
+    CHECK_EQ(table.arenaUsed(), FAUXMO_NAME_ARENA_SIZE);
+}
+
+int main() {
+    RUN(test_ids_are_stable);
+    RUN(test_capacity);
+    RUN(test_arena_compaction);
+    RUN(test_rename);
+    RUN(test_rename_from_arena);
+    RUN(test_default_sizes_hold_every_name);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Debounce del dispatcher: fusione dei comandi sullo stesso dispositivo,
+// burst che partono insieme e limiti della tabella di attesa
+#include <Arduino.h>
+#include <mutex>
+#include <vector>
+#define private public
+#include "controller/CommandDispatcher.h"
+#undef private
+#include "check.h"
+
+static Command command(int device, bool state, int member = 0) {
+    Command c{};
+    c.device = device;
+    c.member = member;
+    c.state = state;
+    c.enqueuedAt = millis();
+    return c;
+}
+
+// Fa scadere il debounce senza aspettarlo
+static void expire(CommandDispatcher & d) {
+    for (int i = 0; i < d.heldCount; i++) d.held[i].enqueuedAt -= SystemConfig::COMMAND_DEBOUNCE;
+}
+
+static void test_ultimo_stato_vince() {
+    CommandDispatcher d(nullptr, nullptr);
+    Command batch[SystemConfig::COMMAND_BATCH];
+    CHECK(d.hold(command(1, true)));
+    CHECK(d.hold(command(2, true)));
+    unsigned long first = d.held[0].enqueuedAt;
+    Command off = command(1, false);
+    off.enqueuedAt = first + 100;
+    CHECK(d.hold(off));
+    CHECK_EQ(d.heldCount, 2);
+    CHECK_EQ(d.getStats().merged, 1);
+
+    // Il comando fuso tiene posto e scadenza del primo
+    CHECK_EQ(d.held[0].enqueuedAt, first);
+    CHECK_EQ(d.release(batch, false), 0);
+
+    expire(d);
+    CHECK_EQ(d.release(batch, false), 2);
+    CHECK(batch[0].device == 1 && !batch[0].state);
+    CHECK(batch[1].device == 2 && batch[1].state);
+    CHECK_EQ(d.heldCount, 0);
+}
+
+static void test_membri_di_gruppo_separati() {
+    CommandDispatcher d(nullptr, nullptr);
+    CHECK(d.hold(command(3, true, 0)));
+    CHECK(d.hold(command(3, true, 1)));
+    CHECK(d.hold(command(3, false, 1)));
+    CHECK_EQ(d.heldCount, 2);
+    CHECK_EQ(d.getStats().merged, 1);
+}
+
+static void test_burst_limitato_al_batch() {
+    CommandDispatcher d(nullptr, nullptr);
+    Command batch[SystemConfig::COMMAND_BATCH];
+    for (int i = 0; i < SystemConfig::COMMAND_BATCH + 3; i++) CHECK(d.hold(command(i, true)));
+    expire(d);
+    CHECK_EQ(d.release(batch, false), SystemConfig::COMMAND_BATCH);
+    CHECK_EQ(batch[0].device, 0);
+    CHECK_EQ(d.heldCount, 3);
+    CHECK_EQ(d.held[0].device, SystemConfig::COMMAND_BATCH);
+    CHECK_EQ(d.release(batch, false), 3);
+}
+
+static void test_tabella_piena() {
+    CommandDispatcher d(nullptr, nullptr);
+    Command batch[SystemConfig::COMMAND_BATCH];
+    for (int i = 0; i < SystemConfig::COMMAND_QUEUE_LENGTH; i++) CHECK(d.hold(command(i, true)));
+    CHECK(!d.hold(command(100, true)));
+
+    // Un dispositivo già in attesa si fonde anche a tabella piena
+    CHECK(d.hold(command(0, false)));
+
+    // Forzando esce solo il più vecchio, quello che fa posto
+    CHECK_EQ(d.release(batch, true), 1);
+    CHECK(batch[0].device == 0 && !batch[0].state);
+    CHECK(d.hold(command(100, true)));
+}
+
+static void test_timeout_del_worker() {
+    CommandDispatcher d(nullptr, nullptr);
+    CHECK_EQ(d.holdTimeout(), portMAX_DELAY);
+    d.hold(command(1, true));
+    TickType_t timeout = d.holdTimeout();
+    CHECK(timeout <= pdMS_TO_TICKS(SystemConfig::COMMAND_DEBOUNCE) && timeout > 0);
+    expire(d);
+    CHECK_EQ(d.holdTimeout(), 0);
+}
+
+// Con i worker veri: on, on, off a pochi ms partono in una sola chiamata
+static std::mutex executedLock;
+static std::vector<std::vector<std::pair<int, bool>>> executed;
+
+static void record(void * context, const Command * commands, int count) {
+    std::lock_guard<std::mutex> lock(executedLock);
+    executed.emplace_back();
+    for (int i = 0; i < count; i++) executed.back().push_back({commands[i].device, commands[i].state});
+}
+
+static void test_worker() {
+    CommandDispatcher d(record, nullptr);
+    Command c = command(0, true);
+    CHECK(!d.submit(c));
+    CHECK(d.begin());
+    CHECK(d.begin());
+
+    c = command(1, true);
+    CHECK(d.submit(c));
+    c = command(2, true);
+    CHECK(d.submit(c));
+    c = command(1, false);
+    CHECK(d.submit(c));
+    delay(SystemConfig::COMMAND_DEBOUNCE / 3);
+    {
+        std::lock_guard<std::mutex> lock(executedLock);
+        CHECK(executed.empty());
+    }
+
+    unsigned long started = millis();
+    while (d.getStats().executed < 2 && millis() - started < 2000) delay(5);
+    DispatchStats stats = d.getStats();
+    CHECK_EQ(stats.submitted, 3);
+    CHECK_EQ(stats.merged, 1);
+    CHECK_EQ(stats.executed, 2);
+    CHECK_EQ(stats.held, 0);
+    std::lock_guard<std::mutex> lock(executedLock);
+    CHECK_EQ(executed.size(), 1);
+    CHECK(executed[0][0] == std::make_pair(1, false));
+    CHECK(executed[0][1] == std::make_pair(2, true));
+}
+
+int main() {
+    RUN(test_ultimo_stato_vince);
+    RUN(test_membri_di_gruppo_separati);
+    RUN(test_burst_limitato_al_batch);
+    RUN(test_tabella_piena);
+    RUN(test_timeout_del_worker);
+    RUN(test_worker);
+    return 0;
+}
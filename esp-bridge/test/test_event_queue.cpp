@@ -0,0 +1,209 @@
+// AsyncTCP event queue with priority classes: high events first, a normal one
+// after every burst of high ones, reordering on setPriority and event purging.
+// The queue code is cut out of AsyncTCP.cpp by the Makefile (event_queue.inc).
+#include <Arduino.h>
+#include <vector>
+#include "check.h"
+
+#define CONFIG_ASYNC_TCP_QUEUE_SIZE 32
+#define CONFIG_ASYNC_TCP_USE_WDT 0
+#define CONFIG_ASYNC_TCP_PRIORITY_BURST 8
+#define CONFIG_LWIP_MAX_ACTIVE_TCP 16
+#define ASYNC_PRIORITY_NORMAL 0
+#define ASYNC_PRIORITY_HIGH 1
+#define ERR_OK 0
+#define log_d(...)
+
+struct tcp_pcb;
+struct pbuf;
+struct ip_addr { uint32_t addr; };
+typedef ip_addr ip_addr_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xSemaphoreCreateMutex();
+}
+
+typedef struct {
+    uint32_t events[2];
+    uint32_t waitAvg[2];
+    uint32_t waitMax[2];
+    uint32_t forced;
+} AsyncQueueStats;
+
+// Just what the queue needs from a client, plus an id to tell events apart
+class AsyncClient {
+    public:
+        uint8_t _priority;
+        int id;
+        uint8_t getPriority() const { return _priority; }
+        void setPriority(uint8_t priority);
+        static AsyncQueueStats getQueueStats();
+};
+
+#include "event_queue.inc"
+
+static void post(lwip_event_t event, AsyncClient * client, bool front = false) {
+    lwip_event_packet_t * e = (lwip_event_packet_t *) malloc(sizeof(lwip_event_packet_t));
+    e->event = event;
+    e->arg = client;
+    bool queued = front ? _prepend_async_event(&e, 0, _client_priority(client)) : _send_async_event(&e, 0, _client_priority(client));
+    CHECK(queued);
+}
+
+// Next event handed to the service task as client id * 100 + event, -1 if none
+static int next() {
+    lwip_event_packet_t * e;
+    if (!_get_async_event(&e)) return -1;
+    int value = ((AsyncClient *) e->arg)->id * 100 + e->event;
+    free(e);
+    return value;
+}
+
+static bool drained() {
+    return _staged_count == 0 && uxQueueMessagesWaiting(_async_queue) == 0;
+}
+
+static AsyncClient normal{ASYNC_PRIORITY_NORMAL, 1};
+static AsyncClient high{ASYNC_PRIORITY_HIGH, 2};
+static AsyncClient control{ASYNC_PRIORITY_NORMAL, 3};
+static AsyncClient closing{ASYNC_PRIORITY_NORMAL, 4};
+
+static void test_high_goes_first() {
+    for (int i = 0; i < 5; i++) post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_RECV, &high);
+    CHECK_EQ(next(), 200 + LWIP_TCP_RECV);
+    for (int i = 0; i < 5; i++) CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK(drained());
+}
+
+static void test_no_starvation() {
+    for (int i = 0; i < 2; i++) post(LWIP_TCP_SENT, &normal);
+    for (int i = 0; i < 20; i++) post(LWIP_TCP_SENT, &high);
+    std::vector<int> order;
+    while (!drained()) order.push_back(next() / 100);
+    CHECK_EQ(order.size(), 22);
+    CHECK_EQ(order[CONFIG_ASYNC_TCP_PRIORITY_BURST], 1);
+    CHECK_EQ(order[2 * CONFIG_ASYNC_TCP_PRIORITY_BURST + 1], 1);
+}
+
+static void test_set_priority_moves_staged_events() {
+    post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_RECV, &control);
+    post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_FIN, &control);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);      // stages the rest
+    control.setPriority(ASYNC_PRIORITY_HIGH);
+    post(LWIP_TCP_ERROR, &control);
+    CHECK_EQ(next(), 300 + LWIP_TCP_RECV);
+    CHECK_EQ(next(), 300 + LWIP_TCP_FIN);
+    CHECK_EQ(next(), 300 + LWIP_TCP_ERROR);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK(drained());
+}
+
+static void test_clear_on_service_task() {
+    post(LWIP_TCP_SENT, &closing);
+    post(LWIP_TCP_SENT, &normal);
+    CHECK_EQ(next(), 400 + LWIP_TCP_SENT);
+    post(LWIP_TCP_RECV, &closing);
+    post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_FIN, &closing);
+    _tcp_clear_events(&closing);
+    CHECK_EQ(_staged_count, 1);
+    CHECK_EQ(uxQueueMessagesWaiting(_async_queue), 1);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK(drained());
+}
+
+// From another task with staging full the events are still dropped
+// before the service task hands out its next one
+static void test_clear_from_other_task() {
+    for (int i = 0; i < 16; i++) {
+        post(LWIP_TCP_SENT, &closing);
+        post(LWIP_TCP_SENT, &normal);
+    }
+    CHECK_EQ(next(), 400 + LWIP_TCP_SENT);
+    for (int i = 0; i < 8; i++) post(LWIP_TCP_RECV, &closing);
+    CHECK_EQ(_staged_count, 31);
+    CHECK_EQ(uxQueueMessagesWaiting(_async_queue), 8);
+
+    TaskHandle_t service = _async_service_task_handle;
+    _async_service_task_handle = (TaskHandle_t) 1;
+    _tcp_clear_events(&closing);
+    _async_service_task_handle = service;
+
+    for (int i = 0; i < 16; i++) CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK(drained());
+}
+
+// Class changed by another task: events queued before and after keep their order
+static void test_class_change_keeps_order() {
+    post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_RECV, &closing);
+    post(LWIP_TCP_SENT, &normal);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    closing._priority = ASYNC_PRIORITY_HIGH;
+    post(LWIP_TCP_FIN, &closing);
+    post(LWIP_TCP_SENT, &normal);
+    CHECK_EQ(next(), 400 + LWIP_TCP_RECV);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK_EQ(next(), 400 + LWIP_TCP_FIN);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    closing._priority = ASYNC_PRIORITY_NORMAL;
+}
+
+static void test_polls_coalesce_and_prepend() {
+    post(LWIP_TCP_POLL, &normal);
+    post(LWIP_TCP_POLL, &normal);
+    post(LWIP_TCP_SENT, &normal);
+    post(LWIP_TCP_CONNECTED, &high, true);
+    CHECK_EQ(next(), 200 + LWIP_TCP_CONNECTED);
+    CHECK_EQ(next(), 100 + LWIP_TCP_POLL);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    CHECK(drained());
+}
+
+static void test_overflow_drains_in_order() {
+    for (int i = 0; i < CONFIG_ASYNC_TCP_QUEUE_SIZE; i++) post(LWIP_TCP_SENT, &normal);
+    CHECK_EQ(next(), 100 + LWIP_TCP_SENT);
+    for (int i = 0; i < CONFIG_ASYNC_TCP_QUEUE_SIZE - 1; i++) post(LWIP_TCP_RECV, &normal);
+    int sent = 0, received = 0;
+    for (int i = 0; i < 2 * (CONFIG_ASYNC_TCP_QUEUE_SIZE - 1); i++) {
+        int event = next();
+        if (event == 100 + LWIP_TCP_SENT) {
+            CHECK_EQ(received, 0);
+            sent++;
+        } else {
+            CHECK_EQ(event, 100 + LWIP_TCP_RECV);
+            received++;
+        }
+    }
+    CHECK_EQ(sent, CONFIG_ASYNC_TCP_QUEUE_SIZE - 1);
+    CHECK_EQ(received, CONFIG_ASYNC_TCP_QUEUE_SIZE - 1);
+    CHECK(drained());
+}
+
+static void test_stats() {
+    AsyncQueueStats stats = AsyncClient::getQueueStats();
+    CHECK_EQ(stats.forced, 2);
+    CHECK(stats.events[ASYNC_PRIORITY_HIGH] > 20);
+    CHECK(stats.events[ASYNC_PRIORITY_NORMAL] > 90);
+    CHECK(stats.waitMax[ASYNC_PRIORITY_NORMAL] >= stats.waitAvg[ASYNC_PRIORITY_NORMAL]);
+}
+
+int main() {
+    CHECK(_init_async_event_queue());
+    _async_service_task_handle = xTaskGetCurrentTaskHandle();
+
+    RUN(test_high_goes_first);
+    RUN(test_no_starvation);
+    RUN(test_set_priority_moves_staged_events);
+    RUN(test_clear_on_service_task);
+    RUN(test_clear_from_other_task);
+    RUN(test_class_change_keeps_order);
+    RUN(test_polls_coalesce_and_prepend);
+    RUN(test_overflow_drains_in_order);
+    RUN(test_stats);
+    return 0;
+}
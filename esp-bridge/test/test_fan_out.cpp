@@ -0,0 +1,67 @@
+// FanOut: i lavori partono in parallelo e run() torna con il più lento
+#include <Arduino.h>
+#include <atomic>
+#include "controller/FanOut.h"
+#include "check.h"
+
+static const unsigned long JOB_MS = 100;
+
+static std::atomic<int> ran{0};
+static std::atomic<int> seen[SystemConfig::COMMAND_BATCH];
+
+static void slowJob(void * context, int index) {
+    delay(JOB_MS);
+    seen[index]++;
+    ran++;
+}
+
+static unsigned long timed(FanOut & fanOut, int count) {
+    unsigned long started = millis();
+    fanOut.run(slowJob, nullptr, count);
+    return millis() - started;
+}
+
+static void test_senza_task_in_sequenza() {
+    FanOut fanOut;
+    ran = 0;
+    unsigned long ms = timed(fanOut, 2);
+    CHECK_EQ(ran, 2);
+    CHECK(ms >= 2 * JOB_MS);
+}
+
+static void test_parallelo() {
+    FanOut fanOut;
+    CHECK(fanOut.begin());
+    CHECK(fanOut.begin());
+
+    // Un task per lavoro più il chiamante: il tempo è quello di uno solo
+    ran = 0;
+    unsigned long ms = timed(fanOut, SystemConfig::FANOUT_TASKS + 1);
+    CHECK_EQ(ran, SystemConfig::FANOUT_TASKS + 1);
+    CHECK(ms < 2 * JOB_MS);
+
+    // Più lavori che task: ogni lavoro una volta sola, a ondate
+    ran = 0;
+    for (auto & s : seen) s = 0;
+    ms = timed(fanOut, SystemConfig::COMMAND_BATCH);
+    CHECK_EQ(ran, SystemConfig::COMMAND_BATCH);
+    for (auto & s : seen) CHECK_EQ(s, 1);
+    int waves = (SystemConfig::COMMAND_BATCH + SystemConfig::FANOUT_TASKS) / (SystemConfig::FANOUT_TASKS + 1);
+    CHECK(ms < (waves + 1) * JOB_MS);
+}
+
+static void test_nessun_lavoro() {
+    FanOut fanOut;
+    fanOut.begin();
+    ran = 0;
+    fanOut.run(slowJob, nullptr, 0);
+    fanOut.run(slowJob, nullptr, -1);
+    CHECK_EQ(ran, 0);
+}
+
+int main() {
+    RUN(test_senza_task_in_sequenza);
+    RUN(test_parallelo);
+    RUN(test_nessun_lavoro);
+    return 0;
+}
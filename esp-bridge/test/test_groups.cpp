@@ -0,0 +1,186 @@
+// Gruppi di dispositivi da capo a fondo: configurazione, persistenza e
+// comando Alexa che si apre verso tutti i membri in parallelo. I target
+// rispondono dopo CONNECT_MS, come un ESP lento a dare la connessione.
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#define private public
+#include "controller/AlexaController.h"
+#undef private
+#include "check.h"
+
+static const unsigned long CONNECT_MS = 100;
+
+// -----------------------------------------------------------------------------
+// Rete finta: il resolver dà a ogni host un indirizzo 0.0.0.N, la connessione
+// a quell'indirizzo risponde 200 a ogni GET (404 a /pulsePins se non supportato)
+// -----------------------------------------------------------------------------
+
+struct Peer {
+    std::string host;
+    std::string input;
+    size_t read = 0;
+    bool open = false;
+};
+
+static std::mutex networkLock;
+static std::vector<std::string> hosts;
+static std::map<WiFiClient *, Peer> peers;
+static std::vector<std::string> requests;   // host + path, in ordine di arrivo
+static bool multiPin = false;
+
+bool AsyncDNSCache::resolve(const char * host, IPAddress & ip, uint32_t timeout) {
+    std::lock_guard<std::mutex> lock(networkLock);
+    auto known = std::find(hosts.begin(), hosts.end(), host);
+    if (known == hosts.end()) known = hosts.insert(hosts.end(), host);
+    ip = IPAddress((uint32_t) (known - hosts.begin()));
+    return true;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    delay(CONNECT_MS);
+    std::lock_guard<std::mutex> lock(networkLock);
+    Peer & peer = peers[this];
+    peer = Peer();
+    peer.host = hosts[(uint32_t) ip];
+    peer.open = true;
+    return 1;
+}
+
+size_t WiFiClient::write(const uint8_t * data, size_t size) {
+    std::lock_guard<std::mutex> lock(networkLock);
+    Peer & peer = peers[this];
+    std::string text((const char *) data, size);
+    for (size_t p = text.find("GET "); p != std::string::npos; p = text.find("GET ", p + 4)) {
+        std::string path = text.substr(p + 4, text.find(' ', p + 4) - p - 4);
+        requests.push_back(peer.host + path);
+        bool missing = !multiPin && path.find("/pulsePins") == 0;
+        peer.input += missing ? "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+                              : "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    }
+    return size;
+}
+
+int WiFiClient::available() {
+    std::lock_guard<std::mutex> lock(networkLock);
+    Peer & peer = peers[this];
+    return peer.input.size() - peer.read;
+}
+
+int WiFiClient::read() {
+    std::lock_guard<std::mutex> lock(networkLock);
+    Peer & peer = peers[this];
+    return peer.read < peer.input.size() ? (unsigned char) peer.input[peer.read++] : -1;
+}
+
+bool WiFiClient::connected() {
+    std::lock_guard<std::mutex> lock(networkLock);
+    return peers[this].open;
+}
+
+void WiFiClient::stop() {
+    std::lock_guard<std::mutex> lock(networkLock);
+    peers[this].open = false;
+}
+
+// -----------------------------------------------------------------------------
+
+static Preferences preferences;
+static SerialController serial;
+static fauxmoESP fauxmo;
+
+static void waitResults(AlexaController & alexa, int id, int results) {
+    unsigned long started = millis();
+    while (alexa.health[id].results < results && millis() - started < 5000) delay(5);
+    CHECK_EQ(alexa.health[id].results, results);
+}
+
+static void test_configurazione() {
+    DeviceController devices(&preferences, &serial);
+    devices.initialize();
+    CHECK(devices.addDevice("a", 5));
+    CHECK(devices.addDevice("b", String("http://h1/x")));
+    CHECK(devices.addDevice("c", String("http://h2/y")));
+
+    // Membri sconosciuti, troppi membri e gruppi annidati sono rifiutati
+    CHECK(!devices.addGroup("bad", "a;nope"));
+    CHECK(!devices.addGroup("bad", "a;a;a;a;a;a;a;a;a"));
+    CHECK(devices.addGroup("g", " a ; b;c ;http://h3/z"));
+    CHECK(devices.addDevice("d", 7));
+    CHECK(devices.addGroup("pins", "a;d"));
+    CHECK(!devices.addGroup("gg", "g"));
+
+    // Riletto dalle preferenze com'era, membri normalizzati
+    DeviceController reloaded(&preferences, &serial);
+    reloaded.initialize();
+    CHECK(reloaded.getDevicePtr(3)->isGroup);
+    CHECK(reloaded.getDevicePtr(3)->members == "a;b;c;http://h3/z");
+    CHECK_EQ(reloaded.getDevicePtr(3)->request.length(), 0);
+    CHECK(reloaded.getDevicePtr(0)->request == "GET /pulsePin?pin=5 HTTP/1.1\r\nHost: 192.168.178.164\r\nConnection: keep-alive\r\n\r\n");
+    CHECK_EQ(reloaded.getDevicePtr(0)->port, 80);
+}
+
+static void test_comandi() {
+    static DeviceController devices(&preferences, &serial);
+    devices.initialize();
+    static AlexaController alexa(&fauxmo, &devices, &serial);
+    CHECK(alexa.initialize());
+
+    // Quattro membri su tre host: il tempo è debounce + il più lento, non la somma
+    int g = fauxmo.getDeviceId("g");
+    CHECK_EQ(g, 3);
+    unsigned long started = millis();
+    AlexaController::onDeviceStateChanged(g, "g", true, 255);
+    waitResults(alexa, g, 4);
+    unsigned long ms = millis() - started;
+    CHECK(ms < SystemConfig::COMMAND_DEBOUNCE + CONNECT_MS + 80);
+    CHECK(alexa.health[g].confirmedState);
+    CHECK_EQ(alexa.health[g].successes, 4);
+
+    // Due pin sullo stesso ESP: una /pulsePins, al 404 si torna a /pulsePin in pipeline
+    {
+        std::lock_guard<std::mutex> lock(networkLock);
+        requests.clear();
+    }
+    int pins = fauxmo.getDeviceId("pins");
+    AlexaController::onDeviceStateChanged(pins, "pins", true, 255);
+    waitResults(alexa, pins, 2);
+    {
+        std::lock_guard<std::mutex> lock(networkLock);
+        CHECK_EQ(requests.size(), 3);
+        CHECK(requests[0].find("/pulsePins?pins=5,7") != std::string::npos);
+    }
+    CHECK(alexa.multiPinSupport == AlexaController::MULTI_PIN_UNSUPPORTED);
+
+    // Coda piena: il comando conta come fallito e lo stato torna indietro
+    QueueHandle_t queue = alexa.dispatcher.queue;
+    alexa.dispatcher.queue = nullptr;
+    int a = fauxmo.getDeviceId("a");
+    unsigned long failures = alexa.health[a].failures;
+    AlexaController::onDeviceStateChanged(a, "a", true, 255);
+    CHECK_EQ(alexa.health[a].failures, failures + 1);
+    CHECK_EQ(alexa.health[a].lastCode, COMMAND_ERROR_QUEUE_FULL);
+
+    // Per un gruppo falliscono tutti i membri insieme
+    failures = alexa.health[g].failures;
+    bool confirmed = alexa.health[g].confirmedState;
+    AlexaController::onDeviceStateChanged(g, "g", false, 0);
+    CHECK_EQ(alexa.health[g].failures, failures + 4);
+    CHECK_EQ(alexa.health[g].results, 4);
+    CHECK(alexa.health[g].resultFailed);
+    CHECK(alexa.health[g].confirmedState == confirmed);
+    alexa.dispatcher.queue = queue;
+}
+
+int main() {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    RUN(test_configurazione);
+    RUN(test_comandi);
+
+    // I worker restano in attesa sulle code, non si aspetta che finiscano
+    fflush(stdout);
+    _Exit(0);
+}
@@ -0,0 +1,129 @@
+// HTTP request parsing of the Hue emulation: framing, pipelining and bad lengths
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#define private public
+#include "fauxmoESP.h"
+#undef private
+#include "check.h"
+#include "host.h"
+
+static fauxmoESP fauxmo;
+static AsyncClient client;
+
+static int calls = 0;
+static bool lastState = false;
+static unsigned char lastValue = 0;
+
+static void feed(const char * data, size_t length) {
+    fauxmo._onTCPData(&client, 0, data, length);
+}
+
+static void feed(const std::string & data) {
+    feed(data.data(), data.size());
+}
+
+static size_t count(const std::string & text, const char * what) {
+    size_t n = 0;
+    for (size_t p = text.find(what); p != std::string::npos; p = text.find(what, p + 1)) n++;
+    return n;
+}
+
+static void reconnect() {
+    fauxmo._releaseTCPSlot(0);
+    fauxmo._onTCPClient(&client);
+    host::reset();
+}
+
+static void test_state_put_one_byte_at_a_time() {
+    reconnect();
+    const char * request =
+        "PUT /api/user/lights/1/state HTTP/1.1\r\n"
+        "Host: 192.168.1.10\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 22\r\n"
+        "\r\n"
+        "{\"on\":true,\"bri\":128}\n";
+    calls = 0;
+    for (size_t i = 0; i < strlen(request); i++) feed(request + i, 1);
+    CHECK_EQ(calls, 1);
+    CHECK(lastState);
+    CHECK_EQ(lastValue, 128);
+    CHECK(host::output.find("HTTP/1.1 200") == 0);
+    CHECK(host::output.find("success") != std::string::npos);
+}
+
+static void test_pipelined_gets() {
+    reconnect();
+    feed("GET /api/user/lights/1 HTTP/1.1\r\nHost: x\r\n\r\n"
+         "GET /api/user/lights/2 HTTP/1.1\r\n\r\n");
+    CHECK_EQ(count(host::output, "HTTP/1.1 200"), 2);
+    CHECK(host::output.find("luce studio") != std::string::npos);
+    CHECK(host::output.find("porta") != std::string::npos);
+    CHECK(host::output.find("<CLOSE>") == std::string::npos);
+}
+
+static void test_description() {
+    reconnect();
+    feed("GET /description.xml HTTP/1.1\r\n\r\n");
+    CHECK(host::output.find("HTTP/1.1 200") == 0);
+    CHECK(host::output.find("<root") != std::string::npos);
+}
+
+static void test_parse_length() {
+    CHECK_EQ(fauxmo._parseLength(" 22"), 22);
+    CHECK_EQ(fauxmo._parseLength("0"), 0);
+    CHECK_EQ(fauxmo._parseLength(" 7 \t"), 7);
+    CHECK(fauxmo._parseLength(" -1") == SIZE_MAX);
+    CHECK(fauxmo._parseLength("+5") == SIZE_MAX);
+    CHECK(fauxmo._parseLength("") == SIZE_MAX);
+    CHECK(fauxmo._parseLength("12abc") == SIZE_MAX);
+    CHECK(fauxmo._parseLength("99999999999999999999999") == SIZE_MAX);
+}
+
+// Lengths that would wrap or do not fit must reset the connection, and
+// never through close(), which frees the client under its own onData
+static void test_bad_length_aborts() {
+    const char * lengths[] = {"-1", "4294967295", "18446744073709551615", "18446744073709551616", "1x", "600"};
+    for (const char * length : lengths) {
+        reconnect();
+        feed(std::string("PUT /api/user/lights/1/state HTTP/1.1\r\nContent-Length: ") + length + "\r\n\r\n{\"on\":true}");
+        CHECK(host::output.find("<ABORT>") != std::string::npos);
+        CHECK(host::output.find("<CLOSE>") == std::string::npos);
+    }
+}
+
+static void test_url_overflow_aborts() {
+    reconnect();
+    feed("GET /" + std::string(FAUXMO_RX_BUFFER_SIZE, 'a') + " HTTP/1.1\r\n\r\n");
+    CHECK(host::output.find("<ABORT>") != std::string::npos);
+}
+
+static void test_body_without_length() {
+    reconnect();
+    calls = 0;
+    feed("PUT /api/user/lights/1/state HTTP/1.1\r\n\r\n{\"on\":true}");
+    CHECK(host::output.find("411 Length Required") != std::string::npos);
+    CHECK_EQ(calls, 0);
+    CHECK(fauxmo._tcpSlots[0].closeOnAck);
+}
+
+int main() {
+    fauxmo._enabled = true;
+    fauxmo.addDevice("luce studio");
+    fauxmo.addDevice("porta");
+    fauxmo.onSetState([](unsigned char id, const char * name, bool state, unsigned char value) {
+        calls++;
+        lastState = state;
+        lastValue = value;
+    });
+    fauxmo._onTCPClient(&client);
+
+    RUN(test_state_put_one_byte_at_a_time);
+    RUN(test_pipelined_gets);
+    RUN(test_description);
+    RUN(test_parse_length);
+    RUN(test_bad_length_aborts);
+    RUN(test_url_overflow_aborts);
+    RUN(test_body_without_length);
+    return 0;
+}
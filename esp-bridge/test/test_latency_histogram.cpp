@@ -0,0 +1,95 @@
+// Bucket dell'istogramma delle latenze: confini, errore massimo e percentili
+#include <Arduino.h>
+#define private public
+#include "model/LatencyHistogram.h"
+#undef private
+#include "check.h"
+
+static void test_bucket_limiti_contigui() {
+    // Ogni bucket comincia dove finisce il precedente
+    uint32_t start = 0;
+    for (int b = 0; b < LatencyHistogram::BUCKETS - 1; b++) {
+        uint32_t limit = LatencyHistogram::bucketLimit(b);
+        CHECK(limit > start);
+        CHECK_EQ(LatencyHistogram::bucketOf(start), b);
+        CHECK_EQ(LatencyHistogram::bucketOf(limit - 1), b);
+        CHECK_EQ(LatencyHistogram::bucketOf(limit), b + 1);
+        start = limit;
+    }
+    CHECK_EQ(LatencyHistogram::bucketLimit(LatencyHistogram::BUCKETS - 1), 0xFFFFFFFFu);
+}
+
+static void test_bucket_valori_estremi() {
+    CHECK_EQ(LatencyHistogram::bucketOf(0), 0);
+    CHECK_EQ(LatencyHistogram::bucketOf(3), 3);
+    CHECK_EQ(LatencyHistogram::bucketOf(4), 4);
+    CHECK_EQ(LatencyHistogram::bucketOf(0xFFFFFFFFu), LatencyHistogram::BUCKETS - 1);
+
+    // Fino a ~29 s si misura, oltre si finisce nell'ultimo bucket
+    CHECK_EQ(LatencyHistogram::bucketLimit(LatencyHistogram::BUCKETS - 2), 29360128u);
+    CHECK(LatencyHistogram::bucketOf(29000000) < LatencyHistogram::BUCKETS - 1);
+    CHECK_EQ(LatencyHistogram::bucketOf(30000000), LatencyHistogram::BUCKETS - 1);
+    CHECK_EQ(LatencyHistogram::bucketOf(0x80000000u), LatencyHistogram::BUCKETS - 1);
+}
+
+static void test_errore_massimo_25_percento() {
+    for (uint32_t us = 4; us < 40000000; us += 1 + us / 97) {
+        int b = LatencyHistogram::bucketOf(us);
+        if (b == LatencyHistogram::BUCKETS - 1) break;
+        uint32_t limit = LatencyHistogram::bucketLimit(b);
+        CHECK(limit > us);
+        CHECK((uint64_t) (limit - us) * 4 <= us);
+    }
+}
+
+static void test_record_e_statistiche() {
+    LatencyHistogram h;
+    CHECK_EQ(h.count(), 0);
+    CHECK_EQ(h.percentile(50), 0);
+    CHECK_EQ(h.mean(), 0);
+
+    h.record(100);
+    h.record(300);
+    CHECK_EQ(h.count(), 2);
+    CHECK_EQ(h.max(), 300);
+    CHECK_EQ(h.mean(), 200);
+    CHECK_EQ(h.bucket(LatencyHistogram::bucketOf(100)), 1);
+
+    h.clear();
+    CHECK_EQ(h.count(), 0);
+    CHECK_EQ(h.max(), 0);
+}
+
+static void test_percentili() {
+    LatencyHistogram h;
+
+    // Un solo valore: ogni percentile è il valore stesso, mai oltre il massimo
+    h.record(1000);
+    CHECK_EQ(h.percentile(0), 1000);
+    CHECK_EQ(h.percentile(50), 1000);
+    CHECK_EQ(h.percentile(100), 1000);
+
+    // 10..10000 us uniformi: il percentile è il limite del suo bucket
+    h.clear();
+    for (uint32_t i = 1; i <= 1000; i++) h.record(i * 10);
+    uint32_t p50 = h.percentile(50), p95 = h.percentile(95), p99 = h.percentile(99);
+    CHECK(p50 >= 5000 && p50 <= 6250);
+    CHECK(p95 >= 9500 && p95 <= 10000);
+    CHECK(p99 >= 9900 && p99 <= 10000);
+    CHECK(p50 <= p95 && p95 <= p99);
+    CHECK_EQ(h.percentile(100), 10000);
+
+    // Valori oltre l'ultimo limite riportano il massimo vero
+    h.clear();
+    h.record(0xFFFFFFF0u);
+    CHECK_EQ(h.percentile(99), 0xFFFFFFF0u);
+}
+
+int main() {
+    RUN(test_bucket_limiti_contigui);
+    RUN(test_bucket_valori_estremi);
+    RUN(test_errore_massimo_25_percento);
+    RUN(test_record_e_statistiche);
+    RUN(test_percentili);
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Device name lookup: case, accent and blank folding, probing and capacity
+#include <Arduino.h>
+#include "nameindex.h"
+#include "check.h"
+
+static const char * names[] = {"Luce Città", "Cucina", "  Camera   da letto ", "TV", "Straße", "Ÿÿ"};
+static const int COUNT = sizeof(names) / sizeof(names[0]);
+
+static const char * nameOf(void * context, int value) {
+    return ((const char **) context)[value];
+}
+
+static void test_folding() {
+    NameIndex<16> index(nameOf, names);
+    for (int i = 0; i < COUNT; i++) CHECK(index.insert(names[i], i));
+    CHECK_EQ(index.size(), COUNT);
+
+    CHECK_EQ(index.find("Luce Città"), 0);
+    CHECK_EQ(index.find("luce citta"), 0);
+    CHECK_EQ(index.find("LUCE CITTÀ"), 0);
+    CHECK_EQ(index.find("cucina"), 1);
+    CHECK_EQ(index.find("camera da letto"), 2);
+    CHECK_EQ(index.find("\tCamera da  letto"), 2);
+    CHECK_EQ(index.find("tv"), 3);
+
+    // Sharp s folds to a single s, and must not alias ÿ
+    CHECK_EQ(index.find("straße"), 4);
+    CHECK_EQ(index.find("STRAßE"), 4);
+    CHECK_EQ(index.find("strase"), 4);
+    CHECK_EQ(index.find("strayye"), -1);
+    CHECK_EQ(index.find("Ÿy"), 5);
+}
+
+static void test_misses() {
+    NameIndex<16> index(nameOf, names);
+    for (int i = 0; i < COUNT; i++) index.insert(names[i], i);
+    CHECK_EQ(index.find("garage"), -1);
+    CHECK_EQ(index.find("Luce Citt"), -1);
+    CHECK_EQ(index.find(""), -1);
+    CHECK_EQ(index.find(NULL), -1);
+}
+
+static void test_every_latin1_letter_folds() {
+    // U+00C0..U+00FF: upper and lower case hash alike, except × and ÷
+    for (int cp = 0xC0; cp <= 0xDE; cp++) {
+        if (cp == 0xD7) continue;
+        char upper[3] = {(char) 0xC3, (char) (0x80 + cp - 0xC0), 0};
+        char lower[3] = {(char) 0xC3, (char) (0xA0 + cp - 0xC0), 0};
+        CHECK(NameIndex<1>::equals(upper, lower));
+        CHECK_EQ(NameIndex<1>::hash(upper), NameIndex<1>::hash(lower));
+    }
+    CHECK(!NameIndex<1>::equals("×", "÷"));
+}
+
+static const char * numbered(void * context, int value) {
+    static char buffer[16];
+    snprintf(buffer, sizeof(buffer), "luce %d", value);
+    return buffer;
+}
+
+static void test_capacity_and_clear() {
+    NameIndex<100> index(numbered, nullptr);
+    char name[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "Luce %d", i);
+        CHECK(index.insert(name, i));
+    }
+    CHECK(!index.insert("altra", 100));
+    CHECK(!index.insert("negativo", -1));
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "LUCE  %d", i);
+        CHECK_EQ(index.find(name), i);
+    }
+    index.clear();
+    CHECK_EQ(index.size(), 0);
+    CHECK_EQ(index.find("luce 7"), -1);
+}
+
+int main() {
+    RUN(test_folding);
+    RUN(test_misses);
+    RUN(test_every_latin1_letter_folds);
+    RUN(test_capacity_and_clear);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// One-pass Hue state tokenizer: every attribute of a body, applied together
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#define private public
+#include "fauxmoESP.h"
+#undef private
+#include "check.h"
+
+static fauxmoESP fauxmo;
+
+static bool parse(const char * body, fauxmoesp_state_t * state) {
+    return fauxmo._parseState(body, strlen(body), state);
+}
+
+static void test_all_attributes() {
+    fauxmoesp_state_t state;
+    CHECK(parse("{\"on\":true,\"bri\":128,\"xy\":[0.3227,0.329],\"transitiontime\": 4, \"name\":\"x\", \"ct\": 366}", &state));
+    CHECK_EQ(state.fields, FAUXMO_STATE_ON | FAUXMO_STATE_BRI | FAUXMO_STATE_XY | FAUXMO_STATE_TRANSITION | FAUXMO_STATE_CT);
+    CHECK(state.on);
+    CHECK_EQ(state.bri, 128);
+    CHECK_EQ(state.x, 3227);
+    CHECK_EQ(state.y, 3290);
+    CHECK_EQ(state.transitiontime, 4);
+    CHECK_EQ(state.ct, 366);
+}
+
+static void test_hue_and_sat() {
+    fauxmoesp_state_t state;
+    CHECK(parse("{\"hue\": 21845, \"sat\": 254}", &state));
+    CHECK_EQ(state.fields, FAUXMO_STATE_HUE | FAUXMO_STATE_SAT);
+    CHECK_EQ(state.hue, 21845);
+    CHECK_EQ(state.sat, 254);
+}
+
+static void test_clamping() {
+    fauxmoesp_state_t state;
+    CHECK(parse("{\"bri\":300,\"sat\":-4,\"hue\":70000,\"xy\":[1.5,-0.2]}", &state));
+    CHECK_EQ(state.bri, 255);
+    CHECK_EQ(state.sat, 0);
+    CHECK_EQ(state.hue, 65535);
+    CHECK_EQ(state.x, 10000);
+    CHECK_EQ(state.y, 0);
+}
+
+static void test_numbers_too_long_saturate() {
+    fauxmoesp_state_t state;
+    CHECK(parse("{\"bri\":300000,\"hue\":4294967296}", &state));
+    CHECK_EQ(state.bri, 255);
+    CHECK_EQ(state.hue, 65535);
+    CHECK(parse("{\"bri\":99999999999999999999999999,\"xy\":[0.123456789012345678901234,0.5]}", &state));
+    CHECK_EQ(state.bri, 255);
+    CHECK_EQ(state.x, 1234);
+    CHECK_EQ(state.y, 5000);
+}
+
+static void test_rejected_bodies() {
+    fauxmoesp_state_t state;
+    CHECK(!parse("{\"on\": null}", &state));
+    CHECK(!parse("{\"bri\": \"128\"}", &state));
+    CHECK(!parse("{\"xy\": [0.3]}", &state));
+    CHECK(!parse("{\"devicetype\":\"Echo\"}", &state));
+    CHECK(!parse("", &state));
+    CHECK(!parse("{\"on", &state));
+    CHECK(!parse("{\"on\":", &state));
+}
+
+// Only the first len bytes count, the body is not NUL terminated on the wire
+static void test_length_bound() {
+    fauxmoesp_state_t state;
+    const char * body = "{\"bri\":12345}";
+    CHECK(fauxmo._parseState(body, 9, &state));
+    CHECK_EQ(state.bri, 12);
+}
+
+static void test_apply_together() {
+    fauxmoesp_state_t state;
+    parse("{\"on\":true,\"bri\":128}", &state);
+    fauxmo._applyState(0, &state);
+    CHECK(fauxmo._devices[0].state);
+    CHECK_EQ(fauxmo._devices[0].value, 128);
+
+    // Switching off keeps the brightness asked for with it
+    parse("{\"on\": false, \"bri\": 200}", &state);
+    fauxmo._applyState(0, &state);
+    CHECK(!fauxmo._devices[0].state);
+    CHECK_EQ(fauxmo._devices[0].value, 200);
+
+    parse("{\"hue\": 21845, \"sat\": 254}", &state);
+    fauxmo._applyState(0, &state);
+    CHECK(fauxmo._devices[0].rgb[1] > 250);
+    CHECK(fauxmo._devices[0].rgb[0] < 5);
+    CHECK(fauxmo._devices[0].rgb[2] < 5);
+}
+
+int main() {
+    fauxmo._enabled = true;
+    fauxmo.addDevice("luce");
+
+    RUN(test_all_attributes);
+    RUN(test_hue_and_sat);
+    RUN(test_clamping);
+    RUN(test_numbers_too_long_saturate);
+    RUN(test_rejected_bodies);
+    RUN(test_length_bound);
+    RUN(test_apply_together);
+    return 0;
+}